@@ -0,0 +1,261 @@
+/* Codegen benchmark: compile time, peak memory, code size and simulated cycles per program
+ *
+ *   codegen_bench [--runs=N] [--baseline=FILE] [--threshold=PCT] --results=FILE <compiler> <program.stump>...
+ *
+ * Each program is compiled N times by running the compiler (best wall time, peak RSS of the
+ * child), then its output/output.s is assembled and simulated until it halts. Like the
+ * programs in tests/, each starts with `// result: N`; a run that stops on the step limit or
+ * a bad fetch, or halts with anything else in R1, fails before any metric counts. Results are
+ * written as JSON, one program per line. With a baseline, any metric that got worse past its
+ * threshold fails the run:
+ *  - instructions, words and cycles are deterministic, --threshold (default 1%)
+ *  - compile time and memory are noisy, 50% / 25% on top of a small absolute slack */
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "source.h"
+#include "assembler.h"
+#include "simulator.h"
+
+static constexpr const char* OUTPUT_FILE = "output/output.s";
+static constexpr uint64_t STEP_LIMIT = 100000000;
+
+struct Result {
+    std::string name;
+    double compileMs = 0;
+    long peakKiB = 0;
+    uint64_t instructions = 0;
+    uint64_t words = 0;
+    uint64_t cycles = 0;
+};
+
+/* Metric the gate checks: how to read it and how much worse it may get */
+struct Metric {
+    const char* key;
+    double (*get)(const Result&);
+    double percent;
+    double slack;       // absolute allowance, for noisy metrics
+};
+
+// ==================================== Measuring ====================================
+
+/* Runs the compiler once with stdout discarded, returns wall ms and the child's peak RSS */
+static bool compile(const std::string& compiler, const std::string& program, double& ms, long& peakKiB) {
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) dup2(null, STDOUT_FILENO);
+        execl(compiler.c_str(), compiler.c_str(), program.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage {};
+    if (wait4(pid, &status, 0, &usage) < 0) return false;
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    peakKiB = usage.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* N from the program's `// result: N` first line */
+static bool expected(const std::string& program, int16_t& value) {
+    std::ifstream in(program);
+    std::string line;
+    const std::string header = "// result: ";
+    if (!std::getline(in, line) || line.rfind(header, 0) != 0) return false;
+    try {
+        value = static_cast<int16_t>(std::stoi(line.substr(header.size())));
+    } catch (const std::logic_error&) {
+        return false;
+    }
+    return true;
+}
+
+static bool measure(const std::string& compiler, const std::string& program, int runs, Result& result) {
+    int16_t want = 0;
+    if (!expected(program, want)) {
+        std::cerr << program << ": first line should be // result: N" << std::endl;
+        return false;
+    }
+    std::string base = program.substr(program.find_last_of('/') + 1);
+    result.name = base.substr(0, base.rfind('.'));
+    result.compileMs = 1e300;
+    for (int i = 0; i < runs; i++) {
+        double ms = 0;
+        long peak = 0;
+        if (!compile(compiler, program, ms, peak)) {
+            std::cerr << program << ": compiler failed" << std::endl;
+            return false;
+        }
+        result.compileMs = std::min(result.compileMs, ms);
+        result.peakKiB = std::max(result.peakKiB, peak);
+    }
+
+    try {
+        SourceBuffer source(OUTPUT_FILE);
+        Image image = Assembler(source.view()).assemble();
+        Simulator sim(image);
+        Simulator::Stop stop = sim.run(STEP_LIMIT);
+        if (stop != Simulator::Stop::HALTED) {
+            std::cerr << program << (stop == Simulator::Stop::STEP_LIMIT ? ": did not halt within " : ": executed non-code after ")
+                      << sim.steps() << " steps" << std::endl;
+            return false;
+        }
+        int16_t got = static_cast<int16_t>(sim.reg(1));
+        if (got != want) {
+            std::cerr << program << ": result " << got << ", expected " << want << std::endl;
+            return false;
+        }
+        result.instructions = static_cast<uint64_t>(std::count(image.code.begin(), image.code.end(), true));
+        result.words = image.words;
+        result.cycles = sim.cycles();
+    } catch (const std::runtime_error& e) {
+        std::cerr << program << ": " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ===================================== Results =====================================
+
+static std::string toJson(const Result& r) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3)
+        << "{\"name\": \"" << r.name << "\", \"compile_ms\": " << r.compileMs
+        << ", \"peak_kib\": " << r.peakKiB << ", \"instructions\": " << r.instructions
+        << ", \"words\": " << r.words << ", \"cycles\": " << r.cycles << "}";
+    return out.str();
+}
+
+/* Value of "key" on a line written by toJson */
+static std::string field(const std::string& line, const std::string& key) {
+    size_t at = line.find("\"" + key + "\":");
+    if (at == std::string::npos) return "";
+    at = line.find_first_not_of(" \"", at + key.size() + 3);
+    size_t end = line.find_first_of(",}\"", at);
+    return line.substr(at, end - at);
+}
+
+static std::map<std::string, Result> readResults(const std::string& path) {
+    std::map<std::string, Result> results;
+    std::ifstream in(path);
+    for (std::string line; std::getline(in, line);) {
+        if (line.find("\"name\"") == std::string::npos) continue;
+        Result r;
+        r.name = field(line, "name");
+        r.compileMs = std::stod(field(line, "compile_ms"));
+        r.peakKiB = std::stol(field(line, "peak_kib"));
+        r.instructions = std::stoull(field(line, "instructions"));
+        r.words = std::stoull(field(line, "words"));
+        r.cycles = std::stoull(field(line, "cycles"));
+        results[r.name] = r;
+    }
+    return results;
+}
+
+static void writeResults(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream out(path);
+    out << "{\"programs\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        out << "  " << toJson(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+}
+
+// ====================================== Harness ======================================
+
+int main(int argc, char** argv) {
+    int runs = 3;
+    double threshold = 1.0;
+    std::string baselinePath, resultsPath, compiler;
+    std::vector<std::string> programs;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--runs=", 0) == 0) {
+            runs = std::max(1, std::stoi(arg.substr(7)));
+        } else if (arg.rfind("--baseline=", 0) == 0) {
+            baselinePath = arg.substr(11);
+        } else if (arg.rfind("--threshold=", 0) == 0) {
+            threshold = std::stod(arg.substr(12));
+        } else if (arg.rfind("--results=", 0) == 0) {
+            resultsPath = arg.substr(10);
+        } else if (compiler.empty()) {
+            compiler = arg;
+        } else {
+            programs.push_back(arg);
+        }
+    }
+    if (resultsPath.empty() || compiler.empty() || programs.empty()) {
+        std::cerr << "Usage should be..." << std::endl;
+        std::cerr << "./bin/codegen_bench [--runs=N] [--baseline=FILE] [--threshold=PCT] --results=FILE <compiler> <program.stump>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Result> results;
+    for (const std::string& program : programs) {
+        Result r;
+        if (!measure(compiler, program, runs, r)) return EXIT_FAILURE;
+        results.push_back(r);
+    }
+    writeResults(resultsPath, results);
+
+    const Metric metrics[] = {
+        {"instructions", [](const Result& r) { return double(r.instructions); }, threshold, 0},
+        {"words",        [](const Result& r) { return double(r.words); },        threshold, 0},
+        {"cycles",       [](const Result& r) { return double(r.cycles); },       threshold, 0},
+        {"compile_ms",   [](const Result& r) { return r.compileMs; },            50.0, 5.0},
+        {"peak_kib",     [](const Result& r) { return double(r.peakKiB); },      25.0, 1024.0},
+    };
+
+    std::map<std::string, Result> baseline;
+    if (!baselinePath.empty()) baseline = readResults(baselinePath);
+
+    std::cout << std::left << std::setw(12) << "program" << std::right
+              << std::setw(12) << "compile ms" << std::setw(10) << "peak KiB"
+              << std::setw(8) << "instrs" << std::setw(8) << "words" << std::setw(12) << "cycles" << "\n";
+    int regressions = 0;
+    for (const Result& r : results) {
+        std::cout << std::left << std::setw(12) << r.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(12) << r.compileMs << std::setw(10) << r.peakKiB
+                  << std::setw(8) << r.instructions << std::setw(8) << r.words << std::setw(12) << r.cycles << "\n";
+        if (baselinePath.empty()) continue;
+        auto base = baseline.find(r.name);
+        if (base == baseline.end()) {
+            std::cout << "    not in baseline" << "\n";
+            continue;
+        }
+        for (const Metric& m : metrics) {
+            double now = m.get(r), before = m.get(base->second);
+            if (now == before) continue;
+            double change = before != 0 ? 100.0 * (now - before) / before : 100.0;
+            bool regressed = now > before * (1 + m.percent / 100) + m.slack;
+            if (regressed || m.slack == 0) {
+                std::cout << std::defaultfloat << std::setprecision(6) << "    " << m.key << ": " << before << " -> " << now
+                          << " (" << std::showpos << change << std::noshowpos << "%)"
+                          << (regressed ? "  REGRESSION" : "") << "\n";
+            }
+            if (regressed) regressions++;
+        }
+    }
+    std::cout << "results written to " << resultsPath << std::endl;
+
+    if (regressions > 0) {
+        std::cerr << regressions << " metric(s) regressed past the threshold against " << baselinePath << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
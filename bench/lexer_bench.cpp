@@ -0,0 +1,208 @@
+/* Lexer benchmark: MiB/s, tokens/sec and peak RSS of the mmap'd span lexer against
+ * the original stringstream + std::optional<std::string> token path.
+ *
+ *   lexer_bench generate <statements> <out.stump>
+ *   lexer_bench modules <files> <statements> <dir>    a program split over files, for -j builds
+ *   lexer_bench <legacy|mmap|stream> <input.stump> [repeat]
+ *
+ * stream pulls tokens one at a time the way the parser does, without collecting them
+ *
+ * Run each mode in its own process so peak RSS isn't shared between them. */
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/resource.h>
+
+#include "source.h"
+#include "lexer.h"
+
+// ================================ Legacy Reference ================================
+
+/* Token layout and lexing loop as they were before the span lexer */
+struct LegacyToken {
+    TokenType type;
+    std::optional<std::string> value;
+};
+
+static std::vector<LegacyToken> legacyTokenise(const std::string& src) {
+    std::vector<LegacyToken> tokens;
+    std::string buffer;
+    size_t idx = 0;
+    auto peek = [&](size_t ahead = 0) -> std::optional<char> {
+        if (idx + ahead >= src.length()) return {};
+        return src.at(idx + ahead);
+    };
+
+    static const std::unordered_map<std::string, TokenType> text_tokens = {
+        {"return", TokenType::RETURN}, {"if", TokenType::IF},
+        {"while", TokenType::WHILE}, {"else", TokenType::ELSE},
+        {"fn", TokenType::FUNCTION}, {"int", TokenType::INT},
+        {"bool", TokenType::BOOL}, {"true", TokenType::TRUE},
+        {"false", TokenType::FALSE}, {"effects", TokenType::EFFECTS}
+    };
+
+    while (peek().has_value()) {
+        char c = peek().value();
+        if (std::isspace(c)) idx++;
+        else if (c == '/' && peek(1).has_value() && peek(1).value() == '/') {
+            while (peek().has_value() && peek().value() != '\n') idx++;
+        }
+        else if (std::isdigit(c)) {
+            while (peek().has_value() && std::isdigit(peek().value())) buffer.push_back(src.at(idx++));
+            tokens.push_back({TokenType::INT_LIT, buffer});
+            buffer.clear();
+        }
+        else if (std::isalpha(c)) {
+            while (peek().has_value() && std::isalnum(peek().value())) buffer.push_back(src.at(idx++));
+            auto text_token = text_tokens.find(buffer);
+            if (text_token != text_tokens.end()) tokens.push_back({text_token->second, std::nullopt});
+            else tokens.push_back({TokenType::IDENTIFIER, buffer});
+            buffer.clear();
+        }
+        else {
+            TokenType type = TokenType::INVALID;
+            switch (c) {
+                case ';': type = TokenType::SEMI; break;
+                case '(': type = TokenType::LBRACKET; break;
+                case ')': type = TokenType::RBRACKET; break;
+                case '{': type = TokenType::LBRACE; break;
+                case '}': type = TokenType::RBRACE; break;
+                case ',': type = TokenType::COMMA; break;
+                case '[': type = TokenType::LSQUARE; break;
+                case ']': type = TokenType::RSQUARE; break;
+                case '+': type = TokenType::PLUS; break;
+                case '*': type = TokenType::MULTIPLY; break;
+                case '/': type = TokenType::DIVIDE; break;
+                case '-':
+                    if (peek(1).has_value() && peek(1).value() == '>') { idx++; type = TokenType::ARROW; }
+                    else type = TokenType::MINUS;
+                    break;
+                case '=':
+                    if (peek(1).has_value() && peek(1).value() == '=') { idx++; type = TokenType::EQUALS; }
+                    else type = TokenType::ASSIGN;
+                    break;
+                default: break;
+            }
+            idx++;
+            tokens.push_back({type, std::nullopt});
+        }
+    }
+    tokens.push_back({TokenType::END_OF_FILE, std::nullopt});
+    return tokens;
+}
+
+// ==================================== Harness ====================================
+
+static void generate(size_t statements, const std::string& path) {
+    std::ofstream out(path);
+    size_t perFunction = 64;
+    for (size_t i = 0; i < statements; i++) {
+        if (i % perFunction == 0) {
+            if (i > 0) out << "    return v" << (i - 1) << ";\n}\n\n";
+            out << "fn f" << (i / perFunction) << "(a, b) -> int effects [] {\n";
+            out << "    // generated block " << (i / perFunction) << "\n";
+            out << "    int v" << i << " = a + " << (i % 97) << ";\n";
+            continue;
+        }
+        out << "    int v" << i << " = v" << (i - 1) << " * " << (i % 13) << " + (b - " << (i % 31) << " );\n";
+    }
+    out << "    return v" << (statements - 1) << ";\n}\n";
+}
+
+/* Files m0..m<files-1> of `statements` each, in functions named after the file that each call
+ * the next one so none is dead; m0 also holds main calling the first function of every file */
+static void generateModules(size_t files, size_t statements, const std::string& dir) {
+    size_t perFunction = 64;
+    for (size_t m = 0; m < files; m++) {
+        std::ofstream out(dir + "/m" + std::to_string(m) + ".stump");
+        std::string prefix = "m" + std::to_string(m) + "f";
+        for (size_t i = 0; i < statements; i++) {
+            if (i % perFunction == 0) {
+                if (i > 0) out << "    return v" << (i - 1) << " + " << prefix << (i / perFunction) << "(v" << (i - 1) << ", b);\n}\n\n";
+                out << "fn " << prefix << (i / perFunction) << "(a, b) -> int effects [] {\n";
+                out << "    int v" << i << " = a + " << (i % 97) << ";\n";
+                continue;
+            }
+            out << "    int v" << i << " = v" << (i - 1) << " * " << (i % 13) << " + (b - " << (i % 31) << " );\n";
+        }
+        out << "    return v" << (statements - 1) << ";\n}\n";
+        if (m == 0) {
+            out << "\nfn main() -> int effects [] {\n    int s = 0;\n";
+            for (size_t k = 0; k < files; k++) out << "    s = s + m" << k << "f0(s, " << k << ");\n";
+            out << "    return s;\n}\n";
+        }
+    }
+}
+
+static long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 4 && std::string(argv[1]) == "generate") {
+        generate(std::stoul(argv[2]), argv[3]);
+        return EXIT_SUCCESS;
+    }
+    if (argc >= 5 && std::string(argv[1]) == "modules") {
+        generateModules(std::stoul(argv[2]), std::stoul(argv[3]), argv[4]);
+        return EXIT_SUCCESS;
+    }
+    if (argc < 3) {
+        std::cerr << "Usage should be..." << std::endl;
+        std::cerr << "./bin/lexer_bench generate <statements> <out.stump>" << std::endl;
+        std::cerr << "./bin/lexer_bench modules <files> <statements> <dir>" << std::endl;
+        std::cerr << "./bin/lexer_bench <legacy|mmap|stream> <input.stump> [repeat]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string mode = argv[1];
+    int repeat = argc >= 4 ? std::stoi(argv[3]) : 5;
+    size_t tokenCount = 0;
+    size_t bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++) {
+        if (mode == "legacy") {
+            std::stringstream contents_stream;
+            std::fstream input(argv[2], std::ios::in);
+            contents_stream << input.rdbuf();
+            std::string contents = contents_stream.str();
+            bytes = contents.size();
+            tokenCount = legacyTokenise(contents).size();
+        } else if (mode == "mmap") {
+            SourceBuffer source(argv[2]);
+            bytes = source.view().size();
+            Interner interner;
+            Lexer lexer(source.view(), interner);
+            tokenCount = lexer.tokenise().size();
+        } else if (mode == "stream") {
+            SourceBuffer source(argv[2]);
+            bytes = source.view().size();
+            Interner interner;
+            Lexer lexer(source.view(), interner);
+            tokenCount = 1;
+            while (lexer.next().type != TokenType::END_OF_FILE) tokenCount++;
+        } else {
+            std::cerr << "unknown mode " << mode << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double seconds = elapsed.count() / repeat;
+    std::cout << mode << ": "
+              << tokenCount << " tokens, "
+              << bytes / (1024.0 * 1024.0) << " MiB, "
+              << seconds * 1000.0 << " ms/run, "
+              << bytes / (1024.0 * 1024.0) / seconds << " MiB/s, "
+              << tokenCount / seconds / 1e6 << " Mtokens/s, "
+              << "peak RSS " << peakRssKb() << " KiB" << std::endl;
+    return EXIT_SUCCESS;
+}
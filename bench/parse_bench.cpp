@@ -0,0 +1,77 @@
+/* Front/back-end benchmark: heap allocation count and parse+generate time
+ *
+ *   parse_bench <input.stump> [repeat]
+ *
+ * Inputs can be made with `lexer_bench generate <statements> <out.stump>`. */
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "source.h"
+#include "lexer.h"
+#include "parser.h"
+#include "lower.h"
+#include "generator.h"
+
+// ================================ Allocation Counting ================================
+
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// ====================================== Harness ======================================
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage should be..." << std::endl;
+        std::cerr << "./bin/parse_bench <input.stump> [repeat]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    int repeat = argc >= 3 ? std::stoi(argv[2]) : 5;
+    SourceBuffer source(argv[1]);
+
+    double parseSeconds = 0, generateSeconds = 0;
+    size_t parseAllocations = 0, generateAllocations = 0, outputBytes = 0, astBytes = 0;
+
+    for (int r = 0; r < repeat; r++) {
+        size_t before = g_allocations.load();
+        auto t0 = std::chrono::steady_clock::now();
+
+        Interner interner;
+        Lexer lexer(source.view(), interner);
+        Parser parser(lexer);
+        auto program = parser.parse();
+
+        auto t1 = std::chrono::steady_clock::now();
+        size_t parsed = g_allocations.load();
+
+        Generator generator(interner);
+        std::string output = generator.generate(Lowering(interner).lower(*program)).print();
+
+        auto t2 = std::chrono::steady_clock::now();
+        parseAllocations = parsed - before;
+        generateAllocations = g_allocations.load() - parsed;
+        outputBytes = output.size();
+        astBytes = program->arena.used();
+        parseSeconds += std::chrono::duration<double>(t1 - t0).count();
+        generateSeconds += std::chrono::duration<double>(t2 - t1).count();
+    }
+
+    std::cout << "parse:    " << parseSeconds / repeat * 1000.0 << " ms, "
+              << parseAllocations << " allocations, "
+              << astBytes << " AST bytes" << std::endl;
+    std::cout << "generate: " << generateSeconds / repeat * 1000.0 << " ms, "
+              << generateAllocations << " allocations, "
+              << outputBytes << " bytes out" << std::endl;
+    return EXIT_SUCCESS;
+}
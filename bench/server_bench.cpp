@@ -0,0 +1,191 @@
+/* Compile server benchmark: per-request latency over the socket against a fork/exec per file
+ *
+ *   server_bench [--requests=N] [--clients=N] <compiler> <socket> <program.stump>...
+ *
+ * Starts `<compiler> --server=<socket>`, then:
+ *  - compiles the programs N times by running the compiler, output to /dev/null
+ *  - checks the server's output for each program is the file the compiler writes
+ *  - one client sends N requests over one connection: the first (cold caches) on its own,
+ *    the rest as mean / p50 / p99
+ *  - --clients clients do the same at once, for throughput and latency under load
+ * and stops the server with SIGTERM. */
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "server.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double micros(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+/* argv[0] is the compiler, stdout discarded; false unless it exits 0 */
+static bool run(const std::vector<std::string>& args) {
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) dup2(null, STDOUT_FILENO);
+        std::vector<char*> argv;
+        for (const std::string& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// ===================================== Latencies ======================================
+
+struct Latencies {
+    std::vector<double> us;
+
+    double mean() const {
+        double sum = 0;
+        for (double u : us) sum += u;
+        return us.empty() ? 0 : sum / static_cast<double>(us.size());
+    }
+    double percentile(double p) {
+        if (us.empty()) return 0;
+        std::sort(us.begin(), us.end());
+        return us[std::min(us.size() - 1, static_cast<size_t>(p * static_cast<double>(us.size())))];
+    }
+};
+
+/* N requests in turn over one connection, cycling through the programs */
+static bool client(const std::string& socket, const std::vector<CompileServer::Request>& requests, int count,
+                   Latencies& latencies) {
+    int fd = CompileServer::connect(socket);
+    if (fd < 0) return false;
+    bool ok = true;
+    CompileServer::Response response;
+    for (int i = 0; i < count && ok; i++) {
+        auto start = Clock::now();
+        ok = CompileServer::send(fd, requests[static_cast<size_t>(i) % requests.size()]) &&
+             CompileServer::receive(fd, response) && response.status == 0;
+        latencies.us.push_back(micros(start, Clock::now()));
+    }
+    close(fd);
+    return ok;
+}
+
+// ====================================== Harness =======================================
+
+int main(int argc, char** argv) {
+    int count = 2000, clients = 4;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--requests=", 0) == 0) count = std::max(1, std::atoi(arg.c_str() + 11));
+        else if (arg.rfind("--clients=", 0) == 0) clients = std::max(1, std::atoi(arg.c_str() + 10));
+        else positional.push_back(arg);
+    }
+    if (positional.size() < 3) {
+        std::cerr << "Usage should be..." << std::endl;
+        std::cerr << "./bin/server_bench [--requests=N] [--clients=N] <compiler> <socket> <program.stump>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string compiler = positional[0], socket = positional[1];
+    std::vector<std::string> programs(positional.begin() + 2, positional.end());
+
+    std::vector<CompileServer::Request> requests;
+    for (const std::string& program : programs) {
+        requests.push_back({{}, {{program, readFile(program)}}});
+    }
+
+    pid_t server = fork();
+    if (server == 0) {
+        execl(compiler.c_str(), compiler.c_str(), ("--server=" + socket).c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    int probe = -1;
+    for (int tries = 0; tries < 500 && probe < 0; tries++) {
+        probe = CompileServer::connect(socket);
+        if (probe < 0) usleep(10000);
+    }
+    if (probe < 0) {
+        std::cerr << "server didn't start on " << socket << std::endl;
+        kill(server, SIGTERM);
+        return EXIT_FAILURE;
+    }
+    close(probe);
+    bool ok = true;
+
+    /* Same bytes as the file the compiler writes */
+    for (size_t p = 0; p < programs.size() && ok; p++) {
+        std::string expected = "output/server_bench.s";
+        CompileServer::Response response;
+        int fd = CompileServer::connect(socket);
+        ok = run({compiler, "-o", expected, programs[p]}) && fd >= 0 && CompileServer::send(fd, requests[p]) &&
+             CompileServer::receive(fd, response) && response.status == 0 && response.output == readFile(expected);
+        if (fd >= 0) close(fd);
+        if (!ok) std::cerr << programs[p] << ": server output differs from the compiler's" << std::endl;
+    }
+
+    int forks = std::max(1, count / 10);
+    auto start = Clock::now();
+    for (int i = 0; i < forks && ok; i++) ok = run({compiler, "-o", "-", programs[static_cast<size_t>(i) % programs.size()]});
+    double forkUs = micros(start, Clock::now()) / forks;
+
+    Latencies single;
+    ok = ok && client(socket, requests, count, single);
+    double first = 0;
+    if (!single.us.empty()) {
+        first = single.us[0];
+        single.us.erase(single.us.begin());
+    }
+
+    std::vector<Latencies> loaded(static_cast<size_t>(clients));
+    std::vector<char> done(static_cast<size_t>(clients), 0);
+    std::vector<std::thread> threads;
+    start = Clock::now();
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&, c] { done[static_cast<size_t>(c)] = client(socket, requests, count, loaded[static_cast<size_t>(c)]); });
+    }
+    for (std::thread& thread : threads) thread.join();
+    double wallUs = micros(start, Clock::now());
+    Latencies all;
+    for (int c = 0; c < clients; c++) {
+        ok = ok && done[static_cast<size_t>(c)];
+        all.us.insert(all.us.end(), loaded[static_cast<size_t>(c)].us.begin(), loaded[static_cast<size_t>(c)].us.end());
+    }
+
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+    if (!ok) {
+        std::cerr << "a request failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "fork/exec:     " << std::setw(10) << forkUs << " us per compile (" << forks << " runs)\n"
+              << "server, cold:  " << std::setw(10) << first << " us first request\n"
+              << "server, warm:  " << std::setw(10) << single.mean() << " us mean, p50 " << single.percentile(0.5)
+              << ", p99 " << single.percentile(0.99) << " (" << single.us.size() << " requests)\n"
+              << clients << " clients:     " << std::setw(10) << all.mean() << " us mean, p50 " << all.percentile(0.5)
+              << ", p99 " << all.percentile(0.99) << ", "
+              << static_cast<double>(all.us.size()) / wallUs * 1e6 << " requests/s\n";
+    return EXIT_SUCCESS;
+}
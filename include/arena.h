@@ -0,0 +1,90 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* Contiguous run of arena-owned elements */
+template <typename T>
+struct Span {
+    T* data = nullptr;
+    uint32_t size = 0;
+
+    T* begin() const { return data; }
+    T* end() const { return data + size; }
+    T& operator[](size_t i) const { return data[i]; }
+    bool empty() const { return size == 0; }
+};
+
+/* Bump allocator
+ *  - objects are carved out of large blocks in allocation order
+ *  - nothing is freed individually, destroying the arena releases every block
+ *  - only trivially destructible types, destructors are never run */
+class Arena {
+public:
+    Arena() = default;
+    ~Arena() {
+        for (void* block : m_blocks) ::operator delete(block);
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(m_ptr) + align - 1) & ~(uintptr_t)(align - 1);
+        if (m_ptr == nullptr || p + bytes > reinterpret_cast<uintptr_t>(m_end)) {
+            grow(bytes + align);
+            p = (reinterpret_cast<uintptr_t>(m_ptr) + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        m_ptr = reinterpret_cast<char*>(p + bytes);
+        return reinterpret_cast<void*>(p);
+    }
+
+    /* Constructing a single object in the arena */
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>, "arena never runs destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /* Copying [first, first + count) into arena storage */
+    template <typename T>
+    Span<T> copy(const T* first, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>, "arena spans are memcpy'd");
+        if (count == 0) return {};
+        T* data = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        std::memcpy(data, first, sizeof(T) * count);
+        return {data, static_cast<uint32_t>(count)};
+    }
+
+    /* Bytes handed out so far (excluding block slack) */
+    size_t used() const { return m_used + (m_ptr - m_begin); }
+
+private:
+    static constexpr size_t MIN_BLOCK = 64 * 1024;
+    static constexpr size_t MAX_BLOCK = 4 * 1024 * 1024;
+
+    void grow(size_t atLeast) {
+        m_used += m_ptr - m_begin;
+        size_t size = m_blocks.empty() ? MIN_BLOCK : std::min<size_t>((m_end - m_begin) * 2, MAX_BLOCK);
+        if (size < atLeast) size = atLeast;
+        m_begin = static_cast<char*>(::operator new(size));
+        m_blocks.push_back(m_begin);
+        m_ptr = m_begin;
+        m_end = m_begin + size;
+    }
+
+    std::vector<void*> m_blocks;
+    char* m_begin = nullptr;
+    char* m_ptr = nullptr;
+    char* m_end = nullptr;
+    size_t m_used = 0;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/* Memory map (samples/images/MemoryLayout.png and samples/mentalmaths.s)
+ *  0x0000-0xFEFF  RAM: code, data and stack
+ *  0xFF00-0xFFFF  memory-mapped peripherals: LED matrix, LCD, keypad, counter
+ * Compiled programs start at 0 and their stack grows up from STACK_BASE, or from the end of
+ * a program too big to fit below it */
+static constexpr uint16_t STACK_BASE = 0x1200;
+static constexpr uint16_t PERIPHERAL_BASE = 0xFF00;
+
+/* Assembled memory image, 64K 16-bit words */
+struct Image {
+    static constexpr uint32_t WORDS = 0x10000;
+
+    std::vector<uint16_t> memory = std::vector<uint16_t>(WORDS, 0);
+    std::vector<bool> used = std::vector<bool>(WORDS, false);          // written by the source
+    std::vector<bool> code = std::vector<bool>(WORDS, false);          // holds an instruction
+    std::vector<uint32_t> lineOf = std::vector<uint32_t>(WORDS, 0);    // 1-based source line, 0 if none
+
+    std::vector<std::string> lines;                                     // source text per line (0-based)
+    std::vector<std::pair<uint16_t, std::string>> labels;               // sorted by address
+    uint32_t words = 0;                                                 // words emitted, DEFS space excluded
+
+    /* Label owning address (the nearest one at or before it), empty if none */
+    std::string_view labelAt(uint16_t address) const;
+};
+
+/* STUMP encoding
+ *  ALU  [15:13] op  [12] 0=reg 1=imm  [11] S  [10:8] Rd  [7:5] Ra  [4:2] Rb [1:0] shift / [4:0] imm5
+ *       op: ADD ADC SUB SBC AND OR
+ *  LD/ST 110        [12] 0=[Ra, Rb] 1=[Ra, #imm]  [11] 0=LD 1=ST  rest as ALU
+ *  Bcc  111  [12:9] unused [11:8] cond  [7:0] offset from PC + 1 */
+namespace stump {
+    enum AluOp : uint8_t { ADD, ADC, SUB, SBC, AND, OR, MEM, BRANCH };
+    enum ShiftOp : uint8_t { NO_SHIFT, ASR, ROR, RRC };
+
+    inline uint16_t aluReg(uint8_t op, bool s, uint8_t rd, uint8_t ra, uint8_t rb, uint8_t shift) {
+        return static_cast<uint16_t>(op << 13 | s << 11 | rd << 8 | ra << 5 | rb << 2 | shift);
+    }
+    inline uint16_t aluImm(uint8_t op, bool s, uint8_t rd, uint8_t ra, int32_t imm) {
+        return static_cast<uint16_t>(op << 13 | 1 << 12 | s << 11 | rd << 8 | ra << 5 | (imm & 0x1F));
+    }
+    inline uint16_t memReg(bool store, uint8_t rd, uint8_t ra, uint8_t rb) {
+        return static_cast<uint16_t>(MEM << 13 | store << 11 | rd << 8 | ra << 5 | rb << 2);
+    }
+    inline uint16_t memImm(bool store, uint8_t rd, uint8_t ra, int32_t imm) {
+        return static_cast<uint16_t>(MEM << 13 | 1 << 12 | store << 11 | rd << 8 | ra << 5 | (imm & 0x1F));
+    }
+    inline uint16_t branch(uint8_t cond, int32_t offset) {
+        return static_cast<uint16_t>(BRANCH << 13 | cond << 8 | (offset & 0xFF));
+    }
+}
+
+/* Loadable forms of an image, words go out high byte first
+ *  - flat: every word from address 0 to the last one written, gaps zero-filled
+ *  - Intel HEX: data records over each run of written words at byte address 2 * word address,
+ *    extended linear address records past 64K bytes, then the end record */
+std::string flatImage(const Image& image);
+std::string intelHex(const Image& image);
+
+/* Two-pass assembler for STUMP source in the style of samples/mentalmaths.s
+ *  - labels with or without a colon, alone or before an instruction/directive
+ *  - ORG, EQU (register alias or constant), DATA/DEFW, DEFS
+ *  - MOV/CMP/NOP pseudo instructions, S suffixes, ASR/ROR/RRC shifts
+ *  - `LD Rd, label` is PC-relative
+ * Errors throw std::runtime_error naming the line */
+class Assembler {
+public:
+    explicit Assembler(std::string_view source);
+
+    Image assemble();
+
+private:
+    struct Line {
+        uint32_t number;
+        uint16_t address;
+        std::string mnemonic;
+        std::vector<std::string> operands;
+    };
+
+    void scan();
+    void encode(const Line& line);
+    int32_t value(const std::string& text, const Line& line) const;
+    uint8_t reg(const std::string& text, const Line& line) const;
+    bool isRegister(const std::string& text) const;
+    [[noreturn]] void error(const Line& line, const std::string& message) const;
+
+    std::string_view m_source;
+    Image m_image;
+    std::vector<Line> m_lines;
+    std::unordered_map<std::string, int32_t> m_symbols;
+    std::unordered_map<std::string, uint8_t> m_registers;
+};
+
+#endif
@@ -1,32 +1,30 @@
 #ifndef AST_VISITOR_H
 #define AST_VISITOR_H
 
-struct NodeVarDecl;
+struct NodeStatement;
 struct NodeArithmetic;
-struct NodeAssignment;
-struct NodeReturn;
-struct NodeInteger;
-struct NodeBoolean;
-struct NodeIdentifier;
-struct NodeOperator;
-struct NodeFunctionCall;
+struct NodeExpression;
 
 class ASTVisitor {
 public:
     virtual ~ASTVisitor() = default;
     
     // Statement visitors
-    virtual void visit(const NodeVarDecl& node) = 0;
-    virtual void visit(const NodeArithmetic& node) = 0;
-    virtual void visit(const NodeAssignment& node) = 0;
-    virtual void visit(const NodeReturn& node) = 0;
+    virtual void visitVarDecl(const NodeStatement& node) = 0;
+    virtual void visitArithmetic(const NodeArithmetic& node) = 0;
+    virtual void visitAssignment(const NodeStatement& node) = 0;
+    virtual void visitReturn(const NodeStatement& node) = 0;
+    virtual void visitIf(const NodeStatement& node) = 0;
+    virtual void visitWhile(const NodeStatement& node) = 0;
+    virtual void visitBreak(const NodeStatement& node) = 0;
+    virtual void visitContinue(const NodeStatement& node) = 0;
     
-    // Expression visitors
-    virtual void visit(const NodeInteger& node) = 0;
-    virtual void visit(const NodeBoolean& node) = 0;
-    virtual void visit(const NodeIdentifier& node) = 0;
-    virtual void visit(const NodeOperator& node) = 0;
-    virtual void visit(const NodeFunctionCall& node) = 0;
+    // Expression visitors (one RPN element each)
+    virtual void visitInteger(const NodeExpression& node) = 0;
+    virtual void visitBoolean(const NodeExpression& node) = 0;
+    virtual void visitIdentifier(const NodeExpression& node) = 0;
+    virtual void visitOperator(const NodeExpression& node) = 0;
+    virtual void visitFunctionCall(const NodeExpression& node) = 0;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "instruction.h"
+#include "interner.h"
+#include "ir.h"
+
+/* On-disk cache of generated functions, one file per entry in a directory
+ *  - the key hashes everything a function's code depends on: its IR after inlining and dead
+ *    code elimination, the names it refers to, the address of each global it touches, the
+ *    compiler binary itself and the flags that change code. An edit misses only for the
+ *    functions whose IR it changed, and for callers that inlined them
+ *  - an entry holds the function's listing after the peephole pass, its spill counts, its
+ *    stack frame and which runtime routines it calls
+ *  - entries are written to a temporary file and renamed into place, so builds sharing the
+ *    directory never see half an entry, and anything unreadable is just a miss
+ * Only code generation and the peephole pass are skipped on a hit: the key is taken from IR
+ * that inlining and evaluation produced across functions, so parsing, lowering and
+ * optimisation run on every build. A function's tokens alone can't key it, its code changes
+ * with its callees' bodies and with where globals land
+ * key() and load()/store() may be called from several threads at once */
+class FunctionCache {
+public:
+    struct Entry {
+        Listing listing;
+        uint32_t spills = 0;
+        uint32_t frameSlots = 0;
+        uint32_t stackWords = 0;                                // Generator::StackFrame, with the
+        std::vector<std::pair<std::string, uint32_t>> calls;    // callees by name across runs
+        bool multiply = false;
+        bool divide = false;
+    };
+
+    /* flags: every option that changes generated code, in a fixed order, spelled the same way
+     * whatever order the command line gave them in */
+    FunctionCache(std::string directory, std::string_view flags);
+
+    /* Where the program's globals live, needed before any key() */
+    void layout(const IrModule& module, const Interner& interner, uint32_t globalBase);
+
+    uint64_t key(const IrFunction& func, const Interner& interner) const;
+    bool load(uint64_t key, Entry& entry);
+    void store(uint64_t key, const Entry& entry) const;
+
+    uint32_t hits() const { return m_hits; }
+    uint32_t misses() const { return m_misses; }
+
+private:
+    std::string path(uint64_t key) const;
+
+    std::string m_directory;
+    uint64_t m_seed;                        // compiler identity and flags
+    std::vector<int32_t> m_globalAddress;   // per symbol: address of the global or -1
+    std::atomic<uint32_t> m_hits{0};
+    std::atomic<uint32_t> m_misses{0};
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef CONSTFOLD_H
+#define CONSTFOLD_H
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "interner.h"
+#include "parser.h"
+
+/* Constant folding + propagation over each statement's RPN
+ *  - operators whose operands are both literals become one literal
+ *  - locals last assigned a literal are replaced by it where read, forgotten again where
+ *    control flow joins with a path that may have assigned them
+ *  - arithmetic wraps at 16 bits like the STUMP ALU
+ * RPN sequences only ever shrink, so they are rewritten in place in the arena */
+class ConstantFolder {
+public:
+    explicit ConstantFolder(const Interner& interner);
+
+    void run(NodeProgram& program);
+
+    /* Wrapping a value to a signed 16-bit STUMP word */
+    static int32_t wrap(int32_t value) {
+        return static_cast<int16_t>(static_cast<uint16_t>(value));
+    }
+
+    /* Evaluating one operator at 16 bits, empty if it can't be folded (e.g. divide by zero) */
+    static std::optional<int32_t> evaluate(TokenType op, int32_t lhs, int32_t rhs);
+
+    /* Counters from the last run() */
+    uint32_t folded() const { return m_folded; }
+    uint32_t propagated() const { return m_propagated; }
+
+private:
+    void foldFunction(NodeFunction& func);
+    void foldBody(NodeBody& body);
+    void foldIf(NodeStatement& stmt);
+    void foldWhile(NodeStatement& stmt);
+    void foldStatement(NodeStatement& stmt);
+    void forget(Symbol symbol);
+
+    std::vector<std::optional<int32_t>> m_known;    // per symbol: literal the local currently holds
+    std::vector<bool> m_local;                      // per symbol: declared in this function
+    std::vector<Symbol> m_touched;
+    std::vector<Symbol> m_assigned;                 // assigned inside the ifs/whiles being folded
+    struct Shadowed {
+        Symbol name;
+        std::optional<int32_t> known;
+        bool local;
+    };
+    std::vector<Shadowed> m_shadowed;               // state before each declaration still in scope
+    std::vector<bool> m_constant;                   // RPN stack: entry is a single literal
+    uint32_t m_folded = 0;
+    uint32_t m_propagated = 0;
+};
+
+#endif
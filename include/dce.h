@@ -0,0 +1,45 @@
+#ifndef DCE_H
+#define DCE_H
+
+#include <cstdint>
+#include <vector>
+#include "interner.h"
+#include "ir.h"
+
+/* Dead code elimination over the SSA IR
+ *  - functions main never reaches, directly or through other calls
+ *  - blocks no path from the entry reaches, i.e. statements after a return or behind a branch
+ *    on a constant or a comparison of constants
+ *  - values nothing reads and that have no effect (constants, loads, arithmetic, comparisons,
+ *    parameters, phis)
+ *  - globals no surviving function reads, along with every store to them
+ * Dropping a store can leave its value unread, so values and globals repeat until neither shrinks.
+ * Calls always stay, a callee may store to globals */
+class DeadCodeEliminator {
+public:
+    explicit DeadCodeEliminator(const Interner& interner);
+
+    void run(IrModule& module);
+
+    /* Counters from the last run() */
+    uint32_t functions() const { return m_functions; }
+    uint32_t blocks() const { return m_blocks; }
+    uint32_t values() const { return m_values; }
+    uint32_t globals() const { return m_globals; }
+
+private:
+    void removeUnreachableFunctions(IrModule& module);
+    void removeUnreachableBlocks(IrFunction& func);
+    void removeFoldedEdges(IrFunction& func);
+    bool removeDeadValues(IrFunction& func);
+    bool removeUnreadGlobals(IrModule& module);
+
+    const Interner& m_interner;
+    std::vector<bool> m_read;       // per symbol: a global some LOAD reads
+    uint32_t m_functions = 0;
+    uint32_t m_blocks = 0;
+    uint32_t m_values = 0;
+    uint32_t m_globals = 0;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* Errors found while compiling, collected rather than thrown so one run reports them all
+ *  - each points at a line and column of one of the input files, given by its index
+ *  - shared by the threads compiling different files, error() takes a lock
+ *  - once `limit` errors are in, full() turns true and further ones are only counted, so
+ *    parsers can give up early; 0 is no limit */
+class Diagnostics {
+public:
+    struct Diagnostic {
+        uint32_t file;
+        uint32_t line;
+        uint32_t column;
+        std::string message;
+    };
+
+    Diagnostics(std::vector<std::string> files, uint32_t limit);
+
+    void error(uint32_t file, uint32_t line, uint32_t column, std::string message);
+
+    /* Errors reported so far, dropped ones included */
+    uint32_t count() const;
+    bool full() const;
+
+    /* file:line:column: error: message, by file then position, then how many there were */
+    void print(std::ostream& out) const;
+
+private:
+    std::vector<std::string> m_files;
+    uint32_t m_limit;
+    mutable std::mutex m_mutex;
+    std::vector<Diagnostic> m_errors;
+    uint32_t m_dropped = 0;
+};
+
+#endif
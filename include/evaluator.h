@@ -0,0 +1,48 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+#include "interner.h"
+#include "ir.h"
+
+/* Calls worked out at compile time over the SSA IR
+ *  - a call qualifies when its callee is declared `effects []` and every argument is a constant,
+ *    the call becomes the constant it returns
+ *  - the callee's IR is interpreted with 16-bit arithmetic like the STUMP ALU, calling into
+ *    other `effects []` functions as it goes
+ *  - the declaration isn't taken on trust: a store, a load of a global anything stores to, a
+ *    call to a function with effects, a divide by zero or running out of steps abandons the
+ *    call and it stays as it was
+ *  - `budget` bounds the instructions one call may execute with everything it calls, 0 turns
+ *    evaluation off. Calls nest at most MAX_DEPTH deep
+ * Results are remembered per callee and arguments, so the same call elsewhere costs a lookup */
+class CallEvaluator {
+public:
+    static constexpr uint32_t BUDGET = 65536;
+    static constexpr uint32_t MAX_DEPTH = 256;
+
+    explicit CallEvaluator(const Interner& interner, uint32_t budget = BUDGET);
+
+    void run(IrModule& module);
+
+    /* Counters from the last run() */
+    uint32_t evaluated() const { return m_evaluated; }
+
+private:
+    std::optional<int32_t> call(size_t function, std::vector<int32_t> args, uint32_t depth);
+    std::optional<int32_t> execute(const IrFunction& func, const std::vector<int32_t>& args, uint32_t depth);
+
+    const Interner& m_interner;
+    uint32_t m_budget;
+    const IrModule* m_module = nullptr;
+    std::vector<int32_t> m_index;                   // per symbol: function index or -1
+    std::vector<std::optional<int32_t>> m_constant; // per symbol: a global nothing stores to
+    std::map<std::vector<int32_t>, std::optional<int32_t>> m_results;  // function index, args...
+    uint32_t m_steps = 0;
+    uint32_t m_evaluated = 0;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef FOOTPRINT_H
+#define FOOTPRINT_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "generator.h"
+#include "instruction.h"
+#include "interner.h"
+
+/* What a linked program needs of the memory map (assembler.h)
+ *  - code and data: the words from ORG 0 to the end of the program, instructions are code;
+ *    globals, literal pools and the stack pointer's DATA word are data
+ *  - stack: the worst case from main down the call graph, a function's own words or, deeper,
+ *    where one of its calls lands plus that callee's worst case. A function on a cycle of
+ *    calls (recursion, direct or through others) has no bound, nor does anything calling one
+ *  - the stack starts at STACK_BASE, or straight after a program too big to end below it, and
+ *    may take `limit` words, 0 for all the RAM up to the peripherals
+ * run() points the listing's stack at where it starts, and throws std::runtime_error when the
+ * program or its stack doesn't fit, naming the chain of calls that goes deepest. A stack with no
+ * bound can't be checked, recursion() names the calls that make it so */
+class Footprint {
+public:
+    struct Function {
+        Symbol name;
+        uint32_t words;                 // its own, from the slot its return address goes in
+        std::optional<uint32_t> stack;  // with everything it calls, none when unbounded
+        bool recursive;
+    };
+
+    Footprint(const Interner& interner, uint32_t limit);
+
+    void run(Listing& listing, const std::vector<Generator::StackFrame>& frames);
+
+    uint32_t codeWords() const { return m_codeWords; }
+    uint32_t dataWords() const { return m_dataWords; }
+    uint32_t stackBase() const { return m_stackBase; }
+    uint32_t stackLimit() const { return m_stackLimit; }
+    /* From main, none when it can reach recursion */
+    std::optional<uint32_t> stackWords() const { return m_stackWords; }
+    /* When it can: the calls from main to the first recursive function, "main -> draw -> fill" */
+    const std::string& recursion() const { return m_recursion; }
+
+    /* In the order of the frames given to run() */
+    const std::vector<Function>& functions() const { return m_functions; }
+
+private:
+    void connect(uint32_t f);
+    std::string chain(uint32_t f) const;
+    std::string toRecursion(uint32_t f) const;
+
+    const Interner& m_interner;
+    uint32_t m_limit;
+    uint32_t m_codeWords = 0;
+    uint32_t m_dataWords = 0;
+    uint32_t m_stackBase = 0;
+    uint32_t m_stackLimit = 0;
+    std::optional<uint32_t> m_stackWords;
+    std::string m_recursion;
+    std::vector<Function> m_functions;
+
+    /* Call graph over frame indices, Tarjan's strongly connected components */
+    const std::vector<Generator::StackFrame>* m_frames = nullptr;
+    std::vector<int32_t> m_frameOf;     // per symbol: its frame or -1
+    std::vector<int32_t> m_deepest;     // per frame: the callee its worst case goes through, or -1
+    std::vector<uint32_t> m_index, m_lowLink;
+    std::vector<bool> m_onStack;
+    std::vector<uint32_t> m_stack;
+    uint32_t m_next = 0;
+};
+
+#endif
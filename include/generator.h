@@ -1,34 +1,179 @@
 #ifndef GENERATOR_H
 #define GENERATOR_H
 
-#include <sstream>
-#include "ast_visitor.h"
-#include "parser.h"
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include "instruction.h"
+#include "interner.h"
+#include "ir.h"
+#include "regalloc.h"
 
-class Generator : public ASTVisitor {
+/* STUMP backend over the SSA IR, one function at a time
+ *  - linear-scan allocation over the function's instructions, values are live from their
+ *    definition to their last use and across every block they are live through
+ *  - a phi and the inputs that don't interfere with it share one home, so most edges need no moves
+ *  - constants never take a register, whatever consumes them picks an immediate or a pool load
+ *  - a comparison feeding only its block's branch becomes CMP + Bcc
+ *  - globals and functions are labelled `_name`. Source names are letters and digits only, so
+ *    they can't meet the compiler's own labels (stack, halt, SP, __mul..., f_L0) or read as a
+ *    mnemonic or register in the text */
+class Generator {
 public:
-    Generator();
-    
-    std::string generate(const NodeProgram& program);
-    
-    // Statement visitors
-    void visit(const NodeVarDecl& node) override;
-    void visit(const NodeArithmetic& node) override;
-    void visit(const NodeAssignment& node) override;
-    void visit(const NodeReturn& node) override;
-    
-    // Expression visitors
-    void visit(const NodeInteger& node) override;
-    void visit(const NodeBoolean& node) override;
-    void visit(const NodeIdentifier& node) override;
-    void visit(const NodeOperator& node) override;
-    void visit(const NodeFunctionCall& node) override;
+    explicit Generator(const Interner& interner);
+
+    Listing generate(const IrModule& module);
+
+    /* The same program in pieces, for generating functions on several threads and linking after:
+     * the header (entry branch, stack, globals), any range of functions with one Generator per
+     * thread, then the runtime routines any of them called for */
+    Listing generateHeader(const IrModule& module);
+    Listing generateFunctions(const IrModule& module, size_t begin, size_t end);
+    Listing generateRuntime(bool multiply, bool divide);
+    bool usesMultiply() const { return m_usesMultiply; }
+    bool usesDivide() const { return m_usesDivide; }
+
+    /* Address of a module's first global, the rest follow in order */
+    static uint32_t globalBase(const IrModule& module);
+
+    /* Register pressure of one generated function */
+    struct SpillReport {
+        Symbol function;
+        uint32_t spills;        // values kept in memory instead of a register
+        uint32_t frameSlots;    // stack words reserved for them
+    };
+    const std::vector<SpillReport>& spills() const { return m_spills; }
+
+    /* Stack use of one generated function, measured in words up from the slot its return
+     * address goes in (main's is one below the stack, and never written)
+     *  - words: the most its own code claims, frame, pushes and calls to the runtime routines
+     *  - calls: each function it calls, and where that callee's return slot lands */
+    struct StackFrame {
+        Symbol function;
+        uint32_t words;
+        std::vector<std::pair<Symbol, uint32_t>> calls;
+    };
+    const std::vector<StackFrame>& frames() const { return m_frames; }
 
 private:
-    void generateFunction(const NodeFunction& func);
-    
-    std::stringstream m_output;
-    size_t m_stackOffset = 0;
+    void layoutGlobals(const IrModule& module);
+    void emitHeader(const IrModule& module);
+    void emitFunctions(const IrModule& module, size_t begin, size_t end);
+    void generateFunction(const IrFunction& func);
+    void generateInstruction(Value v);
+
+    /* An instruction's operand: a value with an allocated home, or a constant not yet materialised */
+    struct Operand {
+        bool isLiteral;
+        int32_t literal;
+        uint32_t value;
+    };
+    Operand operand(Value v) const;
+
+    /* Register allocation: live ranges over one function's instructions */
+    void analyseFunction(const IrFunction& func);
+    void liveness(const IrFunction& func, const std::vector<bool>& needsHome,
+                  std::vector<uint32_t>& start, std::vector<uint32_t>& end);
+    void coalescePhis(const IrFunction& func, const std::vector<bool>& needsHome,
+                      const std::vector<uint32_t>& start, const std::vector<uint32_t>& end);
+    void allocate(std::vector<uint8_t> registers);
+    bool isFarGlobal(Symbol name) const;
+    bool callsRuntime(const IrInst& inst) const;
+
+    /* Moving values between their allocated homes and registers */
+    uint8_t use(const Operand& operand, uint8_t scratch);
+    uint8_t target(uint32_t value, uint8_t scratch);
+    void commit(uint32_t value, uint8_t reg);
+    int frameOffset(uint32_t value) const;
+    void receiveParameters();
+    void parallelMove(std::vector<std::pair<uint8_t, uint8_t>> moves);
+
+    /* Literal pool: constants that don't fit an immediate are loaded PC-relative
+     *  - LD's offset is 5 bits, so a pending entry must land within 16 words of its first load
+     *  - the pool is dumped after the return path, or as an island branched over if a load
+     *    would otherwise fall out of range */
+    struct PoolEntry {
+        std::string key;        // value or global name, entries with the same key are shared
+        Symbol label;
+        uint32_t deadline;      // last word address the entry may occupy
+        Instruction word;
+    };
+    void emit(const Instruction& instruction);
+    Symbol symbol(Symbol name);
+    void reservePool(uint32_t words);
+    void flushPool(bool branchOver);
+    void loadLiteral(uint8_t reg, const std::string& key, const Instruction& word);
+    Symbol local(const char* kind);
+
+    /* Emitting common instruction sequences */
+    void loadConstant(uint8_t reg, int32_t value);
+    void loadStack(uint8_t reg, int offset);
+    void storeStack(uint8_t reg, int offset);
+    void loadGlobal(uint8_t reg, Symbol name);
+    void storeGlobal(uint8_t reg, Symbol name);
+    void push(uint8_t reg);
+    void adjustSP(int delta);
+    void epilogue();
+    void arithmetic(Value v);
+    void call(Symbol label, std::optional<Symbol> callee, const std::vector<Operand>& args, Value result);
+
+    /* Control flow: compare-and-branch, block layout and phi moves along edges */
+    void labelBlocks(const IrFunction& func);
+    Cond compare(IrOp op, Operand lhs, Operand rhs);
+    void materialise(Value v);
+    void branch(Value v);
+    void jump(uint32_t block, bool fallThrough);
+    Value incoming(const IrInst& phi, uint32_t block) const;
+    bool sameHome(Value a, Value b) const;
+    bool needsMoves(uint32_t from, uint32_t to) const;
+    void edgeMoves(uint32_t from, uint32_t to);
+    void emitStubs();
+
+    /* Multiply/divide lowering */
+    void multiplyConstant(uint8_t d, uint8_t a, int32_t c);
+    void dividePowerOfTwo(uint8_t d, uint8_t a, int32_t c);
+    void emitRuntime();
+
+    const Interner& m_interner;
+    Listing m_listing;
+
+    /* Program wide */
+    std::vector<int32_t> m_globalIndex;     // per symbol: index into globals or -1
+    int m_globalBase = 2;                   // address of the first global
+    std::vector<SpillReport> m_spills;
+    std::vector<StackFrame> m_frames;
+    bool m_usesMultiply = false;            // runtime routines to append
+    bool m_usesDivide = false;
+
+    /* Per function: a value is the index of the instruction defining it */
+    const IrFunction* m_function = nullptr;
+    std::vector<LiveInterval> m_intervals;  // values needing a home, constants have none
+    std::vector<int16_t> m_paramIndex;      // per value: parameter position or -1
+    std::vector<Value> m_web;               // per value: phi web it shares a home with (itself if none)
+    std::vector<bool> m_fused;              // per value: comparison emitted by its branch
+    std::vector<uint32_t> m_blockOf;        // per value: block holding it
+    std::vector<Symbol> m_blockLabel;       // per block: label, NO_LABEL when only fallen into
+    Allocation m_alloc;
+    uint32_t m_block = 0;                   // block being generated
+    struct Stub {
+        Symbol label;
+        uint32_t from, to;                  // edge whose phi moves it holds
+    };
+    std::vector<Stub> m_stubs;
+    uint32_t m_point = 0;                   // instruction being generated
+    uint32_t m_frameSlots = 0;
+    int m_frameWords = 0;                   // SP above the return address slot once the prologue ran
+    bool m_leaf = false;                    // makes no calls, not even to the runtime
+    int m_pushDepth = 0;                    // words pushed below the frame since entry
+    uint8_t m_scratchB = 0;                 // second scratch register, only when values spill
+    bool m_needsScratchB = false;           // a far global store needs it even without spills
+
+    /* Literal pool state for the current function */
+    uint32_t m_words = 0;                   // words emitted so far in this function
+    bool m_poolLocked = false;              // inside a sequence that can't be split
+    uint32_t m_localLabels = 0;
+    std::vector<PoolEntry> m_pool;          // pending, in deadline order
+    std::unordered_map<std::string, std::pair<Symbol, uint32_t>> m_placed;    // key -> label, address
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,44 @@
+#ifndef INLINER_H
+#define INLINER_H
+
+#include <cstdint>
+#include <vector>
+#include "interner.h"
+#include "ir.h"
+
+/* Inlining calls to small functions over the SSA IR
+ *  - a callee qualifies when it is one block, can't reach itself through calls and costs at
+ *    most `budget` instructions, or at most SINGLE_SITE_BUDGET when it has a single call site.
+ *    The call has to pass as many arguments as it has parameters
+ *  - cost counts what will be generated: constants and parameters are free
+ *  - callees are visited before their callers, so they arrive with their own calls inlined
+ * Functions left without callers are removed afterwards by dead code elimination */
+class Inliner {
+public:
+    static constexpr uint32_t SINGLE_SITE_BUDGET = 40;
+
+    explicit Inliner(const Interner& interner, uint32_t budget = 8);
+
+    void run(IrModule& module);
+
+    /* Counters from the last run() */
+    uint32_t inlined() const { return m_inlined; }
+
+private:
+    void order(size_t function);
+    bool reaches(size_t from, size_t target);
+    bool qualifies(const IrInst& call) const;
+    void inlineCalls(IrFunction& caller);
+
+    const Interner& m_interner;
+    uint32_t m_budget;
+    IrModule* m_module = nullptr;
+    std::vector<int32_t> m_index;           // per symbol: function index or -1
+    std::vector<uint32_t> m_sites;          // per function: calls to it
+    std::vector<bool> m_recursive;          // per function: reaches itself
+    std::vector<bool> m_visited;
+    std::vector<size_t> m_order;            // callees first
+    uint32_t m_inlined = 0;
+};
+
+#endif
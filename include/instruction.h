@@ -0,0 +1,99 @@
+#ifndef INSTRUCTION_H
+#define INSTRUCTION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "interner.h"
+
+/* STUMP instruction list
+ * The generator emits into a Listing, later passes rewrite it in place and print() turns it into assembly */
+
+enum class Opcode : uint8_t {
+    ADD, ADC, SUB, SBC, AND, OR,    // rd, ra, rb / rd, ra, #imm
+    MOV, CMP,                       // pseudo: MOV rd, ra / #imm, CMP ra, rb / #imm
+    LD, ST,                         // rd, [ra, #imm] / [ra, rb] / label (PC-relative)
+    B,                              // Bcc label
+    LABEL,                          // label definition
+    ORG, EQU, DATA, DEFW,           // directives
+    NOP,                            // removed by a pass, skipped when printing
+};
+
+/* Condition codes in encoding order */
+enum class Cond : uint8_t { AL, NV, HI, LS, CC, CS, NE, EQ, VC, VS, PL, MI, GE, LT, GT, LE };
+
+/* Single-bit shift applied to Ra before the ALU, register forms only */
+enum class Shift : uint8_t { NONE, ASR, ROR, RRC };
+
+/* How the last operand is given
+ *  REG:   rb
+ *  IMM:   imm, or a symbolic immediate when label is set (e.g. [R0, #name])
+ *  LABEL: label, PC-relative for LD/ST/B, the word itself for DEFW */
+enum class Mode : uint8_t { REG, IMM, LABEL };
+
+static constexpr Symbol NO_LABEL = 0;
+
+struct Instruction {
+    Opcode op = Opcode::NOP;
+    Mode mode = Mode::IMM;
+    Cond cond = Cond::AL;
+    Shift shift = Shift::NONE;
+    bool setFlags = false;      // ALU: S suffix, CMP always sets them
+    bool call = false;          // B: a call, execution resumes at the next instruction
+    uint8_t rd = 0, ra = 0, rb = 0;
+    int32_t imm = 0;
+    Symbol label = NO_LABEL;    // operand label, or the name a LABEL/EQU defines
+
+    static Instruction alu(Opcode op, uint8_t rd, uint8_t ra, uint8_t rb);
+    static Instruction aluImm(Opcode op, uint8_t rd, uint8_t ra, int32_t imm);
+    static Instruction shifted(Opcode op, uint8_t rd, uint8_t ra, uint8_t rb, Shift shift);
+    static Instruction compare(uint8_t ra, uint8_t rb);
+    static Instruction move(uint8_t rd, uint8_t ra);
+    static Instruction moveImm(uint8_t rd, int32_t imm);
+    static Instruction memory(Opcode op, uint8_t rd, uint8_t ra, int32_t imm, Symbol symbol = NO_LABEL);
+    static Instruction memoryReg(Opcode op, uint8_t rd, uint8_t ra, uint8_t rb);
+    static Instruction memoryLabel(Opcode op, uint8_t rd, Symbol label);
+    static Instruction branch(Cond cond, Symbol label, bool call = false);
+    static Instruction define(Symbol label);
+    static Instruction word(Opcode op, int32_t value, Symbol label = NO_LABEL);
+    Instruction& flags() { setFlags = true; return *this; }
+
+    /* Register dataflow, R0 reads as zero and is never written */
+    bool reads(uint8_t r) const;
+    bool writes(uint8_t r) const;
+    bool emitsWord() const { return op != Opcode::LABEL && op != Opcode::NOP && op != Opcode::ORG && op != Opcode::EQU; }
+    /* Words after Listing::relax() at worst: a far B grows to 2, a far Bcc to 3 */
+    uint32_t maxWords() const;
+};
+
+struct Image;
+
+/* One program's instructions, label names are interned separately from source identifiers */
+struct Listing {
+    Interner names;
+    std::vector<Instruction> code;
+    std::vector<bool> functions;    // per label: starts a function
+    Symbol stack = NO_LABEL;        // labels the DATA word SP starts from, in the header
+
+    Listing() { names.intern(""); }     // symbol 0 is NO_LABEL
+    Symbol label(std::string_view name) { return names.intern(name); }
+    bool isFunction(Symbol label) const { return label < functions.size() && functions[label]; }
+
+    void compact();
+    /* Another listing's code after this one's, a label name means the same label in both */
+    void append(const Listing& other);
+    /* Both throw std::runtime_error, like the text assembler, for a label defined twice or
+     * used without being defined */
+    uint32_t relax();
+    std::string print() const;
+    /* Encoded straight to words, without going through print() and the text assembler
+     * Run after relax(), throws std::runtime_error if an operand is still out of reach */
+    Image assemble() const;
+
+private:
+    void checkLabels() const;
+};
+
+const char* registerName(uint8_t r);
+
+#endif
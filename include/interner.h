@@ -0,0 +1,42 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Interned identifier, index into the interner's pool */
+using Symbol = uint32_t;
+
+/* Identifier interner
+ *  - every distinct spelling gets one Symbol, ids are dense from 0
+ *  - spellings are stored back to back in a single pool
+ *  - lookup is an open-addressed table of ids, probed by hash */
+class Interner {
+public:
+    Interner();
+
+    /* Symbol for text, adding it if unseen */
+    Symbol intern(std::string_view text);
+
+    /* Spelling of a symbol */
+    std::string_view name(Symbol symbol) const {
+        return std::string_view(m_pool).substr(m_offsets[symbol], m_offsets[symbol + 1] - m_offsets[symbol]);
+    }
+
+    /* Number of distinct symbols */
+    size_t size() const { return m_offsets.size() - 1; }
+
+private:
+    static uint32_t hash(std::string_view text);
+    void rehash();
+
+    std::string m_pool;
+    std::vector<uint32_t> m_offsets;    // symbol i spans [m_offsets[i], m_offsets[i + 1])
+    std::vector<uint32_t> m_hashes;     // cached hash per symbol, used when rehashing
+    std::vector<Symbol> m_table;        // EMPTY or symbol id
+    static constexpr Symbol EMPTY = UINT32_MAX;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef IR_H
+#define IR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "interner.h"
+
+/* Three-address SSA between the AST and the backend
+ *  - a function's instructions sit back to back in one vector and a value is the index of the
+ *    instruction defining it, so operands are plain indices rather than pointers
+ *  - basic blocks are consecutive runs of that vector, each ending in a terminator (ret, jmp, br)
+ *  - locals only exist while lowering, every assignment simply names a new value and phis
+ *    merge them where control flow joins
+ *  - blocks are laid out so that every block comes after the blocks dominating it */
+
+using Value = uint32_t;
+static constexpr Value NO_VALUE = UINT32_MAX;
+
+enum class IrOp : uint8_t {
+    CONST,                  // imm
+    PARAM,                  // imm: position in IrFunction::parameters
+    LOAD,                   // global sym
+    STORE,                  // global sym = a
+    ADD, SUB, MUL, DIV,     // a, b
+    EQ, NE, LT, LE, GT, GE, // a, b: signed comparison, 1 or 0
+    CALL,                   // sym(args[a .. a + b))
+    PHI,                    // incoming[a .. a + b), first in their block
+    RET,                    // a, or NO_VALUE to leave R1 as it is
+    JMP,                    // target block
+    BR,                     // a != 0 ? target : b (blocks)
+};
+
+/* One instruction, 16 bytes */
+struct IrInst {
+    IrOp op;
+    Value a = NO_VALUE;
+    Value b = NO_VALUE;
+    union {
+        int32_t imm = 0;    // CONST/PARAM
+        Symbol sym;         // LOAD/STORE/CALL
+        uint32_t target;    // JMP/BR
+    };
+
+    explicit IrInst(IrOp o) : op(o) {}
+
+    bool definesValue() const { return op != IrOp::STORE && !isTerminator(); }
+    bool isTerminator() const { return op == IrOp::RET || op == IrOp::JMP || op == IrOp::BR; }
+    bool isComparison() const { return op >= IrOp::EQ && op <= IrOp::GE; }
+};
+
+/* One phi input: the value arriving along the edge from block */
+struct IrIncoming {
+    uint32_t block;
+    Value value;
+};
+
+/* Instructions [begin, end) */
+struct IrBlock {
+    uint32_t begin;
+    uint32_t end;
+};
+
+struct IrFunction {
+    Symbol name;
+    std::vector<Symbol> parameters;
+    std::vector<IrInst> code;
+    std::vector<IrBlock> blocks;
+    std::vector<Value> args;            // CALL argument runs
+    std::vector<IrIncoming> incoming;   // PHI input runs
+    bool pure = false;                  // declared `effects []`
+
+    /* Drops instructions with keep[v] false and renumbers the rest, blocks left empty go too
+     * along with phi inputs arriving from them */
+    void compact(const std::vector<bool>& keep);
+
+    /* Calls f on every value an instruction reads */
+    template <typename F>
+    void forEachOperand(const IrInst& inst, F f) const {
+        switch (inst.op) {
+        case IrOp::CALL:
+            for (uint32_t i = 0; i < inst.b; i++) f(args[inst.a + i]);
+            break;
+        case IrOp::PHI:
+            for (uint32_t i = 0; i < inst.b; i++) f(incoming[inst.a + i].value);
+            break;
+        case IrOp::ADD: case IrOp::SUB: case IrOp::MUL: case IrOp::DIV:
+        case IrOp::EQ: case IrOp::NE: case IrOp::LT: case IrOp::LE: case IrOp::GT: case IrOp::GE:
+            f(inst.a);
+            f(inst.b);
+            break;
+        case IrOp::STORE: case IrOp::BR:
+            f(inst.a);
+            break;
+        case IrOp::RET:
+            if (inst.a != NO_VALUE) f(inst.a);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* Replaces every value an instruction reads with f(value) */
+    template <typename F>
+    void mapOperands(IrInst& inst, F f) {
+        switch (inst.op) {
+        case IrOp::CALL:
+            for (uint32_t i = 0; i < inst.b; i++) args[inst.a + i] = f(args[inst.a + i]);
+            break;
+        case IrOp::PHI:
+            for (uint32_t i = 0; i < inst.b; i++) incoming[inst.a + i].value = f(incoming[inst.a + i].value);
+            break;
+        case IrOp::ADD: case IrOp::SUB: case IrOp::MUL: case IrOp::DIV:
+        case IrOp::EQ: case IrOp::NE: case IrOp::LT: case IrOp::LE: case IrOp::GT: case IrOp::GE:
+            inst.a = f(inst.a);
+            inst.b = f(inst.b);
+            break;
+        case IrOp::STORE: case IrOp::BR:
+            inst.a = f(inst.a);
+            break;
+        case IrOp::RET:
+            if (inst.a != NO_VALUE) inst.a = f(inst.a);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* Calls f on the blocks a block's terminator can go to, `ret` has none */
+    template <typename F>
+    void forEachSuccessor(uint32_t block, F f) const {
+        const IrInst& last = code[blocks[block].end - 1];
+        if (last.op == IrOp::JMP || last.op == IrOp::BR) f(last.target);
+        if (last.op == IrOp::BR && last.b != last.target) f(last.b);
+    }
+};
+
+struct IrGlobal {
+    Symbol name;
+    int32_t initial;    // literal initialisers, the rest are stored at the start of main
+};
+
+struct IrModule {
+    std::vector<IrGlobal> globals;
+    std::vector<IrFunction> functions;
+
+    /* Textual dump for --emit-ir */
+    std::string print(const Interner& interner) const;
+
+    /* Moving every symbol over to another interner, to[s] is s's symbol there */
+    void rename(const std::vector<Symbol>& to);
+};
+
+#endif
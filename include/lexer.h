@@ -1,13 +1,15 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <cstdint>
 #include <iostream>
-#include <optional>
+#include <string_view>
 #include <vector>
+#include "interner.h"
 
-enum class TokenType {
+enum class TokenType : uint8_t {
     // Keywords
-    FUNCTION, WHILE, IF, ELSE, RETURN,
+    FUNCTION, WHILE, IF, ELSE, RETURN, BREAK, CONTINUE,
     
     // Types
     INT, BOOL,
@@ -17,7 +19,7 @@ enum class TokenType {
     
     // Operators
     PLUS, MINUS, MULTIPLY, DIVIDE, 
-    ASSIGN, EQUALS,
+    ASSIGN, EQUALS, NOT_EQUALS,
     LESS, GREATER, LESS_EQUAL, GREATER_EQUAL,
     AND, OR, NOT,
 
@@ -34,34 +36,57 @@ enum class TokenType {
     EFFECTS,
     
     // Special
-    END_OF_FILE, INVALID
+    END_OF_FILE, INVALID,
+    NEGATE          // never lexed: unary minus on the parser's operator stack
 };
 
+/* Compact token: text lives in the source buffer at [offset, offset + length),
+ * identifiers are interned as they are lexed */
 struct Token {
-   TokenType type;
-   std::optional<std::string> value;
+    TokenType type;
+    Symbol symbol = 0;          // IDENTIFIER
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    uint32_t line = 0;
+    uint32_t column = 0;
 };
 
+/* How a token type reads in a diagnostic: the symbol itself, or "a name", "an integer" */
+const char* spelling(TokenType type);
+
+/* Anything that can't start a token comes back as one INVALID token for the parser to report:
+ * a stray character, or digits running into letters (`12ab`) */
 class Lexer {
 public:
-    /* Constructor */
-    explicit Lexer(std::string& src);
+    /* Constructor, src must outlive the lexer and its tokens */
+    Lexer(std::string_view src, Interner& interner);
     
-    /* Converting input file to vector of tokens */
+    /* Converting input file to vector of tokens (whole file at once) */
     std::vector<Token> tokenise();
 
+    /* Lexing the next token on demand, END_OF_FILE forever once input runs out */
+    Token next();
+
+    /* Source text a token was lexed from */
+    std::string_view text(const Token& token) const {
+        return m_src.substr(token.offset, token.length);
+    }
+
 private:
-    /* Looking ahead n characters 
-        [[nodiscard]]? used for const member functions (member var not changed)
-        so return value must be of value 
-        - more useful for non const functions that also return something */
-    std::optional<char> peek(int ahead = 0) const;
+    /* Past a run of whitespace, counting the lines it crosses */
+    void skipSpace();
+
+    /* Up to the newline ending a comment, or the end of the source */
+    void skipComment();
 
-    /* Consuming next character */
-    char consume();
+    /* Building a token that started at start/line/column */
+    Token make(TokenType type, size_t start, uint32_t line, uint32_t column) const;
 
-    const std::string m_src;
+    std::string_view m_src;
+    Interner& m_interner;
     size_t m_idx = 0;
+    uint32_t m_line = 1;
+    size_t m_lineStart = 0;     // offset of the current line's first character, columns count from it
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include <vector>
+#include "instruction.h"
+#include "interner.h"
+#include "ir.h"
+
+/* Putting modules compiled on their own back into one program
+ *  - merge(): one IR module from many, all named by the same interner. main goes first so it
+ *    still lands straight after the globals, then every module's functions and globals in
+ *    input order. A program without main is an error here, not an unresolved label once
+ *    assembling. Calls were resolved while lowering, with every module's definitions known
+ *  - link(): one listing from the separately generated pieces, laid out as
+ *        ORG 0   entry branch, stack word, every module's globals
+ *                each piece of code in order, the runtime routines last
+ *    Relaxation runs on the result, so a branch into another piece that ends up out of
+ *    reach is fixed there like any other */
+class Linker {
+public:
+    explicit Linker(const Interner& interner);
+
+    IrModule merge(std::vector<IrModule>& modules);
+    Listing link(Listing header, const std::vector<Listing>& pieces, const Listing& runtime);
+
+private:
+    const Interner& m_interner;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include <utility>
+#include <vector>
+#include "ast_visitor.h"
+#include "diagnostics.h"
+#include "interner.h"
+#include "ir.h"
+#include "parser.h"
+
+/* AST -> SSA IR
+ *  - each RPN element becomes at most one instruction, the RPN stack holds values
+ *  - locals and parameters are bindings from symbol to the value they currently name, a body's
+ *    declarations go out of scope at its end
+ *  - where paths join, names bound to different values on each get a phi; a loop's header has
+ *    one for every name its body assigns. break and continue are jumps to the loop's exit and
+ *    to its condition, which join what every jump arriving there carries
+ *  - non-literal global initialisers run at the start of main, so a module holding them must
+ *    define main
+ *  - globals and functions defined by other modules are passed in as externals, read, stored
+ *    and called like its own
+ *  - a function that can fall off its end gets a `ret` that leaves R1 as it is
+ * Names are resolved here: an undeclared identifier, a call to a function nobody defines or
+ * one passing the wrong number of arguments is reported against `file` at the node's line and
+ * column, and lowering carries on to find the rest. Without diagnostics the first one throws.
+ * A module lowered with errors is only good for reporting */
+class Lowering : public ASTVisitor {
+public:
+    explicit Lowering(const Interner& interner, Diagnostics* diagnostics = nullptr, uint32_t file = 0);
+
+    /* functions: name and parameter count of each function another module defines */
+    IrModule lower(const NodeProgram& program, const std::vector<Symbol>& externals = {},
+                   const std::vector<std::pair<Symbol, uint32_t>>& functions = {});
+
+    /* Errors the last lower() reported */
+    uint32_t errors() const { return m_errors; }
+
+    // Statement visitors
+    void visitVarDecl(const NodeStatement& node) override;
+    void visitArithmetic(const NodeArithmetic& node) override;
+    void visitAssignment(const NodeStatement& node) override;
+    void visitReturn(const NodeStatement& node) override;
+    void visitIf(const NodeStatement& node) override;
+    void visitWhile(const NodeStatement& node) override;
+    void visitBreak(const NodeStatement& node) override;
+    void visitContinue(const NodeStatement& node) override;
+
+    // Expression visitors
+    void visitInteger(const NodeExpression& node) override;
+    void visitBoolean(const NodeExpression& node) override;
+    void visitIdentifier(const NodeExpression& node) override;
+    void visitOperator(const NodeExpression& node) override;
+    void visitFunctionCall(const NodeExpression& node) override;
+
+private:
+    void lowerFunction(const NodeFunction& func);
+    void lowerBody(const NodeBody& body);
+    Value lowerCondition(const NodeArithmetic& condition);
+    Value append(const IrInst& inst);
+    uint32_t currentBlock() const;
+    void endBlock();
+    Value phi(const std::vector<IrIncoming>& incoming);
+    void merge(Symbol name, const std::vector<IrIncoming>& incoming);
+    void leave(std::vector<Value>& jumps, std::vector<IrIncoming>& sites);
+    void tracked(std::vector<Symbol>& names) const;
+    void bind(Symbol name, Value value);
+    void declare(Symbol name, Value value);
+    void error(uint32_t line, uint32_t column, const std::string& message);
+
+    const Interner& m_interner;
+    Diagnostics* m_diagnostics;
+    uint32_t m_file;
+    uint32_t m_errors = 0;
+    const NodeProgram* m_program = nullptr;
+    IrFunction* m_function = nullptr;
+    std::vector<bool> m_global;         // per symbol: names a global
+    std::vector<int32_t> m_parameters;  // per symbol: its function's parameter count, -1 for none
+    std::vector<Value> m_binding;       // per symbol: value a local/parameter names, or NO_VALUE
+    std::vector<Symbol> m_touched;      // symbols to reset in m_binding
+    std::vector<std::pair<Symbol, Value>> m_scope;  // declarations in scope: name, binding it shadowed
+    bool m_live = true;                 // current block is reachable
+    std::vector<Value> m_stack;         // RPN evaluation stack
+
+    /* A while being lowered: the names its body assigns, and for break and continue every
+     * jump (targets filled in once known) and, from reachable ones, each name's binding */
+    struct Loop {
+        std::vector<Symbol> names;
+        size_t scope;                                   // m_scope's size outside the body
+        std::vector<Value> breakJumps, continueJumps;
+        std::vector<IrIncoming> breaks, continues;      // names.size() per reachable jump
+    };
+    std::vector<Loop> m_loops;
+};
+
+#endif
@@ -2,14 +2,16 @@
 #define PARSER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <queue>
-#include <stack>
 #include <memory>
 #include <utility>
 #include <iostream>
 #include <stdexcept>
 #include <fstream>
+#include "arena.h"
+#include "diagnostics.h"
+#include "interner.h"
 #include "lexer.h"
 #include "ast_visitor.h"
 
@@ -17,43 +19,50 @@ struct NodeProgram;
 struct NodeFunction;
 struct NodeBody;
 struct NodeStatement;
-struct NodeAssignment;
-struct NodeVarDecl;
 struct NodeArithmetic;
-struct NodeReturn;
 struct NodeExpression;
-struct NodeInteger;
-struct NodeIdentifier;
-struct NodeOperator;
-struct NodeFunctionCall;
 
+/* Recursive descent over tokens pulled from the lexer as needed
+ *  - with diagnostics, a syntax error is reported against `file` and parsing picks up again
+ *    at the next statement (past a `;`, or at the `}` closing the body) or, outside a
+ *    function body, at the next `fn`/`int`; it stops once the diagnostics are full
+ *  - without, the first error throws std::runtime_error naming its line and column
+ * A program parsed with errors is incomplete and only good for reporting */
 class Parser {
 public:
     /* Constructor */
-    explicit Parser(std::vector<Token>& tokens);
+    explicit Parser(Lexer& lexer, Diagnostics* diagnostics = nullptr, uint32_t file = 0);
 
-    /* Parsing input tokens from lexer */
+    /* Parsing input tokens from lexer, every node lives in the program's arena */
     std::unique_ptr<NodeProgram> parse();
 
+    /* Syntax errors the last parse() reported */
+    uint32_t errors() const { return m_errors; }
+
 private:
     /* Parsing different abstracted constructs */
-    std::unique_ptr<NodeFunction> parseFunction();
-    std::vector<std::string> parseParameters();
-    void parseEffectList();
-    std::unique_ptr<NodeBody> parseBody();
-    std::unique_ptr<NodeStatement> parseStatement();
-    std::unique_ptr<NodeAssignment> parseAssignment();
-    std::unique_ptr<NodeVarDecl> parseVarDecl(bool global);
-    std::unique_ptr<NodeArithmetic> parseArithmetic();
-    std::unique_ptr<NodeReturn> parseReturn();
+    NodeFunction parseFunction();
+    Span<Symbol> parseParameters();
+    bool parseEffectList();
+    NodeBody parseBody();
+    NodeStatement parseStatement();
+    NodeStatement parseAssignment();
+    NodeStatement parseVarDecl(bool global);
+    NodeArithmetic parseArithmetic();
+    NodeStatement parseReturn();
+    NodeStatement parseIf();
+    NodeStatement parseWhile();
+    NodeStatement parseJump();
+    NodeArithmetic parseCondition();
+    NodeArithmetic parseExpression();
 
     /* Arithmetic Helper methods */
     bool isOperator(TokenType type);
-    char getOperator(TokenType op);
-    int getPrecedence(char op);
+    int getPrecedence(TokenType op);
+    void popOperator();
 
-    /* Looking at/consuming previous/current token, should we use ahead for peek? */
-    Token peek() const;
+    /* Looking at/consuming current token, ahead < LOOKAHEAD */
+    const Token& peek(size_t ahead = 0);
     Token consume(TokenType type);
 
     /* Navigating and validating tokens */
@@ -62,153 +71,158 @@ private:
     bool checkAdvance(TokenType type);
     bool atEnd();
 
-    /* Error handling */
-    std::runtime_error error(const Token& token);
+    /* Source text behind a token */
+    std::string_view text(const Token& token) const;
+
+    /* A node placed at a token, so passes after parsing can point at it */
+    template <typename Node>
+    static Node at(Node node, const Token& token) {
+        node.line = token.line;
+        node.column = token.column;
+        return node;
+    }
 
-    const std::vector<Token> m_tokens;
-    size_t m_idx = 0;
+    /* Error handling: thrown up to the construct that can resume past it */
+    struct SyntaxError {
+        Token token;
+        std::string message;
+    };
+    struct Abandon {};          // diagnostics are full, unwinds all the way out of parse()
+    SyntaxError error(const Token& token, const std::string& expected);
+    void report(const SyntaxError& error);
+    std::string describe(const Token& token) const;
+    void skipStatement();
+    void skipDeclaration();
+
+    /* Tokens pulled from the lexer on demand into a small ring buffer */
+    static constexpr size_t LOOKAHEAD = 4;
+    Lexer& m_lexer;
+    Diagnostics* m_diagnostics;
+    uint32_t m_file;
+    uint32_t m_errors = 0;
+    uint32_t m_loops = 0;       // whiles around the statement being parsed, break/continue need one
+    Token m_ring[LOOKAHEAD];
+    size_t m_head = 0;
+    size_t m_buffered = 0;
+
+    /* Program being built, its arena owns every node */
+    NodeProgram* m_program = nullptr;
+
+    /* Scratch stacks reused across constructs, finished runs are copied into the arena
+     *  - nested constructs push above an outer construct's base and truncate back to it */
+    struct PendingCall {
+        Token name;
+        uint16_t argc;
+        size_t outputBase;
+    };
+    std::vector<NodeExpression> m_rpn;
+    std::vector<TokenType> m_operators;
+    std::vector<PendingCall> m_calls;
+    std::vector<NodeStatement> m_statements;
+    std::vector<Symbol> m_parameters;
 };
 
 /* Layers of abstract syntax tree
  * ---> Program -> Function -> Body -> Statement -> Expression
+ *
+ * Nodes are plain tagged structs stored contiguously in the program's arena,
+ * dispatch is a switch on the tag rather than a vtable. 
  */
-struct NodeProgram {
-    std::vector<std::unique_ptr<NodeFunction>> functions;
-    std::vector<std::unique_ptr<NodeVarDecl>> globals;
-};
-
-struct NodeFunction {
-    std::string name;
-    std::vector<std::string> parameters;
-    std::unique_ptr<NodeBody> body;
 
-    NodeFunction(std::string n, std::vector<std::string> p, std::unique_ptr<NodeBody> b)
-        : name(std::move(n)), parameters(std::move(p)), body(std::move(b)) {}
+//---> Expression ∈ {Integer, Boolean, Identifier, Operator, FunctionCall}
+enum class ExprKind : uint8_t {
+    INTEGER, BOOLEAN, IDENTIFIER, OPERATOR, CALL
 };
 
-struct NodeBody {
-    std::vector<std::unique_ptr<NodeStatement>> statements;
-    
-    NodeBody(std::vector<std::unique_ptr<NodeStatement>> stmts)
-        : statements(std::move(stmts)) {}
-};
-
-//---> Statement ∈ {Assignment, VarDecl, Return}
-struct NodeStatement {
-    virtual ~NodeStatement() = default;
-    virtual void accept(ASTVisitor& visitor) const = 0;
-};
-
-struct NodeAssignment : NodeStatement {
-    std::string name;
-    std::unique_ptr<NodeArithmetic> rpn;
-    
-    NodeAssignment(std::string n, std::unique_ptr<NodeArithmetic> r)
-        : name(n), rpn(std::move(r)) {}
-    
-    void accept(ASTVisitor& visitor) const override {
-        visitor.visit(*this);
+/* One element of an RPN sequence, 16 bytes */
+struct NodeExpression {
+    ExprKind kind;
+    TokenType op = TokenType::INVALID;  // OPERATOR
+    uint16_t argc = 0;                  // CALL: arguments already pushed by the preceding RPN
+    union {
+        int32_t value = 0;              // INTEGER/BOOLEAN
+        Symbol name;                    // IDENTIFIER/CALL
+    };
+    uint32_t line = 0, column = 0;      // IDENTIFIER/CALL: where the name is, for errors past parsing
+
+    explicit NodeExpression(ExprKind k) : kind(k) {}
+
+    void accept(ASTVisitor& visitor) const {
+        switch (kind) {
+        case ExprKind::INTEGER:    visitor.visitInteger(*this); break;
+        case ExprKind::BOOLEAN:    visitor.visitBoolean(*this); break;
+        case ExprKind::IDENTIFIER: visitor.visitIdentifier(*this); break;
+        case ExprKind::OPERATOR:   visitor.visitOperator(*this); break;
+        case ExprKind::CALL:       visitor.visitFunctionCall(*this); break;
+        }
     }
 };
 
-struct NodeVarDecl : NodeStatement {
-    std::string name;
-    std::unique_ptr<NodeArithmetic> rpn;
-    bool global;
+struct NodeArithmetic {
+    Span<NodeExpression> reversepolish;
 
-    NodeVarDecl(std::string n, std::unique_ptr<NodeArithmetic> r, bool g = false)
-        : name(n), rpn(std::move(r)), global(g) {}
-    
-    void accept(ASTVisitor& visitor) const override {
-        visitor.visit(*this);
+    void accept(ASTVisitor& visitor) const {
+        visitor.visitArithmetic(*this);
     }
 };
 
-struct NodeArithmetic : NodeStatement {
-    std::vector<std::unique_ptr<NodeExpression>> reversepolish;
-
-    NodeArithmetic(std::vector<std::unique_ptr<NodeExpression>> rpn)
-        : reversepolish(std::move(rpn)) {}
-    
-    void accept(ASTVisitor& visitor) const override {
-        visitor.visit(*this);
-    }
+//---> Statement ∈ {Assignment, VarDecl, Return, If, While, Break, Continue}
+enum class StmtKind : uint8_t {
+    ASSIGNMENT, VAR_DECL, RETURN, IF, WHILE, BREAK, CONTINUE
 };
 
-struct NodeReturn : NodeStatement {
-    std::unique_ptr<NodeArithmetic> rpn;
-
-    NodeReturn(std::unique_ptr<NodeArithmetic> r)
-        : rpn(std::move(r)) {}
-    
-    void accept(ASTVisitor& visitor) const override {
-        visitor.visit(*this);
-    }
-};
-
-//---> Expression ∈ {Integer, Arithmetic, FunctionCall}
-struct NodeExpression {
-    virtual ~NodeExpression() = default;
-    virtual void accept(ASTVisitor& visitor) const = 0;
-};
+struct NodeStatement;
 
-struct NodeInteger : NodeExpression {
-    Token value;
+struct NodeBody {
+    Span<NodeStatement> statements;
 
-    NodeInteger(Token v)
-        : value(std::move(v)) {}
-    
-    void accept(ASTVisitor& visitor) const override {
-        visitor.visit(*this);
-    }
+    /* Names assigned anywhere inside, nested bodies included (may repeat) */
+    void assigned(std::vector<Symbol>& names) const;
 };
 
-struct NodeIdentifier : NodeExpression {
-    Token value;
-
-    NodeIdentifier(Token v)
-        : value(std::move(v)) {}
-    
-    void accept(ASTVisitor& visitor) const override {
-        visitor.visit(*this);
+struct NodeStatement {
+    StmtKind kind;
+    bool global = false;        // VAR_DECL
+    Symbol name = 0;            // ASSIGNMENT/VAR_DECL
+    NodeArithmetic rpn{};       // value, or the condition of IF/WHILE
+    NodeBody body{};            // IF/WHILE
+    NodeBody otherwise{};       // IF: else branch, `else if` is an else holding one IF
+    uint32_t line = 0, column = 0;  // the name of ASSIGNMENT/VAR_DECL, otherwise the keyword
+
+    void accept(ASTVisitor& visitor) const {
+        switch (kind) {
+        case StmtKind::ASSIGNMENT: visitor.visitAssignment(*this); break;
+        case StmtKind::VAR_DECL:   visitor.visitVarDecl(*this); break;
+        case StmtKind::RETURN:     visitor.visitReturn(*this); break;
+        case StmtKind::IF:         visitor.visitIf(*this); break;
+        case StmtKind::WHILE:      visitor.visitWhile(*this); break;
+        case StmtKind::BREAK:      visitor.visitBreak(*this); break;
+        case StmtKind::CONTINUE:   visitor.visitContinue(*this); break;
+        }
     }
 };
 
-struct NodeOperator : NodeExpression {
-    Token value;
-
-    NodeOperator(Token v)
-        : value(std::move(v)) {}
-    
-    void accept(ASTVisitor& visitor) const override {
-        visitor.visit(*this);
+inline void NodeBody::assigned(std::vector<Symbol>& names) const {
+    for (const NodeStatement& stmt : statements) {
+        if (stmt.kind == StmtKind::ASSIGNMENT) names.push_back(stmt.name);
+        stmt.body.assigned(names);
+        stmt.otherwise.assigned(names);
     }
-};
-
-struct NodeBoolean : NodeExpression {
-    Token value;
+}
 
-    NodeBoolean(Token v)
-        : value(std::move(v)) {}
-    
-    void accept(ASTVisitor& visitor) const override {
-        visitor.visit(*this);
-    }
+struct NodeFunction {
+    Symbol name;
+    Span<Symbol> parameters;
+    NodeBody body;
+    bool pure;      // declared `effects []`
 };
 
-struct NodeFunctionCall : NodeExpression {
-    Token value;
-    std::vector<Token> inputs; // int_lit or identifier
-
-    NodeFunctionCall(Token v, std::vector<Token> i)
-        : value(std::move(v)), inputs(std::move(i)) {}
-    
-    void accept(ASTVisitor& visitor) const override {
-        visitor.visit(*this);
-    }
+struct NodeProgram {
+    Arena arena;
+    Span<NodeFunction> functions;
+    Span<NodeStatement> globals;
 };
 
-
 #endif
 
 /*
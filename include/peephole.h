@@ -0,0 +1,71 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "instruction.h"
+
+/* Peephole rules, each can be switched off on its own */
+enum class PeepholeRule : uint8_t {
+    STORE_LOAD,     // ST r, [a] ... LD s, [a]  ->  ST r, [a] ... MOV s, r
+    LOAD_LOAD,      // LD r, [a] ... LD s, [a]  ->  LD r, [a] ... MOV s, r
+    LOAD_STORE,     // LD r, [a] ... ST r, [a]  ->  LD r, [a]
+    SELF_MOVE,      // MOV r, r
+    REVERSE_MOVE,   // MOV r, s ... MOV s, r  ->  MOV r, s
+    SP_SINK,        // ADD SP, SP, #k; LD r, [SP, #i]  ->  LD r, [SP, #i+k]; ADD SP, SP, #k
+    SP_MERGE,       // ADD SP, SP, #a; SUB SP, SP, #b  ->  ADD SP, SP, #a-b
+    DEAD_ZERO,      // MOV r, #0 never read before r is overwritten or the function returns
+    COUNT,
+};
+
+/* Peephole optimiser over a Listing
+ *  - local rules look at a sliding window of instructions within one basic block
+ *  - dead zeroing follows branches to see whether the register is read again
+ *  - removed instructions become NOPs during the passes and are compacted at the end
+ *  - rules run to a fixed point, one rewrite often exposes another */
+class Peephole {
+public:
+    explicit Peephole(size_t window = 8);
+
+    void enable(PeepholeRule rule, bool on) { m_enabled[static_cast<size_t>(rule)] = on; }
+    void enableAll(bool on) { m_enabled.fill(on); }
+    bool enabled(PeepholeRule rule) const { return m_enabled[static_cast<size_t>(rule)]; }
+
+    void run(Listing& listing);
+
+    /* Per-rule hit counters from the last run() */
+    uint32_t hits(PeepholeRule rule) const { return m_hits[static_cast<size_t>(rule)]; }
+
+    static const char* name(PeepholeRule rule);
+    static std::optional<PeepholeRule> rule(std::string_view name);
+
+private:
+    static constexpr size_t RULES = static_cast<size_t>(PeepholeRule::COUNT);
+
+    void hit(PeepholeRule rule) { m_hits[static_cast<size_t>(rule)]++; }
+
+    bool forwardMemory(size_t at);
+    bool reverseMove(size_t at);
+    bool stackPointer(size_t at);
+    bool deadZero(size_t at);
+    bool isLive(size_t from, uint8_t reg);
+
+    size_t next(size_t at) const;
+    bool barrier(const Instruction& instruction) const;
+
+    size_t m_window;
+    std::array<bool, RULES> m_enabled;
+    std::array<uint32_t, RULES> m_hits;
+
+    Listing* m_listing = nullptr;
+    std::vector<Instruction>* m_code = nullptr;
+    std::vector<size_t> m_labelAt;      // per label: index of its definition or SIZE_MAX
+    std::vector<bool> m_pinned;         // inside a PC-relative return address sequence
+    std::vector<size_t> m_work;
+    std::vector<bool> m_visited;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Wall time and heap use per compiler phase, for --time-report and --trace
+ *  - a Scope times one run of a phase on the calling thread; runs of the same phase, from any
+ *    thread, add up to one row of the report
+ *  - allocations and bytes are what the phase asked operator new for, peak is how far the
+ *    thread's live heap grew above where it stood when the phase started
+ *  - phases running on several threads at once report the sum of their threads' time, so a
+ *    row can exceed the total wall time
+ * A disabled profiler's scopes do nothing, and operator new only counts while one is enabled */
+class Profiler {
+public:
+    struct Phase {
+        std::string name;
+        uint32_t runs = 0;
+        double ms = 0;
+        uint64_t allocations = 0;
+        uint64_t bytes = 0;
+        int64_t peak = 0;
+    };
+
+    class Scope {
+    public:
+        Scope(Profiler& profiler, const char* name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Profiler* m_profiler;               // null when disabled
+        const char* m_name;
+        std::chrono::steady_clock::time_point m_start;
+        uint64_t m_allocations = 0;
+        uint64_t m_bytes = 0;
+        int64_t m_live = 0;
+        int64_t m_outerPeak = 0;            // restored on exit, scopes may nest
+    };
+
+    /* trace: also keep one event per scope for writeTrace() */
+    Profiler(bool enabled, bool trace);
+    ~Profiler();
+
+    bool enabled() const { return m_enabled; }
+
+    /* Phases in the order they first ran, then the whole run's wall time */
+    std::string report() const;
+
+    /* Chrome trace-event JSON, false if the file can't be written */
+    bool writeTrace(const std::string& path) const;
+
+private:
+    struct Event {
+        const char* name;
+        uint32_t thread;
+        double start, duration;     // microseconds since the profiler started
+    };
+
+    void record(const char* name, std::chrono::steady_clock::time_point start,
+                uint64_t allocations, uint64_t bytes, int64_t peak);
+
+    bool m_enabled;
+    bool m_trace;
+    std::chrono::steady_clock::time_point m_start;
+    mutable std::mutex m_mutex;
+    std::vector<Phase> m_phases;
+    std::vector<Event> m_events;
+};
+
+#endif
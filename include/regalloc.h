@@ -0,0 +1,40 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <cstdint>
+#include <vector>
+
+/* Live range of one value over a function's linearised program points,
+ * the value is read for the last time at end */
+struct LiveInterval {
+    uint32_t value;
+    uint32_t start;
+    uint32_t end;
+    bool hasHome = false;       // value already has a memory home, spilling needs no slot
+};
+
+/* Where each value ended up */
+struct Allocation {
+    static constexpr int8_t SPILLED = -1;
+
+    std::vector<int8_t> reg;        // per value: register number or SPILLED
+    std::vector<int16_t> slot;      // per value: spill slot or -1
+    uint32_t spills = 0;            // intervals that didn't get a register
+    uint32_t slots = 0;             // spill slots needed
+};
+
+/* Linear-scan register allocation (Poletto & Sarkar)
+ *  - intervals are visited by start point, a register frees up once its interval ends
+ *  - under pressure the interval ending furthest away is spilled */
+class LinearScan {
+public:
+    /* Constructor: registers available to allocate from, in order of preference */
+    explicit LinearScan(std::vector<uint8_t> registers);
+
+    Allocation allocate(std::vector<LiveInterval> intervals, size_t valueCount) const;
+
+private:
+    std::vector<uint8_t> m_registers;
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/* Compiles for other processes over a Unix domain socket, so a build that calls the compiler
+ * thousands of times pays for process start and a cold heap once
+ *  - a request is one compile's flags and files, sent as name and source; the response is
+ *    its exit status, its output and whatever it would have printed
+ *  - every connection gets its own thread and may send any number of requests one after
+ *    another, so clients compile concurrently and one that keeps its connection skips connect()
+ *  - a message is its length then its fields, each a little-endian u32 or a u32 length and
+ *    that many bytes:
+ *      request:  argc, args..., files, (name, source)...
+ *      response: status, output, messages */
+class CompileServer {
+public:
+    struct File {
+        std::string name;
+        std::string source;
+    };
+
+    struct Request {
+        std::vector<std::string> args;
+        std::vector<File> files;
+    };
+
+    struct Response {
+        uint32_t status = 0;
+        std::string output;
+        std::string messages;
+    };
+
+    /* Called on the connection's thread, for as many requests at once as there are connections */
+    using Handler = std::function<Response(const Request&)>;
+
+    /* Listens on path, replacing a socket a stopped server left behind but not one that is
+     * still answering; throws std::runtime_error if it can't */
+    CompileServer(std::string path, Handler handler);
+    ~CompileServer();
+
+    CompileServer(const CompileServer&) = delete;
+    CompileServer& operator=(const CompileServer&) = delete;
+
+    /* Accepts connections until SIGINT or SIGTERM, which remove the socket and exit */
+    void serve();
+
+    /* Both ends of the protocol, false once the connection is closed or broken */
+    static bool send(int fd, const Request& request);
+    static bool send(int fd, const Response& response);
+    static bool receive(int fd, Request& request);
+    static bool receive(int fd, Response& response);
+
+    /* A connected client socket, -1 if nothing is listening on path */
+    static int connect(const std::string& path);
+
+private:
+    void handle(int fd) const;
+
+    std::string m_path;
+    Handler m_handler;
+    int m_listener = -1;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "assembler.h"
+
+/* Instruction classes the cycle model distinguishes */
+enum class InstructionClass : uint8_t { ALU, LOAD, STORE, BRANCH_TAKEN, BRANCH_NOT_TAKEN, COUNT };
+
+/* Cycle model, every access to memory is one cycle on the single 16-bit bus
+ *  - fetch + execute for every instruction
+ *  - one more cycle for the data access of LD/ST
+ *  - taken branches refill the fetch, one more cycle */
+struct CycleModel {
+    uint32_t fetch = 1;
+    uint32_t execute = 1;
+    uint32_t memory = 1;
+    uint32_t branchTaken = 1;
+};
+
+/* STUMP executor over an assembled Image
+ *  - halts on a branch to itself (`halt: B halt`) or after a step limit
+ *  - executing a word the source never wrote stops with an error
+ *  - per-address execution counts and cycles for hot-spot profiles */
+class Simulator {
+public:
+    explicit Simulator(const Image& image, CycleModel model = {});
+
+    enum class Stop { HALTED, STEP_LIMIT, BAD_FETCH };
+    Stop run(uint64_t stepLimit);
+
+    uint16_t reg(uint8_t r) const { return m_regs[r]; }
+    uint16_t pc() const { return m_regs[7]; }
+    bool flag(char name) const;
+
+    /* Counters */
+    uint64_t steps() const { return m_steps; }
+    uint64_t cycles() const { return m_cycles; }
+    uint64_t count(InstructionClass c) const { return m_classCount[static_cast<size_t>(c)]; }
+    uint64_t classCycles(InstructionClass c) const { return m_classCycles[static_cast<size_t>(c)]; }
+    uint64_t fetches() const { return m_steps; }
+    uint64_t reads() const { return m_reads; }
+    uint64_t writes() const { return m_writes; }
+    uint64_t peripheralAccesses() const { return m_peripheral; }
+    uint16_t peakSP() const { return m_peakSP; }
+
+    /* Profile, indexed by address */
+    const std::vector<uint64_t>& hits() const { return m_hits; }
+    const std::vector<uint64_t>& hitCycles() const { return m_hitCycles; }
+
+    static const char* className(InstructionClass c);
+
+private:
+    void step();
+    uint16_t load(uint16_t address);
+    void store(uint16_t address, uint16_t value);
+    bool condition(uint8_t cond) const;
+
+    const Image& m_image;
+    CycleModel m_model;
+    std::vector<uint16_t> m_memory;
+    std::array<uint16_t, 8> m_regs{};
+    bool m_n = false, m_z = false, m_v = false, m_c = false;
+    bool m_halted = false;
+
+    uint64_t m_steps = 0;
+    uint64_t m_cycles = 0;
+    std::array<uint64_t, static_cast<size_t>(InstructionClass::COUNT)> m_classCount{};
+    std::array<uint64_t, static_cast<size_t>(InstructionClass::COUNT)> m_classCycles{};
+    uint64_t m_reads = 0;
+    uint64_t m_writes = 0;
+    uint64_t m_peripheral = 0;
+    uint16_t m_peakSP = 0;
+    std::vector<uint64_t> m_hits;
+    std::vector<uint64_t> m_hitCycles;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <string>
+#include <string_view>
+
+/* Read-only view of an input file
+ *  - file is mmap'd so the lexer can hand out offsets into it without copying
+ *  - buffer must outlive every token/AST node that points into it */
+class SourceBuffer {
+public:
+    /* Constructor: maps whole file, throws std::runtime_error if unreadable */
+    explicit SourceBuffer(const std::string& path);
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    /* Whole file as a view */
+    std::string_view view() const { return {m_data, m_size}; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+#endif
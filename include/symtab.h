@@ -0,0 +1,43 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+#include "interner.h"
+
+/* Program-wide names for modules compiled on different threads
+ *  - each module lexes into its own Interner, then imports it here in one go, so a name is
+ *    the same Symbol in every module from then on
+ *  - functions and globals are defined along with the module they come from, a name can only
+ *    be defined once across the whole program
+ *  - lookups share the lock, imports and definitions take it exclusively */
+class SymbolTable {
+public:
+    enum class Kind : uint8_t { FUNCTION, GLOBAL };
+
+    struct Definition {
+        Kind kind;
+        uint32_t module;
+        uint32_t parameters;    // FUNCTION
+    };
+
+    /* Program-wide symbol for each of a module's local ones */
+    std::vector<Symbol> import(const Interner& local);
+
+    /* Records a definition, or returns the one already there when the name is taken */
+    std::optional<Definition> define(Symbol name, Kind kind, uint32_t module, uint32_t parameters = 0);
+
+    std::optional<Definition> find(Symbol name) const;
+
+    /* Only safe to read once no thread can still import into it */
+    const Interner& interner() const { return m_interner; }
+
+private:
+    mutable std::shared_mutex m_mutex;
+    Interner m_interner;
+    std::vector<std::optional<Definition>> m_definitions;   // per symbol
+};
+
+#endif
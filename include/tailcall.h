@@ -0,0 +1,27 @@
+#ifndef TAILCALL_H
+#define TAILCALL_H
+
+#include <cstdint>
+#include <vector>
+#include "ir.h"
+
+/* Self tail calls become jumps over the SSA IR
+ *  - `%r = call f(...); ret %r` inside f jumps back to a header after the entry block instead
+ *  - the header starts with a phi per parameter: the parameter itself from the entry, the call's
+ *    arguments from each former tail call
+ * The recursion turns into a loop running in constant stack, the backend's phi coalescing
+ * usually leaves each argument computed straight into its parameter's register */
+class TailCallEliminator {
+public:
+    void run(IrModule& module);
+
+    /* Counters from the last run() */
+    uint32_t eliminated() const { return m_eliminated; }
+
+private:
+    void eliminate(IrFunction& func, const std::vector<Value>& sites);
+
+    uint32_t m_eliminated = 0;
+};
+
+#endif
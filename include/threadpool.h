@@ -0,0 +1,49 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads running batches of independent tasks
+ *  - run(count, task) calls task(0) .. task(count - 1) spread over the workers and the calling
+ *    thread, returning once every call has finished
+ *  - tasks are handed out one index at a time, so uneven tasks still balance
+ *  - the first exception a task throws is rethrown by run() after the batch has drained */
+class ThreadPool {
+public:
+    /* 0 threads: one per hardware thread; the calling thread counts as one of them */
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+    unsigned threads() const { return static_cast<unsigned>(m_workers.size()) + 1; }
+
+private:
+    void work();
+    void drain(const std::function<void(size_t)>& task, size_t count);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;     // a batch was posted, or the pool is stopping
+    std::condition_variable m_done;     // a task or a worker finished
+    const std::function<void(size_t)>* m_task = nullptr;
+    size_t m_count = 0;
+    size_t m_finished = 0;              // tasks of the current batch done
+    unsigned m_active = 0;              // workers inside drain()
+    uint64_t m_batch = 0;
+    bool m_stopping = false;
+    std::atomic<size_t> m_next{0};      // next index to hand out
+    std::exception_ptr m_error;
+};
+
+#endif
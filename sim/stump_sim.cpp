@@ -0,0 +1,130 @@
+/* STUMP simulator: assembles a .s file and runs it from address 0
+ *
+ *   stump-sim [--profile] [--top=N] [--limit=STEPS] <program.s>
+ *
+ * Prints code size, cycles per instruction class, memory traffic, the final registers
+ * and, with --profile, where the cycles went per label and per source line. */
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "source.h"
+#include "assembler.h"
+#include "simulator.h"
+
+static void printProfile(const Image& image, const Simulator& sim, size_t top) {
+    const std::vector<uint64_t>& hits = sim.hits();
+    const std::vector<uint64_t>& cycles = sim.hitCycles();
+    double total = static_cast<double>(sim.cycles());
+
+    /* Per label: every address counts towards the nearest label at or before it */
+    std::map<std::string_view, std::pair<uint64_t, uint64_t>> labels;
+    std::map<uint32_t, std::pair<uint64_t, uint64_t>> lines;
+    for (uint32_t address = 0; address < Image::WORDS; address++) {
+        if (hits[address] == 0) continue;
+        std::string_view label = image.labelAt(static_cast<uint16_t>(address));
+        labels[label.empty() ? "<none>" : label].first += cycles[address];
+        labels[label.empty() ? "<none>" : label].second += hits[address];
+        lines[image.lineOf[address]].first += cycles[address];
+        lines[image.lineOf[address]].second += hits[address];
+    }
+
+    auto byCycles = [](const auto& a, const auto& b) { return a.second.first > b.second.first; };
+
+    std::vector<std::pair<std::string_view, std::pair<uint64_t, uint64_t>>> perLabel(labels.begin(), labels.end());
+    std::sort(perLabel.begin(), perLabel.end(), byCycles);
+    std::cout << "\nprofile by label\n";
+    std::cout << std::setw(12) << "cycles" << std::setw(8) << "%" << std::setw(12) << "instrs" << "  label\n";
+    for (size_t i = 0; i < perLabel.size() && i < top; i++) {
+        std::cout << std::setw(12) << perLabel[i].second.first
+                  << std::setw(7) << std::fixed << std::setprecision(1) << 100.0 * perLabel[i].second.first / total << "%"
+                  << std::setw(12) << perLabel[i].second.second << "  " << perLabel[i].first << "\n";
+    }
+
+    std::vector<std::pair<uint32_t, std::pair<uint64_t, uint64_t>>> perLine(lines.begin(), lines.end());
+    std::sort(perLine.begin(), perLine.end(), byCycles);
+    std::cout << "\nprofile by line\n";
+    std::cout << std::setw(12) << "cycles" << std::setw(8) << "%" << std::setw(12) << "hits" << std::setw(7) << "line" << "  source\n";
+    for (size_t i = 0; i < perLine.size() && i < top; i++) {
+        uint32_t line = perLine[i].first;
+        std::string source = line > 0 ? image.lines[line - 1] : "";
+        source.erase(0, source.find_first_not_of(" \t"));
+        std::cout << std::setw(12) << perLine[i].second.first
+                  << std::setw(7) << std::fixed << std::setprecision(1) << 100.0 * perLine[i].second.first / total << "%"
+                  << std::setw(12) << perLine[i].second.second << std::setw(7) << line << "  " << source << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    bool profile = false;
+    size_t top = 20;
+    uint64_t limit = 100000000;
+    const char* input = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--profile") {
+            profile = true;
+        } else if (arg.rfind("--top=", 0) == 0) {
+            top = std::stoul(arg.substr(6));
+        } else if (arg.rfind("--limit=", 0) == 0) {
+            limit = std::stoull(arg.substr(8));
+        } else if (input == nullptr && arg.rfind("--", 0) != 0) {
+            input = argv[i];
+        } else {
+            input = nullptr;
+            break;
+        }
+    }
+    if (input == nullptr) {
+        std::cerr << "Usage should be..." << std::endl;
+        std::cerr << "./bin/stump-sim [--profile] [--top=N] [--limit=STEPS] <program.s>" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Image image;
+    try {
+        SourceBuffer source(input);
+        image = Assembler(source.view()).assemble();
+    } catch (const std::runtime_error& e) {
+        std::cerr << input << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Simulator sim(image);
+    Simulator::Stop stop = sim.run(limit);
+
+    std::cout << "words:    " << image.words << std::endl;
+    std::cout << "steps:    " << sim.steps() << std::endl;
+    std::cout << "cycles:   " << sim.cycles() << std::endl;
+    for (size_t i = 0; i < static_cast<size_t>(InstructionClass::COUNT); i++) {
+        InstructionClass c = static_cast<InstructionClass>(i);
+        std::cout << "  " << std::left << std::setw(18) << Simulator::className(c) << std::right
+                  << std::setw(12) << sim.count(c) << " instrs" << std::setw(12) << sim.classCycles(c) << " cycles" << std::endl;
+    }
+    std::cout << "memory:   " << sim.fetches() << " fetches, " << sim.reads() << " reads, "
+              << sim.writes() << " writes, " << sim.peripheralAccesses() << " peripheral" << std::endl;
+    std::cout << "stack:    peak SP 0x" << std::hex << sim.peakSP() << std::dec << std::endl;
+    std::cout << "regs:    ";
+    for (uint8_t r = 0; r < 8; r++) {
+        std::cout << " R" << int(r) << "=" << static_cast<int16_t>(sim.reg(r));
+    }
+    std::cout << "  " << (sim.flag('N') ? 'N' : '-') << (sim.flag('Z') ? 'Z' : '-')
+              << (sim.flag('V') ? 'V' : '-') << (sim.flag('C') ? 'C' : '-') << std::endl;
+    std::cout << "result:   " << static_cast<int16_t>(sim.reg(1)) << std::endl;
+
+    if (profile) printProfile(image, sim, top);
+
+    switch (stop) {
+    case Simulator::Stop::HALTED:
+        return EXIT_SUCCESS;
+    case Simulator::Stop::STEP_LIMIT:
+        std::cerr << "stopped: step limit of " << limit << " reached at 0x" << std::hex << sim.pc() << std::endl;
+        return EXIT_FAILURE;
+    default:
+        std::cerr << "stopped: executing non-code at 0x" << std::hex << sim.pc() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
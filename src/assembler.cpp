@@ -0,0 +1,406 @@
+#include "assembler.h"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+static const char* ALU_MNEMONICS[] = {"ADD", "ADC", "SUB", "SBC", "AND", "OR"};
+static const char* CONDITIONS[] = {"AL", "NV", "HI", "LS", "CC", "CS", "NE", "EQ",
+                                   "VC", "VS", "PL", "MI", "GE", "LT", "GT", "LE"};
+
+static std::string trim(std::string_view text) {
+    size_t begin = 0, end = text.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) begin++;
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) end--;
+    return std::string(text.substr(begin, end - begin));
+}
+
+static std::string upper(std::string text) {
+    for (char& c : text) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    return text;
+}
+
+/* ALU opcode and S flag for ADD..OR with an optional S suffix, -1 if not one */
+static int aluOpcode(const std::string& mnemonic, bool& setFlags) {
+    for (int op = 0; op < 6; op++) {
+        std::string name = ALU_MNEMONICS[op];
+        if (mnemonic == name) { setFlags = false; return op; }
+        if (mnemonic == name + "S") { setFlags = true; return op; }
+    }
+    return -1;
+}
+
+/* Condition for B/Bcc, -1 if not a branch */
+static int branchCondition(const std::string& mnemonic) {
+    if (mnemonic == "B") return 0;
+    if (mnemonic.size() != 3 || mnemonic[0] != 'B') return -1;
+    for (int cond = 0; cond < 16; cond++) {
+        if (mnemonic.compare(1, 2, CONDITIONS[cond]) == 0) return cond;
+    }
+    return -1;
+}
+
+static bool isMnemonic(const std::string& word) {
+    bool s;
+    std::string w = upper(word);
+    return aluOpcode(w, s) >= 0 || branchCondition(w) >= 0 ||
+           w == "MOV" || w == "MOVS" || w == "CMP" || w == "NOP" || w == "LD" || w == "ST" ||
+           w == "ORG" || w == "EQU" || w == "DATA" || w == "DEFW" || w == "DEFS";
+}
+
+/* Splitting operands on commas outside [ ] */
+static std::vector<std::string> splitOperands(std::string_view text) {
+    std::vector<std::string> operands;
+    int depth = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= text.size(); i++) {
+        if (i == text.size() || (text[i] == ',' && depth == 0)) {
+            std::string operand = trim(text.substr(start, i - start));
+            if (!operand.empty()) operands.push_back(operand);
+            start = i + 1;
+        } else if (text[i] == '[') {
+            depth++;
+        } else if (text[i] == ']') {
+            depth--;
+        }
+    }
+    return operands;
+}
+
+std::string_view Image::labelAt(uint16_t address) const {
+    auto it = std::upper_bound(labels.begin(), labels.end(), address,
+                               [](uint16_t a, const std::pair<uint16_t, std::string>& label) { return a < label.first; });
+    if (it == labels.begin()) return {};
+    return std::prev(it)->second;
+}
+
+Assembler::Assembler(std::string_view source)
+    : m_source(source) {
+    for (uint8_t r = 0; r < 8; r++) {
+        m_registers["R" + std::to_string(r)] = r;
+    }
+    m_registers["SP"] = 6;
+    m_registers["PC"] = 7;
+}
+
+Image Assembler::assemble() {
+    scan();
+    for (const Line& line : m_lines) {
+        encode(line);
+    }
+    std::sort(m_image.labels.begin(), m_image.labels.end());
+    return std::move(m_image);
+}
+
+// ======================================= Pass 1 =======================================
+
+/* Addresses for every line, labels and EQUs into the symbol table */
+void Assembler::scan() {
+    uint32_t address = 0;
+    uint32_t number = 0;
+    for (size_t start = 0; start <= m_source.size();) {
+        size_t end = m_source.find('\n', start);
+        if (end == std::string_view::npos) end = m_source.size();
+        std::string_view raw = m_source.substr(start, end - start);
+        start = end + 1;
+        number++;
+        m_image.lines.emplace_back(raw.substr(0, raw.find_last_not_of('\r') + 1));
+
+        std::string text = trim(raw.substr(0, raw.find(';')));
+        if (text.empty()) continue;
+
+        Line line{number, static_cast<uint16_t>(address), "", {}};
+        auto word = [&]() {
+            size_t stop = 0;
+            while (stop < text.size() && !std::isspace(static_cast<unsigned char>(text[stop]))) stop++;
+            std::string first = text.substr(0, stop);
+            text = trim(std::string_view(text).substr(stop));
+            return first;
+        };
+
+        /* Leading label: `name:` or any first word that isn't a mnemonic */
+        std::string label;
+        std::string first = word();
+        if (first.back() == ':') {
+            label = first.substr(0, first.size() - 1);
+            first = text.empty() ? "" : word();
+        } else if (!isMnemonic(first)) {
+            label = first;
+            first = text.empty() ? "" : word();
+        }
+        line.mnemonic = upper(first);
+        line.operands = splitOperands(text);
+
+        if (line.mnemonic == "EQU") {
+            if (label.empty() || line.operands.size() != 1) error(line, "EQU needs a name and a value");
+            if (isRegister(line.operands[0])) {
+                m_registers[label] = reg(line.operands[0], line);
+            } else {
+                m_symbols[label] = value(line.operands[0], line);
+            }
+            continue;
+        }
+        if (!label.empty()) {
+            if (m_symbols.count(label)) error(line, "duplicate label " + label);
+            m_symbols[label] = static_cast<int32_t>(address);
+            m_image.labels.push_back({static_cast<uint16_t>(address), label});
+        }
+        if (line.mnemonic.empty()) continue;
+
+        if (line.mnemonic == "ORG") {
+            if (line.operands.size() != 1) error(line, "ORG needs an address");
+            address = static_cast<uint32_t>(value(line.operands[0], line)) & 0xFFFF;
+            continue;
+        }
+        if (line.mnemonic == "DEFS") {
+            if (line.operands.size() != 1) error(line, "DEFS needs a size");
+            address += static_cast<uint32_t>(value(line.operands[0], line));
+            continue;
+        }
+
+        line.address = static_cast<uint16_t>(address);
+        bool data = line.mnemonic == "DATA" || line.mnemonic == "DEFW";
+        address += data ? static_cast<uint32_t>(std::max<size_t>(line.operands.size(), 1)) : 1;
+        if (address > Image::WORDS) error(line, "program runs past the end of memory");
+        m_lines.push_back(std::move(line));
+    }
+}
+
+// ======================================= Pass 2 =======================================
+
+void Assembler::encode(const Line& line) {
+    const std::string& m = line.mnemonic;
+    const std::vector<std::string>& ops = line.operands;
+    uint16_t address = line.address;
+
+    auto put = [&](uint16_t at, uint16_t word, bool instruction) {
+        m_image.memory[at] = word;
+        m_image.used[at] = true;
+        m_image.code[at] = instruction;
+        m_image.lineOf[at] = line.number;
+        m_image.words++;
+    };
+    auto immediate = [&](const std::string& text) {
+        if (text.empty() || text[0] != '#') error(line, "expected #immediate, got " + text);
+        int32_t imm = value(text.substr(1), line);
+        if (imm < -16 || imm > 15) error(line, "immediate " + std::to_string(imm) + " doesn't fit in 5 bits");
+        return imm;
+    };
+    auto shift = [&](size_t index) -> uint8_t {
+        if (ops.size() <= index) return stump::NO_SHIFT;
+        std::string s = upper(ops[index]);
+        if (s == "ASR") return stump::ASR;
+        if (s == "ROR") return stump::ROR;
+        if (s == "RRC") return stump::RRC;
+        error(line, "unknown shift " + ops[index]);
+    };
+    auto arity = [&](size_t low, size_t high) {
+        if (ops.size() < low || ops.size() > high) error(line, m + ": wrong number of operands");
+    };
+
+    if (m == "DATA" || m == "DEFW") {
+        if (ops.empty()) error(line, m + " needs a value");
+        for (size_t i = 0; i < ops.size(); i++) {
+            put(static_cast<uint16_t>(address + i), static_cast<uint16_t>(value(ops[i], line)), false);
+        }
+        return;
+    }
+    if (m == "NOP") {
+        put(address, stump::aluReg(stump::ADD, false, 0, 0, 0, stump::NO_SHIFT), true);
+        return;
+    }
+
+    bool setFlags = false;
+    int op = aluOpcode(m, setFlags);
+    if (op >= 0) {
+        arity(3, 4);
+        uint8_t rd = reg(ops[0], line), ra = reg(ops[1], line);
+        if (ops[2][0] == '#') {
+            if (ops.size() == 4) error(line, "shifts only apply to register forms");
+            put(address, stump::aluImm(static_cast<uint8_t>(op), setFlags, rd, ra, immediate(ops[2])), true);
+        } else {
+            put(address, stump::aluReg(static_cast<uint8_t>(op), setFlags, rd, ra, reg(ops[2], line), shift(3)), true);
+        }
+        return;
+    }
+    if (m == "MOV" || m == "MOVS") {
+        arity(2, 3);
+        bool s = m == "MOVS";
+        uint8_t rd = reg(ops[0], line);
+        if (ops[1][0] == '#') {
+            put(address, stump::aluImm(stump::ADD, s, rd, 0, immediate(ops[1])), true);
+        } else {
+            put(address, stump::aluReg(stump::ADD, s, rd, reg(ops[1], line), 0, shift(2)), true);
+        }
+        return;
+    }
+    if (m == "CMP") {
+        arity(2, 2);
+        uint8_t ra = reg(ops[0], line);
+        if (ops[1][0] == '#') {
+            put(address, stump::aluImm(stump::SUB, true, 0, ra, immediate(ops[1])), true);
+        } else {
+            put(address, stump::aluReg(stump::SUB, true, 0, ra, reg(ops[1], line), stump::NO_SHIFT), true);
+        }
+        return;
+    }
+    if (m == "LD" || m == "ST") {
+        arity(2, 2);
+        bool store = m == "ST";
+        uint8_t rd = reg(ops[0], line);
+        const std::string& operand = ops[1];
+        if (operand[0] != '[') {
+            /* PC-relative label, PC reads as the next address */
+            int32_t offset = value(operand, line) - (address + 1);
+            if (offset < -16 || offset > 15) error(line, operand + " is out of PC-relative reach");
+            put(address, stump::memImm(store, rd, 7, offset), true);
+            return;
+        }
+        if (operand.back() != ']') error(line, "unterminated address " + operand);
+        std::vector<std::string> parts = splitOperands(std::string_view(operand).substr(1, operand.size() - 2));
+        if (parts.empty() || parts.size() > 2) error(line, "bad address " + operand);
+        uint8_t ra = reg(parts[0], line);
+        if (parts.size() == 1) {
+            put(address, stump::memImm(store, rd, ra, 0), true);
+        } else if (parts[1][0] == '#') {
+            put(address, stump::memImm(store, rd, ra, immediate(parts[1])), true);
+        } else {
+            put(address, stump::memReg(store, rd, ra, reg(parts[1], line)), true);
+        }
+        return;
+    }
+    int cond = branchCondition(m);
+    if (cond >= 0) {
+        arity(1, 1);
+        int32_t offset = value(ops[0], line) - (address + 1);
+        if (offset < -128 || offset > 127) error(line, "branch to " + ops[0] + " is out of range");
+        put(address, stump::branch(static_cast<uint8_t>(cond), offset), true);
+        return;
+    }
+    error(line, "unknown mnemonic " + m);
+}
+
+// ====================================== Operands ======================================
+
+/* Sum of numbers and symbols, numbers in decimal, 0x hex or 0b binary */
+int32_t Assembler::value(const std::string& text, const Line& line) const {
+    int32_t total = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        int sign = 1;
+        while (i < text.size() && (text[i] == '+' || text[i] == '-' || std::isspace(static_cast<unsigned char>(text[i])))) {
+            if (text[i] == '-') sign = -sign;
+            i++;
+        }
+        size_t start = i;
+        while (i < text.size() && (std::isalnum(static_cast<unsigned char>(text[i])) || text[i] == '_')) i++;
+        std::string term = text.substr(start, i - start);
+        if (term.empty()) error(line, "bad expression " + text);
+
+        int32_t v;
+        if (std::isdigit(static_cast<unsigned char>(term[0]))) {
+            int base = 10;
+            size_t skip = 0;
+            if (term.size() > 2 && term[0] == '0' && (term[1] == 'x' || term[1] == 'X')) { base = 16; skip = 2; }
+            if (term.size() > 2 && term[0] == '0' && (term[1] == 'b' || term[1] == 'B')) { base = 2; skip = 2; }
+            size_t used = 0;
+            try {
+                v = static_cast<int32_t>(std::stol(term.substr(skip), &used, base));
+            } catch (const std::exception&) {
+                error(line, "bad number " + term);
+            }
+            if (used != term.size() - skip) error(line, "bad number " + term);
+        } else {
+            auto symbol = m_symbols.find(term);
+            if (symbol == m_symbols.end()) error(line, "undefined symbol " + term);
+            v = symbol->second;
+        }
+        total += sign * v;
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) i++;
+    }
+    return total;
+}
+
+bool Assembler::isRegister(const std::string& text) const {
+    return m_registers.count(upper(text)) || m_registers.count(text);
+}
+
+uint8_t Assembler::reg(const std::string& text, const Line& line) const {
+    auto it = m_registers.find(text);
+    if (it == m_registers.end()) it = m_registers.find(upper(text));
+    if (it == m_registers.end()) error(line, "expected a register, got " + text);
+    return it->second;
+}
+
+void Assembler::error(const Line& line, const std::string& message) const {
+    throw std::runtime_error("line " + std::to_string(line.number) + ": " + message);
+}
+
+// ====================================== Images ========================================
+
+std::string flatImage(const Image& image) {
+    uint32_t end = Image::WORDS;
+    while (end > 0 && !image.used[end - 1]) end--;
+    std::string out;
+    out.reserve(end * 2);
+    for (uint32_t address = 0; address < end; address++) {
+        out.push_back(static_cast<char>(image.memory[address] >> 8));
+        out.push_back(static_cast<char>(image.memory[address] & 0xFF));
+    }
+    return out;
+}
+
+/* :LLAAAATT<data>CC, CC the two's complement of the byte sum */
+static void hexRecord(std::string& out, uint8_t type, uint16_t offset, const uint8_t* data, uint8_t length) {
+    static const char digits[] = "0123456789ABCDEF";
+    uint8_t sum = static_cast<uint8_t>(length + (offset >> 8) + (offset & 0xFF) + type);
+    auto byte = [&](uint8_t b) {
+        out.push_back(digits[b >> 4]);
+        out.push_back(digits[b & 0xF]);
+    };
+    out.push_back(':');
+    byte(length);
+    byte(static_cast<uint8_t>(offset >> 8));
+    byte(static_cast<uint8_t>(offset & 0xFF));
+    byte(type);
+    for (uint8_t i = 0; i < length; i++) {
+        byte(data[i]);
+        sum = static_cast<uint8_t>(sum + data[i]);
+    }
+    byte(static_cast<uint8_t>(-sum));
+    out.push_back('\n');
+}
+
+std::string intelHex(const Image& image) {
+    static constexpr uint32_t RECORD_WORDS = 8;
+    uint32_t used = static_cast<uint32_t>(std::count(image.used.begin(), image.used.end(), true));
+    std::string out;
+    out.reserve((used / RECORD_WORDS + 2) * (12 + RECORD_WORDS * 4));   // a full record is 44 bytes with its newline
+    uint32_t segment = 0;       // upper 16 bits of the byte address last announced
+    for (uint32_t address = 0; address < Image::WORDS;) {
+        if (!image.used[address]) {
+            address++;
+            continue;
+        }
+        /* Up to a record's worth of written words, not crossing a 64K byte boundary */
+        uint32_t bytes = address * 2;
+        uint32_t end = address;
+        while (end < Image::WORDS && end - address < RECORD_WORDS && image.used[end] &&
+               (end * 2) >> 16 == bytes >> 16) {
+            end++;
+        }
+        if (bytes >> 16 != segment) {
+            segment = bytes >> 16;
+            uint8_t upper[2] = {static_cast<uint8_t>(segment >> 8), static_cast<uint8_t>(segment & 0xFF)};
+            hexRecord(out, 4, 0, upper, 2);
+        }
+        uint8_t data[RECORD_WORDS * 2];
+        for (uint32_t w = address; w < end; w++) {
+            data[(w - address) * 2] = static_cast<uint8_t>(image.memory[w] >> 8);
+            data[(w - address) * 2 + 1] = static_cast<uint8_t>(image.memory[w] & 0xFF);
+        }
+        hexRecord(out, 0, static_cast<uint16_t>(bytes & 0xFFFF), data, static_cast<uint8_t>((end - address) * 2));
+        address = end;
+    }
+    hexRecord(out, 1, 0, nullptr, 0);
+    return out;
+}
@@ -0,0 +1,221 @@
+#include "cache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <sys/stat.h>
+
+/* Bumped whenever an entry's layout changes */
+static constexpr uint32_t FORMAT_VERSION = 3;
+static constexpr char MAGIC[4] = {'S', 'T', 'F', 'C'};
+
+static_assert(std::is_trivially_copyable<Instruction>::value, "instructions are stored as raw bytes");
+
+/* 64-bit FNV-1a, fed field by field */
+class Hasher {
+public:
+    explicit Hasher(uint64_t seed = 0xcbf29ce484222325ull) : m_hash(seed) {}
+
+    void bytes(const void* data, size_t size) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            m_hash ^= p[i];
+            m_hash *= 0x100000001b3ull;
+        }
+    }
+    template <typename T>
+    void value(T v) {
+        static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "plain values only");
+        bytes(&v, sizeof(v));
+    }
+    void text(std::string_view s) {
+        value(static_cast<uint32_t>(s.size()));
+        bytes(s.data(), s.size());
+    }
+    uint64_t hash() const { return m_hash; }
+
+private:
+    uint64_t m_hash;
+};
+
+/* The binary's size and modification time: a rebuilt compiler never reuses an older one's entries */
+static void compilerIdentity(Hasher& hasher) {
+    struct stat info {};
+    if (stat("/proc/self/exe", &info) == 0) {
+        hasher.value(static_cast<int64_t>(info.st_size));
+        hasher.value(static_cast<int64_t>(info.st_mtim.tv_sec));
+        hasher.value(static_cast<int64_t>(info.st_mtim.tv_nsec));
+    }
+}
+
+FunctionCache::FunctionCache(std::string directory, std::string_view flags)
+    : m_directory(std::move(directory)) {
+    Hasher hasher;
+    hasher.value(FORMAT_VERSION);
+    compilerIdentity(hasher);
+    hasher.text(flags);
+    m_seed = hasher.hash();
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+}
+
+void FunctionCache::layout(const IrModule& module, const Interner& interner, uint32_t globalBase) {
+    m_globalAddress.assign(interner.size(), -1);
+    for (size_t i = 0; i < module.globals.size(); i++) {
+        m_globalAddress[module.globals[i].name] = static_cast<int32_t>(globalBase + i);
+    }
+}
+
+uint64_t FunctionCache::key(const IrFunction& func, const Interner& interner) const {
+    Hasher hasher(m_seed);
+    hasher.text(interner.name(func.name));
+    hasher.value(static_cast<uint32_t>(func.parameters.size()));
+    hasher.value(static_cast<uint32_t>(func.blocks.size()));
+    for (const IrBlock& block : func.blocks) {
+        hasher.value(block.begin);
+        hasher.value(block.end);
+    }
+    for (const IrInst& inst : func.code) {
+        hasher.value(inst.op);
+        hasher.value(inst.a);
+        hasher.value(inst.b);
+        switch (inst.op) {
+        case IrOp::LOAD:
+        case IrOp::STORE:
+            hasher.text(interner.name(inst.sym));
+            hasher.value(m_globalAddress[inst.sym]);
+            break;
+        case IrOp::CALL:
+            hasher.text(interner.name(inst.sym));
+            break;
+        default:
+            hasher.value(inst.imm);
+            break;
+        }
+    }
+    hasher.bytes(func.args.data(), func.args.size() * sizeof(Value));
+    for (const IrIncoming& in : func.incoming) {
+        hasher.value(in.block);
+        hasher.value(in.value);
+    }
+    return hasher.hash();
+}
+
+std::string FunctionCache::path(uint64_t key) const {
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return m_directory + "/" + name;
+}
+
+// ====================================== Entries ======================================
+
+/*  magic, version, key
+ *  spills, frame slots, multiply, divide
+ *  stack words, call count, then per call: length, callee, where its return slot lands
+ *  label count, then per label (from 1): length, spelling, starts a function
+ *  instruction count, instructions as raw bytes */
+bool FunctionCache::load(uint64_t key, Entry& entry) {
+    std::ifstream in(path(key), std::ios::binary);
+    auto read = [&](void* data, size_t size) { return static_cast<bool>(in.read(static_cast<char*>(data), static_cast<std::streamsize>(size))); };
+    char magic[4];
+    uint32_t version = 0, labels = 0, count = 0;
+    uint64_t stored = 0;
+    uint8_t multiply = 0, divide = 0;
+    bool ok = in && read(magic, 4) && std::memcmp(magic, MAGIC, 4) == 0 &&
+              read(&version, 4) && version == FORMAT_VERSION && read(&stored, 8) && stored == key &&
+              read(&entry.spills, 4) && read(&entry.frameSlots, 4) &&
+              read(&multiply, 1) && read(&divide, 1);
+    entry.multiply = multiply != 0;
+    entry.divide = divide != 0;
+    uint32_t calls = 0;
+    ok = ok && read(&entry.stackWords, 4) && read(&calls, 4);
+    std::string name;
+    for (uint32_t i = 0; ok && i < calls; i++) {
+        uint32_t length = 0, slot = 0;
+        ok = read(&length, 4) && length < 4096;
+        if (!ok) break;
+        name.resize(length);
+        ok = read(name.data(), length) && read(&slot, 4);
+        entry.calls.push_back({name, slot});
+    }
+    ok = ok && read(&labels, 4);
+    std::vector<Symbol> to(1, NO_LABEL);
+    for (uint32_t i = 1; ok && i < labels; i++) {
+        uint32_t length = 0;
+        uint8_t function = 0;
+        ok = read(&length, 4) && length < 4096;
+        if (!ok) break;
+        name.resize(length);
+        ok = read(name.data(), length) && read(&function, 1);
+        Symbol label = entry.listing.label(name);
+        to.push_back(label);
+        if (function) {
+            if (entry.listing.functions.size() <= label) entry.listing.functions.resize(label + 1, false);
+            entry.listing.functions[label] = true;
+        }
+    }
+    ok = ok && read(&count, 4);
+    if (ok) {
+        entry.listing.code.resize(count);
+        ok = read(entry.listing.code.data(), count * sizeof(Instruction));
+        for (Instruction& i : entry.listing.code) {
+            if (i.label >= to.size()) ok = false;
+            else i.label = to[i.label];
+        }
+    }
+    if (!ok) {
+        entry = Entry();
+        m_misses++;
+        return false;
+    }
+    m_hits++;
+    return true;
+}
+
+void FunctionCache::store(uint64_t key, const Entry& entry) const {
+    std::ostringstream name;
+    name << path(key) << ".tmp" << std::this_thread::get_id();
+    std::string temporary = name.str();
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        auto write = [&](const void* data, size_t size) { out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size)); };
+        uint32_t labels = static_cast<uint32_t>(entry.listing.names.size());
+        uint32_t count = static_cast<uint32_t>(entry.listing.code.size());
+        write(MAGIC, 4);
+        write(&FORMAT_VERSION, 4);
+        write(&key, 8);
+        write(&entry.spills, 4);
+        write(&entry.frameSlots, 4);
+        uint8_t multiply = entry.multiply, divide = entry.divide;
+        write(&multiply, 1);
+        write(&divide, 1);
+        uint32_t calls = static_cast<uint32_t>(entry.calls.size());
+        write(&entry.stackWords, 4);
+        write(&calls, 4);
+        for (const auto& call : entry.calls) {
+            uint32_t length = static_cast<uint32_t>(call.first.size());
+            write(&length, 4);
+            write(call.first.data(), length);
+            write(&call.second, 4);
+        }
+        write(&labels, 4);
+        for (Symbol s = 1; s < labels; s++) {
+            std::string_view spelling = entry.listing.names.name(s);
+            uint32_t length = static_cast<uint32_t>(spelling.size());
+            uint8_t function = entry.listing.isFunction(s);
+            write(&length, 4);
+            write(spelling.data(), length);
+            write(&function, 1);
+        }
+        write(&count, 4);
+        write(entry.listing.code.data(), count * sizeof(Instruction));
+        if (!out) {
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    std::rename(temporary.c_str(), path(key).c_str());
+}
@@ -0,0 +1,193 @@
+#include "constfold.h"
+
+ConstantFolder::ConstantFolder(const Interner& interner)
+    : m_known(interner.size()), m_local(interner.size(), false) {}
+
+void ConstantFolder::run(NodeProgram& program) {
+    m_folded = 0;
+    m_propagated = 0;
+
+    /* Global initialisers run in order before main, so earlier literal globals are known to later ones */
+    for (NodeStatement& global : program.globals) {
+        foldStatement(global);
+        Span<NodeExpression>& rpn = global.rpn.reversepolish;
+        if (rpn.size == 1 && (rpn[0].kind == ExprKind::INTEGER || rpn[0].kind == ExprKind::BOOLEAN)) {
+            m_known[global.name] = rpn[0].value;
+        }
+    }
+    for (const NodeStatement& global : program.globals) {
+        forget(global.name);
+    }
+    for (NodeFunction& func : program.functions) {
+        foldFunction(func);
+    }
+}
+
+std::optional<int32_t> ConstantFolder::evaluate(TokenType op, int32_t lhs, int32_t rhs) {
+    switch (op) {
+    case TokenType::PLUS:     return wrap(lhs + rhs);
+    case TokenType::MINUS:    return wrap(lhs - rhs);
+    case TokenType::MULTIPLY: return wrap(lhs * rhs);
+    case TokenType::DIVIDE:
+        if (rhs == 0) return std::nullopt;
+        return wrap(lhs / rhs);
+    case TokenType::EQUALS:        return lhs == rhs;
+    case TokenType::NOT_EQUALS:    return lhs != rhs;
+    case TokenType::LESS:          return lhs < rhs;
+    case TokenType::GREATER:       return lhs > rhs;
+    case TokenType::LESS_EQUAL:    return lhs <= rhs;
+    case TokenType::GREATER_EQUAL: return lhs >= rhs;
+    default:
+        return std::nullopt;
+    }
+}
+
+void ConstantFolder::foldFunction(NodeFunction& func) {
+    /* Parameters shadow globals and are never known */
+    for (Symbol param : func.parameters) {
+        m_local[param] = true;
+        m_touched.push_back(param);
+    }
+
+    foldBody(func.body);
+
+    for (Symbol symbol : m_touched) forget(symbol);
+    m_touched.clear();
+}
+
+/* Declarations last until the end of their body, shadowed names get their old state back */
+void ConstantFolder::foldBody(NodeBody& body) {
+    size_t base = m_shadowed.size();
+    for (NodeStatement& stmt : body.statements) {
+        switch (stmt.kind) {
+        case StmtKind::RETURN:
+            foldStatement(stmt);
+            break;
+        case StmtKind::IF:
+            foldIf(stmt);
+            break;
+        case StmtKind::WHILE:
+            foldWhile(stmt);
+            break;
+        case StmtKind::BREAK:
+        case StmtKind::CONTINUE:
+            break;
+        case StmtKind::ASSIGNMENT:
+        case StmtKind::VAR_DECL: {
+            foldStatement(stmt);
+            if (stmt.kind == StmtKind::VAR_DECL) {
+                m_shadowed.push_back({stmt.name, m_known[stmt.name], m_local[stmt.name]});
+                m_local[stmt.name] = true;
+                m_touched.push_back(stmt.name);
+            }
+            /* Only locals propagate, a call could change a global behind our back */
+            Span<NodeExpression>& rpn = stmt.rpn.reversepolish;
+            bool literal = rpn.size == 1 && (rpn[0].kind == ExprKind::INTEGER || rpn[0].kind == ExprKind::BOOLEAN);
+            if (m_local[stmt.name] && literal) {
+                m_known[stmt.name] = rpn[0].value;
+            } else {
+                m_known[stmt.name].reset();
+            }
+            break;
+        }
+        }
+    }
+    while (m_shadowed.size() > base) {
+        const Shadowed& old = m_shadowed.back();
+        m_known[old.name] = old.known;
+        m_local[old.name] = old.local;
+        m_shadowed.pop_back();
+    }
+}
+
+/* Each branch starts from what was known before the if, afterwards anything either assigned is unknown */
+void ConstantFolder::foldIf(NodeStatement& stmt) {
+    foldStatement(stmt);
+    size_t base = m_assigned.size();
+    stmt.body.assigned(m_assigned);
+    stmt.otherwise.assigned(m_assigned);
+    std::vector<std::optional<int32_t>> before;
+    for (size_t i = base; i < m_assigned.size(); i++) before.push_back(m_known[m_assigned[i]]);
+
+    foldBody(stmt.body);
+    for (size_t i = base; i < m_assigned.size(); i++) m_known[m_assigned[i]] = before[i - base];
+    foldBody(stmt.otherwise);
+    for (size_t i = base; i < m_assigned.size(); i++) m_known[m_assigned[i]].reset();
+    m_assigned.resize(base);
+}
+
+/* The condition and body also run after the body's own assignments, so those are unknown throughout */
+void ConstantFolder::foldWhile(NodeStatement& stmt) {
+    size_t base = m_assigned.size();
+    stmt.body.assigned(m_assigned);
+    for (size_t i = base; i < m_assigned.size(); i++) m_known[m_assigned[i]].reset();
+
+    foldStatement(stmt);
+    foldBody(stmt.body);
+    for (size_t i = base; i < m_assigned.size(); i++) m_known[m_assigned[i]].reset();
+    m_assigned.resize(base);
+}
+
+void ConstantFolder::foldStatement(NodeStatement& stmt) {
+    Span<NodeExpression>& rpn = stmt.rpn.reversepolish;
+    uint32_t out = 0;
+    m_constant.clear();
+
+    for (uint32_t in = 0; in < rpn.size; in++) {
+        NodeExpression expr = rpn[in];
+        switch (expr.kind) {
+        case ExprKind::INTEGER:
+        case ExprKind::BOOLEAN:
+            rpn[out++] = expr;
+            m_constant.push_back(true);
+            break;
+
+        case ExprKind::IDENTIFIER:
+            if (m_known[expr.name]) {
+                NodeExpression literal{ExprKind::INTEGER};
+                literal.value = *m_known[expr.name];
+                rpn[out++] = literal;
+                m_constant.push_back(true);
+                m_propagated++;
+            } else {
+                rpn[out++] = expr;
+                m_constant.push_back(false);
+            }
+            break;
+
+        case ExprKind::OPERATOR: {
+            bool rhsConstant = m_constant.back(); m_constant.pop_back();
+            bool lhsConstant = m_constant.back(); m_constant.pop_back();
+            /* Constant operands are single literals, so they are the last two outputs */
+            std::optional<int32_t> result;
+            if (lhsConstant && rhsConstant) {
+                result = evaluate(expr.op, rpn[out - 2].value, rpn[out - 1].value);
+            }
+            if (result) {
+                NodeExpression literal{ExprKind::INTEGER};
+                literal.value = *result;
+                out -= 2;
+                rpn[out++] = literal;
+                m_constant.push_back(true);
+                m_folded++;
+            } else {
+                rpn[out++] = expr;
+                m_constant.push_back(false);
+            }
+            break;
+        }
+
+        case ExprKind::CALL:
+            m_constant.resize(m_constant.size() - expr.argc);
+            rpn[out++] = expr;
+            m_constant.push_back(false);
+            break;
+        }
+    }
+    rpn.size = out;
+}
+
+void ConstantFolder::forget(Symbol symbol) {
+    m_known[symbol].reset();
+    m_local[symbol] = false;
+}
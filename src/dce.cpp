@@ -0,0 +1,204 @@
+#include "dce.h"
+#include <algorithm>
+
+DeadCodeEliminator::DeadCodeEliminator(const Interner& interner)
+    : m_interner(interner) {}
+
+void DeadCodeEliminator::run(IrModule& module) {
+    m_functions = 0;
+    m_blocks = 0;
+    m_values = 0;
+    m_globals = 0;
+
+    removeUnreachableFunctions(module);
+    for (IrFunction& func : module.functions) {
+        removeUnreachableBlocks(func);
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (IrFunction& func : module.functions) {
+            changed |= removeDeadValues(func);
+        }
+        changed |= removeUnreadGlobals(module);
+    }
+}
+
+/* Call graph walk from main, a program without main is left alone */
+void DeadCodeEliminator::removeUnreachableFunctions(IrModule& module) {
+    std::vector<int32_t> index(m_interner.size(), -1);
+    for (size_t i = 0; i < module.functions.size(); i++) {
+        index[module.functions[i].name] = static_cast<int32_t>(i);
+    }
+    std::vector<size_t> work;
+    std::vector<bool> reached(module.functions.size(), false);
+    for (size_t i = 0; i < module.functions.size(); i++) {
+        if (m_interner.name(module.functions[i].name) == "main") {
+            reached[i] = true;
+            work.push_back(i);
+        }
+    }
+    if (work.empty()) return;
+
+    while (!work.empty()) {
+        const IrFunction& func = module.functions[work.back()];
+        work.pop_back();
+        for (const IrInst& inst : func.code) {
+            if (inst.op != IrOp::CALL || index[inst.sym] < 0) continue;
+            size_t callee = static_cast<size_t>(index[inst.sym]);
+            if (!reached[callee]) {
+                reached[callee] = true;
+                work.push_back(callee);
+            }
+        }
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < module.functions.size(); i++) {
+        if (reached[i]) {
+            if (out != i) module.functions[out] = std::move(module.functions[i]);
+            out++;
+        }
+    }
+    m_functions += static_cast<uint32_t>(module.functions.size() - out);
+    module.functions.erase(module.functions.begin() + static_cast<std::ptrdiff_t>(out), module.functions.end());
+}
+
+/* Branch condition when it is known: a constant, or a comparison of two
+ * (the guard a rotated loop repeats ahead of its first iteration often is) */
+static bool known(const IrFunction& func, Value v, bool& holds) {
+    const IrInst& inst = func.code[v];
+    if (inst.op == IrOp::CONST) {
+        holds = inst.imm != 0;
+        return true;
+    }
+    if (!inst.isComparison() || func.code[inst.a].op != IrOp::CONST || func.code[inst.b].op != IrOp::CONST) return false;
+    int32_t a = func.code[inst.a].imm;
+    int32_t b = func.code[inst.b].imm;
+    switch (inst.op) {
+    case IrOp::EQ: holds = a == b; break;
+    case IrOp::NE: holds = a != b; break;
+    case IrOp::LT: holds = a < b; break;
+    case IrOp::LE: holds = a <= b; break;
+    case IrOp::GT: holds = a > b; break;
+    default:       holds = a >= b; break;
+    }
+    return true;
+}
+
+/* Branches on a known condition become jumps first, then blocks are walked from the entry
+ * Phi inputs along edges a fold removed, or from blocks that go, are dropped with them */
+void DeadCodeEliminator::removeUnreachableBlocks(IrFunction& func) {
+    if (func.blocks.size() <= 1) return;
+    bool folded = false;
+    for (const IrBlock& block : func.blocks) {
+        IrInst& last = func.code[block.end - 1];
+        bool holds = false;
+        if (last.op != IrOp::BR || !known(func, last.a, holds)) continue;
+        if (!holds) last.target = last.b;
+        last.op = IrOp::JMP;
+        last.a = NO_VALUE;
+        last.b = NO_VALUE;
+        folded = true;
+    }
+    if (folded) removeFoldedEdges(func);
+
+    std::vector<bool> reached(func.blocks.size(), false);
+    std::vector<uint32_t> work{0};
+    reached[0] = true;
+    while (!work.empty()) {
+        uint32_t block = work.back();
+        work.pop_back();
+        func.forEachSuccessor(block, [&](uint32_t next) {
+            if (!reached[next]) {
+                reached[next] = true;
+                work.push_back(next);
+            }
+        });
+    }
+
+    uint32_t removed = static_cast<uint32_t>(std::count(reached.begin(), reached.end(), false));
+    if (removed == 0) return;
+    std::vector<bool> keep(func.code.size(), false);
+    for (size_t b = 0; b < func.blocks.size(); b++) {
+        for (Value v = func.blocks[b].begin; v < func.blocks[b].end; v++) keep[v] = reached[b];
+    }
+    m_blocks += removed;
+    func.compact(keep);
+}
+
+void DeadCodeEliminator::removeFoldedEdges(IrFunction& func) {
+    std::vector<std::vector<uint32_t>> predecessors(func.blocks.size());
+    for (uint32_t b = 0; b < func.blocks.size(); b++) {
+        func.forEachSuccessor(b, [&](uint32_t next) { predecessors[next].push_back(b); });
+    }
+    for (uint32_t b = 0; b < func.blocks.size(); b++) {
+        const std::vector<uint32_t>& from = predecessors[b];
+        for (Value v = func.blocks[b].begin; v < func.blocks[b].end && func.code[v].op == IrOp::PHI; v++) {
+            IrInst& phi = func.code[v];
+            auto first = func.incoming.begin() + phi.a;
+            auto last = std::remove_if(first, first + phi.b, [&](const IrIncoming& in) {
+                return std::find(from.begin(), from.end(), in.block) == from.end();
+            });
+            phi.b = static_cast<uint32_t>(last - first);
+        }
+    }
+}
+
+/* Marking from the instructions with effects, so values only feeding each other around a loop go too */
+bool DeadCodeEliminator::removeDeadValues(IrFunction& func) {
+    std::vector<bool> keep(func.code.size(), false);
+    std::vector<Value> work;
+    for (Value v = 0; v < func.code.size(); v++) {
+        const IrInst& inst = func.code[v];
+        if (inst.op == IrOp::STORE || inst.op == IrOp::CALL || inst.isTerminator()) {
+            keep[v] = true;
+            work.push_back(v);
+        }
+    }
+    while (!work.empty()) {
+        Value v = work.back();
+        work.pop_back();
+        func.forEachOperand(func.code[v], [&](Value used) {
+            if (!keep[used]) {
+                keep[used] = true;
+                work.push_back(used);
+            }
+        });
+    }
+
+    uint32_t removed = static_cast<uint32_t>(std::count(keep.begin(), keep.end(), false));
+    if (removed == 0) return false;
+    m_values += removed;
+    func.compact(keep);
+    return true;
+}
+
+/* A global only stored to is as good as unused, its stores go and its slot with them */
+bool DeadCodeEliminator::removeUnreadGlobals(IrModule& module) {
+    m_read.assign(m_interner.size(), false);
+    for (const IrFunction& func : module.functions) {
+        for (const IrInst& inst : func.code) {
+            if (inst.op == IrOp::LOAD) m_read[inst.sym] = true;
+        }
+    }
+
+    size_t before = module.globals.size();
+    module.globals.erase(std::remove_if(module.globals.begin(), module.globals.end(),
+                                        [&](const IrGlobal& global) { return !m_read[global.name]; }),
+                         module.globals.end());
+    if (module.globals.size() == before) return false;
+    m_globals += static_cast<uint32_t>(before - module.globals.size());
+
+    for (IrFunction& func : module.functions) {
+        std::vector<bool> keep(func.code.size(), true);
+        bool any = false;
+        for (Value v = 0; v < func.code.size(); v++) {
+            if (func.code[v].op == IrOp::STORE && !m_read[func.code[v].sym]) {
+                keep[v] = false;
+                any = true;
+            }
+        }
+        if (any) func.compact(keep);
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+#include "diagnostics.h"
+#include <algorithm>
+
+Diagnostics::Diagnostics(std::vector<std::string> files, uint32_t limit)
+    : m_files(std::move(files)), m_limit(limit) {}
+
+void Diagnostics::error(uint32_t file, uint32_t line, uint32_t column, std::string message) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_limit != 0 && m_errors.size() >= m_limit) {
+        m_dropped++;
+        return;
+    }
+    m_errors.push_back({file, line, column, std::move(message)});
+}
+
+uint32_t Diagnostics::count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<uint32_t>(m_errors.size()) + m_dropped;
+}
+
+bool Diagnostics::full() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limit != 0 && m_errors.size() >= m_limit;
+}
+
+/*  a.stump:3:14: error: expected ';' but found '}'
+ *  b.stump:7:1: error: expected a statement but found 'else'
+ *  2 errors */
+void Diagnostics::print(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    /* Files lex on different threads, sorting makes the order the same every run */
+    std::vector<Diagnostic> errors = m_errors;
+    std::stable_sort(errors.begin(), errors.end(), [](const Diagnostic& a, const Diagnostic& b) {
+        if (a.file != b.file) return a.file < b.file;
+        if (a.line != b.line) return a.line < b.line;
+        return a.column < b.column;
+    });
+    for (const Diagnostic& error : errors) {
+        out << m_files[error.file] << ":" << error.line << ":" << error.column << ": error: " << error.message << "\n";
+    }
+    /* At the limit the parsers gave up, there may be more than were counted */
+    if (m_limit != 0 && errors.size() >= m_limit) {
+        out << "stopped after " << m_limit << " errors, raise --max-errors to see more\n";
+    } else {
+        out << errors.size() << (errors.size() == 1 ? " error" : " errors") << "\n";
+    }
+}
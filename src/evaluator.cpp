@@ -0,0 +1,145 @@
+#include "evaluator.h"
+#include "constfold.h"
+
+static int32_t wrap(int32_t value) {
+    return ConstantFolder::wrap(value);
+}
+
+CallEvaluator::CallEvaluator(const Interner& interner, uint32_t budget)
+    : m_interner(interner), m_budget(budget) {}
+
+void CallEvaluator::run(IrModule& module) {
+    m_evaluated = 0;
+    if (m_budget == 0) return;
+    m_module = &module;
+    m_index.assign(m_interner.size(), -1);
+    for (size_t i = 0; i < module.functions.size(); i++) {
+        m_index[module.functions[i].name] = static_cast<int32_t>(i);
+    }
+
+    /* Globals keep their initial value unless some function, main's initialisers included, stores to them */
+    m_constant.assign(m_interner.size(), std::nullopt);
+    for (const IrGlobal& global : module.globals) m_constant[global.name] = wrap(global.initial);
+    for (const IrFunction& func : module.functions) {
+        for (const IrInst& inst : func.code) {
+            if (inst.op == IrOp::STORE) m_constant[inst.sym].reset();
+        }
+    }
+
+    /* Call results become constants in place, so a call feeding another's arguments is ready by then */
+    m_results.clear();
+    for (IrFunction& func : module.functions) {
+        for (IrInst& inst : func.code) {
+            if (inst.op != IrOp::CALL || m_index[inst.sym] < 0) continue;
+            std::vector<int32_t> args;
+            for (uint32_t i = 0; i < inst.b; i++) {
+                const IrInst& arg = func.code[func.args[inst.a + i]];
+                if (arg.op != IrOp::CONST) break;
+                args.push_back(wrap(arg.imm));
+            }
+            if (args.size() != inst.b) continue;
+
+            m_steps = 0;
+            std::optional<int32_t> result = call(static_cast<size_t>(m_index[inst.sym]), std::move(args), 0);
+            if (!result) continue;
+            inst = IrInst(IrOp::CONST);
+            inst.imm = *result;
+            m_evaluated++;
+        }
+    }
+    m_module = nullptr;
+}
+
+std::optional<int32_t> CallEvaluator::call(size_t function, std::vector<int32_t> args, uint32_t depth) {
+    const IrFunction& func = m_module->functions[function];
+    if (!func.pure || depth >= MAX_DEPTH || m_interner.name(func.name) == "main") return std::nullopt;
+
+    std::vector<int32_t> key(1, static_cast<int32_t>(function));
+    key.insert(key.end(), args.begin(), args.end());
+    auto known = m_results.find(key);
+    if (known != m_results.end()) return known->second;
+
+    /* Running out of steps deeper down says nothing about the same call with a fresh budget */
+    std::optional<int32_t> result = execute(func, args, depth);
+    if (result || depth == 0) m_results.emplace(std::move(key), result);
+    return result;
+}
+
+/* One block at a time from the entry, phis taking the input from the block control came from */
+std::optional<int32_t> CallEvaluator::execute(const IrFunction& func, const std::vector<int32_t>& args, uint32_t depth) {
+    std::vector<int32_t> values(func.code.size(), 0);
+    std::vector<int32_t> arrivals;
+    uint32_t block = 0, from = UINT32_MAX;
+    for (;;) {
+        const IrBlock& current = func.blocks[block];
+
+        /* Phis read their inputs all at once, one may be another's input around a loop */
+        Value v = current.begin;
+        arrivals.clear();
+        for (; v < current.end && func.code[v].op == IrOp::PHI; v++) {
+            const IrInst& phi = func.code[v];
+            bool found = false;
+            for (uint32_t i = 0; i < phi.b && !found; i++) {
+                const IrIncoming& in = func.incoming[phi.a + i];
+                if (in.block != from) continue;
+                arrivals.push_back(values[in.value]);
+                found = true;
+            }
+            if (!found) return std::nullopt;
+        }
+        for (uint32_t i = 0; i < arrivals.size(); i++) values[current.begin + i] = arrivals[i];
+
+        for (; v < current.end; v++) {
+            if (++m_steps > m_budget) return std::nullopt;
+            const IrInst& inst = func.code[v];
+            int32_t lhs = inst.a < values.size() ? values[inst.a] : 0;
+            int32_t rhs = inst.b < values.size() ? values[inst.b] : 0;
+            switch (inst.op) {
+            case IrOp::CONST: values[v] = wrap(inst.imm); break;
+            case IrOp::PARAM:
+                if (static_cast<size_t>(inst.imm) >= args.size()) return std::nullopt;
+                values[v] = args[static_cast<size_t>(inst.imm)];
+                break;
+            case IrOp::LOAD:
+                if (!m_constant[inst.sym]) return std::nullopt;
+                values[v] = *m_constant[inst.sym];
+                break;
+            case IrOp::STORE: return std::nullopt;
+            case IrOp::ADD: values[v] = wrap(lhs + rhs); break;
+            case IrOp::SUB: values[v] = wrap(lhs - rhs); break;
+            case IrOp::MUL: values[v] = wrap(lhs * rhs); break;
+            case IrOp::DIV:
+                if (rhs == 0) return std::nullopt;
+                values[v] = wrap(lhs / rhs);
+                break;
+            case IrOp::EQ: values[v] = lhs == rhs; break;
+            case IrOp::NE: values[v] = lhs != rhs; break;
+            case IrOp::LT: values[v] = lhs < rhs; break;
+            case IrOp::LE: values[v] = lhs <= rhs; break;
+            case IrOp::GT: values[v] = lhs > rhs; break;
+            case IrOp::GE: values[v] = lhs >= rhs; break;
+            case IrOp::CALL: {
+                if (m_index[inst.sym] < 0) return std::nullopt;
+                std::vector<int32_t> inner;
+                for (uint32_t i = 0; i < inst.b; i++) inner.push_back(values[func.args[inst.a + i]]);
+                std::optional<int32_t> result = call(static_cast<size_t>(m_index[inst.sym]), std::move(inner), depth + 1);
+                if (!result) return std::nullopt;
+                values[v] = *result;
+                break;
+            }
+            case IrOp::PHI: return std::nullopt;
+            case IrOp::RET:
+                if (inst.a == NO_VALUE) return std::nullopt;
+                return lhs;
+            case IrOp::JMP:
+                from = block;
+                block = inst.target;
+                break;
+            case IrOp::BR:
+                from = block;
+                block = lhs != 0 ? inst.target : inst.b;
+                break;
+            }
+        }
+    }
+}
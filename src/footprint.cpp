@@ -0,0 +1,158 @@
+#include "footprint.h"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include "assembler.h"
+
+static std::string address(uint32_t a) {
+    char text[8];
+    std::snprintf(text, sizeof(text), "0x%04X", a);
+    return text;
+}
+
+Footprint::Footprint(const Interner& interner, uint32_t limit)
+    : m_interner(interner), m_limit(limit) {}
+
+void Footprint::run(Listing& listing, const std::vector<Generator::StackFrame>& frames) {
+    //---> Code and data, and where the program ends
+    uint32_t pc = 0, end = 0;
+    m_codeWords = m_dataWords = 0;
+    Instruction* stack = nullptr;
+    bool stackLabel = false;
+    for (Instruction& i : listing.code) {
+        if (i.op == Opcode::ORG) pc = static_cast<uint32_t>(i.imm);
+        if (i.op == Opcode::LABEL) stackLabel = listing.stack != NO_LABEL && i.label == listing.stack;
+        if (!i.emitsWord()) continue;
+        if (stackLabel && i.op == Opcode::DATA) stack = &i;
+        stackLabel = false;
+        if (i.op == Opcode::DATA || i.op == Opcode::DEFW) m_dataWords++;
+        else m_codeWords++;
+        end = std::max(end, ++pc);
+    }
+    if (end > PERIPHERAL_BASE) {
+        throw std::runtime_error("program is " + std::to_string(end) + " words, it runs into the peripherals at " +
+                                 address(PERIPHERAL_BASE));
+    }
+    m_stackBase = std::max<uint32_t>(STACK_BASE, end);
+    if (stack) stack->imm = static_cast<int32_t>(m_stackBase);
+    uint32_t room = PERIPHERAL_BASE - m_stackBase;
+    if (m_limit > room) {
+        throw std::runtime_error("a stack of " + std::to_string(m_limit) + " words doesn't fit between " +
+                                 address(m_stackBase) + " and the peripherals at " + address(PERIPHERAL_BASE));
+    }
+    m_stackLimit = m_limit != 0 ? m_limit : room;
+
+    //---> Worst case stack per function, callees before callers
+    m_frames = &frames;
+    m_frameOf.assign(m_interner.size(), -1);
+    m_functions.clear();
+    for (uint32_t f = 0; f < frames.size(); f++) {
+        m_frameOf[frames[f].function] = static_cast<int32_t>(f);
+        m_functions.push_back({frames[f].function, frames[f].words, std::nullopt, false});
+    }
+    m_deepest.assign(frames.size(), -1);
+    m_index.assign(frames.size(), UINT32_MAX);
+    m_lowLink.assign(frames.size(), 0);
+    m_onStack.assign(frames.size(), false);
+    m_stack.clear();
+    m_next = 0;
+    for (uint32_t f = 0; f < frames.size(); f++) {
+        if (m_index[f] == UINT32_MAX) connect(f);
+    }
+
+    //---> The whole program from main, whose return slot sits one below the stack
+    m_stackWords.reset();
+    m_recursion.clear();
+    for (uint32_t f = 0; f < frames.size(); f++) {
+        if (m_interner.name(frames[f].function) != "main") continue;
+        if (!m_functions[f].stack) {
+            m_recursion = toRecursion(f);
+            break;
+        }
+        m_stackWords = *m_functions[f].stack - 1;
+        if (*m_stackWords > m_stackLimit) {
+            std::string room = m_limit != 0 ? "more than the " + std::to_string(m_limit) + " it may take"
+                                            : "only " + std::to_string(m_stackLimit) + " are free from " + address(m_stackBase);
+            throw std::runtime_error("stack needs up to " + std::to_string(*m_stackWords) + " words (" + chain(f) + "), " + room);
+        }
+    }
+}
+
+/* Each component completes after every component it calls into, so a function's callees are
+ * settled by the time its own worst case is worked out */
+void Footprint::connect(uint32_t f) {
+    const std::vector<Generator::StackFrame>& frames = *m_frames;
+    m_index[f] = m_lowLink[f] = m_next++;
+    m_stack.push_back(f);
+    m_onStack[f] = true;
+    for (const auto& call : frames[f].calls) {
+        int32_t callee = m_frameOf[call.first];
+        if (callee < 0) continue;
+        uint32_t c = static_cast<uint32_t>(callee);
+        if (m_index[c] == UINT32_MAX) {
+            connect(c);
+            m_lowLink[f] = std::min(m_lowLink[f], m_lowLink[c]);
+        } else if (m_onStack[c]) {
+            m_lowLink[f] = std::min(m_lowLink[f], m_index[c]);
+        }
+    }
+    if (m_lowLink[f] != m_index[f]) return;
+
+    std::vector<uint32_t> component;
+    uint32_t member;
+    do {
+        member = m_stack.back();
+        m_stack.pop_back();
+        m_onStack[member] = false;
+        component.push_back(member);
+    } while (member != f);
+    bool recursive = component.size() > 1 ||
+                     std::any_of(frames[f].calls.begin(), frames[f].calls.end(),
+                                 [&](const std::pair<Symbol, uint32_t>& call) { return call.first == frames[f].function; });
+    for (uint32_t m : component) {
+        Function& function = m_functions[m];
+        function.recursive = recursive;
+        if (recursive) continue;
+        function.stack = function.words;
+        for (const auto& call : frames[m].calls) {
+            int32_t callee = m_frameOf[call.first];
+            if (callee < 0) continue;
+            const std::optional<uint32_t>& deeper = m_functions[static_cast<size_t>(callee)].stack;
+            if (!deeper) {
+                function.stack.reset();
+                break;
+            }
+            if (call.second + *deeper > *function.stack) {
+                function.stack = call.second + *deeper;
+                m_deepest[m] = callee;
+            }
+        }
+    }
+}
+
+/* main -> draw -> plot */
+std::string Footprint::chain(uint32_t f) const {
+    std::string text(m_interner.name(m_functions[f].name));
+    for (int32_t next = m_deepest[f]; next >= 0; next = m_deepest[static_cast<size_t>(next)]) {
+        text += " -> ";
+        text += m_interner.name(m_functions[static_cast<size_t>(next)].name);
+    }
+    return text;
+}
+
+/* An unbounded function calls an unbounded one, until one of them is itself recursive */
+std::string Footprint::toRecursion(uint32_t f) const {
+    std::string text(m_interner.name(m_functions[f].name));
+    while (!m_functions[f].recursive) {
+        for (const auto& call : (*m_frames)[f].calls) {
+            int32_t callee = m_frameOf[call.first];
+            if (callee >= 0 && !m_functions[static_cast<size_t>(callee)].stack) {
+                f = static_cast<uint32_t>(callee);
+                break;
+            }
+        }
+        text += " -> ";
+        text += m_interner.name(m_functions[f].name);
+    }
+    return text;
+}
@@ -1,84 +1,1205 @@
 #include "generator.h"
+#include <algorithm>
+#include "assembler.h"
 
-Generator::Generator() = default;
+/* Register layout (samples/mentalmaths.s)
+ *  R0 = 0, R1 = return value/scratch, R2-R5 = allocatable, R6 = SP, R7 = PC */
+static constexpr uint8_t R1 = 1;
+static constexpr uint8_t R2 = 2;
+static constexpr uint8_t R5 = 5;
+static constexpr uint8_t SP = 6;
+static constexpr uint8_t PC = 7;
 
-std::string Generator::generate(const NodeProgram& program) {
-    m_output << "ORG 0\n";
-    m_output << "B main\n";
-    m_output << "SP     EQU     R6\n";
-    m_output << "stack  DATA    0x1200\n\n";
-    
-    for (const auto& func : program.functions) {
-        generateFunction(*func);
+/* Globals sit straight after the jump to main and `stack DATA`, main comes right after them
+ * so `B _main` reaches unless there are more globals than its 8-bit offset covers */
+static constexpr uint32_t NEAR_GLOBALS = 126;
+
+/* Calling convention: the first arguments arrive in R2-R5, the rest on the stack */
+static constexpr uint32_t ARG_REGISTERS = 4;
+
+/* PC reads as address + 1, so `LD Rd, label` reaches 16 words forward and 15 back */
+static constexpr uint32_t LITERAL_REACH_FORWARD = 16;
+static constexpr uint32_t LITERAL_REACH_BACK = 15;
+
+static bool fitsImmediate(int value) {
+    return value >= -16 && value <= 15;
+}
+
+static bool isPowerOfTwo(int32_t value) {
+    uint32_t magnitude = static_cast<uint32_t>(value < 0 ? -value : value);
+    return magnitude != 0 && (magnitude & (magnitude - 1)) == 0;
+}
+
+/* Runtime routine labels, reserved names the lexer can't produce as identifiers */
+static constexpr const char* RUNTIME_MULTIPLY = "__mul";
+static constexpr const char* RUNTIME_DIVIDE = "__div";
+
+/* A global's or function's label, see the class comment */
+static std::string mangle(std::string_view name) {
+    return "_" + std::string(name);
+}
+
+Generator::Generator(const Interner& interner)
+    : m_interner(interner) {}
+
+Listing Generator::generate(const IrModule& module) {
+    m_listing = Listing();
+    m_spills.clear();
+    m_frames.clear();
+    m_usesMultiply = false;
+    m_usesDivide = false;
+    emitHeader(module);
+    emitFunctions(module, 0, module.functions.size());
+    emitRuntime();
+    return std::move(m_listing);
+}
+
+Listing Generator::generateHeader(const IrModule& module) {
+    m_listing = Listing();
+    emitHeader(module);
+    return std::move(m_listing);
+}
+
+Listing Generator::generateFunctions(const IrModule& module, size_t begin, size_t end) {
+    m_listing = Listing();
+    m_spills.clear();
+    m_frames.clear();
+    m_usesMultiply = false;
+    m_usesDivide = false;
+    layoutGlobals(module);
+    emitFunctions(module, begin, end);
+    return std::move(m_listing);
+}
+
+Listing Generator::generateRuntime(bool multiply, bool divide) {
+    m_listing = Listing();
+    m_usesMultiply = multiply;
+    m_usesDivide = divide;
+    emitRuntime();
+    return std::move(m_listing);
+}
+
+uint32_t Generator::globalBase(const IrModule& module) {
+    return module.globals.size() <= NEAR_GLOBALS ? 2 : 3;
+}
+
+/* Where each global lives decides how functions address it, so every piece agrees on it */
+void Generator::layoutGlobals(const IrModule& module) {
+    m_globalIndex.assign(m_interner.size(), -1);
+    for (uint32_t i = 0; i < module.globals.size(); i++) {
+        m_globalIndex[module.globals[i].name] = static_cast<int32_t>(i);
+    }
+    m_globalBase = static_cast<int>(globalBase(module));
+}
+
+void Generator::emitHeader(const IrModule& module) {
+    layoutGlobals(module);
+    m_listing.code.push_back(Instruction::word(Opcode::ORG, 0));
+    if (m_globalBase == 2) {
+        m_listing.code.push_back(Instruction::branch(Cond::AL, m_listing.label(mangle("main"))));
+    } else {
+        m_listing.code.push_back(Instruction::memory(Opcode::LD, PC, PC, 0));
+        m_listing.code.push_back(Instruction::word(Opcode::DEFW, 0, m_listing.label(mangle("main"))));
+    }
+    Instruction equ = Instruction::define(m_listing.label("SP"));
+    equ.op = Opcode::EQU;
+    equ.rd = SP;
+    m_listing.code.push_back(equ);
+    m_listing.stack = m_listing.label("stack");
+    m_listing.code.push_back(Instruction::define(m_listing.stack));
+    m_listing.code.push_back(Instruction::word(Opcode::DATA, STACK_BASE));
+    for (const IrGlobal& global : module.globals) {
+        m_listing.code.push_back(Instruction::define(symbol(global.name)));
+        m_listing.code.push_back(Instruction::word(Opcode::DEFW, global.initial));
+    }
+}
+
+/* main first within the range, so in a whole program it sits right after the globals */
+void Generator::emitFunctions(const IrModule& module, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        if (m_interner.name(module.functions[i].name) == "main") generateFunction(module.functions[i]);
+    }
+    for (size_t i = begin; i < end; i++) {
+        if (m_interner.name(module.functions[i].name) != "main") generateFunction(module.functions[i]);
+    }
+}
+
+void Generator::generateFunction(const IrFunction& func) {
+    m_function = &func;
+    bool isMain = m_interner.name(func.name) == "main";
+
+    /* Allocating R2-R5, if anything spills R5 becomes a second scratch register instead */
+    analyseFunction(func);
+    allocate({2, 3, 4, 5});
+    /* Storing R1 to a global past #15 needs an address register besides R1 too */
+    m_scratchB = 0;
+    if (m_alloc.spills > 0 || m_needsScratchB) {
+        allocate({2, 3, 4});
+        m_scratchB = R5;
+    }
+    m_frameSlots = m_alloc.slots;
+    m_spills.push_back({func.name, m_alloc.spills, m_frameSlots});
+    /* main starts one past its (absent) return slot, a leaf without spills needs no frame at all */
+    m_frameWords = isMain || !m_leaf || m_frameSlots > 0 ? static_cast<int>(m_frameSlots) + 1 : 0;
+    m_frames.push_back({func.name, std::max(1u, static_cast<uint32_t>(m_frameWords)), {}});
+
+    m_words = 0;
+    m_poolLocked = false;
+    m_localLabels = 0;
+    m_pool.clear();
+    m_placed.clear();
+    labelBlocks(func);
+
+    Symbol entry = symbol(func.name);
+    if (m_listing.functions.size() <= entry) m_listing.functions.resize(entry + 1, false);
+    m_listing.functions[entry] = true;
+    m_listing.code.push_back(Instruction::define(entry));
+    m_pushDepth = 0;
+    if (isMain) {
+        emit(Instruction::memory(Opcode::LD, SP, 0, 0, m_listing.label("stack")));
+        adjustSP(m_frameWords - 1);
+    } else {
+        adjustSP(m_frameWords);
+    }
+    receiveParameters();
+
+    /* Blocks are laid out in order, so a jump to the next one is just falling into it */
+    for (m_block = 0; m_block < func.blocks.size(); m_block++) {
+        if (m_blockLabel[m_block] != NO_LABEL) m_listing.code.push_back(Instruction::define(m_blockLabel[m_block]));
+        for (Value v = func.blocks[m_block].begin; v < func.blocks[m_block].end; v++) {
+            m_point = v;
+            generateInstruction(v);
+        }
+    }
+
+    emitStubs();
+    if (isMain) {
+        Symbol halt = m_listing.label("halt");
+        m_listing.code.push_back(Instruction::define(halt));
+        emit(Instruction::branch(Cond::AL, halt));
+    }
+    /* Whatever is still pending goes after the return path, no branch needed */
+    flushPool(false);
+}
+
+// ================================= Register Allocation =================================
+
+/* Every non-constant value lives from its instruction to its last use, stretched over every
+ * block it is live through. A phi's input is used at the end of the block it comes from */
+void Generator::analyseFunction(const IrFunction& func) {
+    size_t count = func.code.size();
+    m_intervals.clear();
+    m_paramIndex.assign(count, -1);
+    m_fused.assign(count, false);
+    m_needsScratchB = false;
+    m_leaf = true;
+
+    m_blockOf.resize(count);
+    for (uint32_t b = 0; b < func.blocks.size(); b++) {
+        for (Value v = func.blocks[b].begin; v < func.blocks[b].end; v++) m_blockOf[v] = b;
+    }
+
+    std::vector<bool> needsHome(count, false);
+    std::vector<uint32_t> start(count), end(count), uses(count, 0);
+    for (Value v = 0; v < count; v++) {
+        const IrInst& inst = func.code[v];
+        start[v] = end[v] = v;
+        if (inst.op == IrOp::PHI) {
+            /* Phis all take their values at once on entry to the block */
+            const IrBlock& block = func.blocks[m_blockOf[v]];
+            start[v] = block.begin;
+            for (Value last = v; last < block.end && func.code[last].op == IrOp::PHI; last++) end[v] = last;
+            for (uint32_t i = 0; i < inst.b; i++) {
+                const IrIncoming& in = func.incoming[inst.a + i];
+                end[in.value] = std::max(end[in.value], func.blocks[in.block].end - 1);
+                uses[in.value]++;
+            }
+        } else {
+            func.forEachOperand(inst, [&](Value used) {
+                end[used] = std::max(end[used], v);
+                uses[used]++;
+            });
+        }
+        if (inst.op == IrOp::STORE && isFarGlobal(inst.sym)) m_needsScratchB = true;
+        if (inst.op == IrOp::CALL || callsRuntime(inst)) m_leaf = false;
+        if (inst.definesValue() && inst.op != IrOp::CONST) needsHome[v] = true;
+        if (inst.op == IrOp::PARAM) m_paramIndex[v] = static_cast<int16_t>(inst.imm);
+    }
+
+    /* A comparison only its block's branch reads, with nothing but constants in between, is
+     * emitted by the branch as CMP + Bcc and never needs a register of its own */
+    for (const IrBlock& block : func.blocks) {
+        const IrInst& last = func.code[block.end - 1];
+        if (last.op != IrOp::BR) continue;
+        Value c = last.a;
+        if (!func.code[c].isComparison() || uses[c] != 1 || m_blockOf[c] != m_blockOf[block.end - 1]) continue;
+        bool adjacent = true;
+        for (Value v = c + 1; v < block.end - 1; v++) adjacent &= func.code[v].op == IrOp::CONST;
+        if (!adjacent) continue;
+        m_fused[c] = true;
+        needsHome[c] = false;
+        end[func.code[c].a] = std::max(end[func.code[c].a], block.end - 1);
+        end[func.code[c].b] = std::max(end[func.code[c].b], block.end - 1);
+    }
+
+    if (func.blocks.size() > 1) liveness(func, needsHome, start, end);
+    coalescePhis(func, needsHome, start, end);
+}
+
+/* Live-in/live-out sets per block, iterated backwards to a fixed point, then each value's
+ * interval is widened to cover the blocks it is live across (e.g. a whole loop) */
+void Generator::liveness(const IrFunction& func, const std::vector<bool>& needsHome,
+                         std::vector<uint32_t>& start, std::vector<uint32_t>& end) {
+    size_t blocks = func.blocks.size();
+    size_t words = (func.code.size() + 63) / 64;
+    std::vector<uint64_t> in(blocks * words, 0), out(blocks * words, 0), upward(blocks * words, 0);
+    auto set = [&](std::vector<uint64_t>& bits, size_t b, Value v) { bits[b * words + v / 64] |= uint64_t(1) << (v % 64); };
+
+    for (uint32_t b = 0; b < blocks; b++) {
+        for (Value v = func.blocks[b].begin; v < func.blocks[b].end; v++) {
+            if (func.code[v].op == IrOp::PHI) continue;
+            func.forEachOperand(func.code[v], [&](Value used) {
+                if (needsHome[used] && m_blockOf[used] != b) set(upward, b, used);
+            });
+        }
+    }
+
+    std::vector<uint64_t> next(words);
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t b = blocks; b-- > 0;) {
+            std::fill(next.begin(), next.end(), 0);
+            func.forEachSuccessor(static_cast<uint32_t>(b), [&](uint32_t succ) {
+                for (size_t w = 0; w < words; w++) next[w] |= in[succ * words + w];
+                for (Value v = func.blocks[succ].begin; v < func.blocks[succ].end && func.code[v].op == IrOp::PHI; v++) {
+                    const IrInst& phi = func.code[v];
+                    for (uint32_t i = 0; i < phi.b; i++) {
+                        const IrIncoming& incoming = func.incoming[phi.a + i];
+                        if (incoming.block == b && needsHome[incoming.value]) {
+                            next[incoming.value / 64] |= uint64_t(1) << (incoming.value % 64);
+                        }
+                    }
+                }
+            });
+            for (size_t w = 0; w < words; w++) {
+                if (next[w] != out[b * words + w]) {
+                    out[b * words + w] = next[w];
+                    changed = true;
+                }
+            }
+            /* Values defined in the block are the run [begin, end), masked out of live-out */
+            const IrBlock& block = func.blocks[b];
+            for (size_t w = 0; w < words; w++) {
+                uint64_t defined = 0;
+                uint64_t lo = w * 64, hi = lo + 64;
+                if (block.begin < hi && block.end > lo) {
+                    uint64_t from = std::max<uint64_t>(block.begin, lo) - lo, to = std::min<uint64_t>(block.end, hi) - lo;
+                    defined = (to - from == 64 ? ~uint64_t(0) : ((uint64_t(1) << (to - from)) - 1) << from);
+                }
+                in[b * words + w] = upward[b * words + w] | (out[b * words + w] & ~defined);
+            }
+        }
+    }
+
+    for (size_t b = 0; b < blocks; b++) {
+        const IrBlock& block = func.blocks[b];
+        for (size_t w = 0; w < words; w++) {
+            for (uint64_t bits = out[b * words + w]; bits != 0; bits &= bits - 1) {
+                Value v = static_cast<Value>(w * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+                end[v] = std::max(end[v], block.end - 1);
+            }
+            for (uint64_t bits = in[b * words + w]; bits != 0; bits &= bits - 1) {
+                Value v = static_cast<Value>(w * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+                start[v] = std::min(start[v], block.begin);
+            }
+        }
     }
-    
-    return m_output.str();
 }
 
-void Generator::generateFunction(const NodeFunction& func) {
-    m_output << func.name << ":\n";
-    m_output << "MOV R1, #0\n";
-    m_output << "MOV R2, #0\n";
-    m_output << "MOV R3, #0\n";
-    m_output << "MOV R4, #0\n";
-    m_output << "MOV R5, #0\n";
-    m_output << "LD SP, [R0, #stack]\n";
-    
-    m_stackOffset = 0;
-    
-    for (const auto& stmt : func.body->statements) {
-        stmt->accept(*this);
+/* A phi shares one home with every input whose interval doesn't overlap it or the inputs
+ * already sharing it, so those edges need no moves at all. Constants and stack parameters
+ * are left to edgeMoves() */
+void Generator::coalescePhis(const IrFunction& func, const std::vector<bool>& needsHome,
+                             const std::vector<uint32_t>& start, const std::vector<uint32_t>& end) {
+    size_t count = func.code.size();
+    m_web.resize(count);
+    std::vector<std::vector<Value>> members(count);
+    for (Value v = 0; v < count; v++) {
+        m_web[v] = v;
+        if (needsHome[v]) members[v].push_back(v);
+    }
+    auto stackParam = [&](Value v) { return m_paramIndex[v] >= static_cast<int>(ARG_REGISTERS); };
+    auto overlaps = [&](Value a, Value b) { return start[a] < end[b] && start[b] < end[a]; };
+
+    for (Value v = 0; v < count; v++) {
+        const IrInst& phi = func.code[v];
+        if (phi.op != IrOp::PHI) continue;
+        for (uint32_t i = 0; i < phi.b; i++) {
+            Value input = func.incoming[phi.a + i].value;
+            if (!needsHome[input] || stackParam(input)) continue;
+            Value into = m_web[v], from = m_web[input];
+            if (into == from) continue;
+            bool interferes = std::any_of(members[into].begin(), members[into].end(), [&](Value a) {
+                return std::any_of(members[from].begin(), members[from].end(), [&](Value b) { return overlaps(a, b); });
+            });
+            if (interferes) continue;
+            for (Value member : members[from]) m_web[member] = into;
+            members[into].insert(members[into].end(), members[from].begin(), members[from].end());
+            members[from].clear();
+        }
+    }
+
+    for (Value v = 0; v < count; v++) {
+        if (members[v].empty()) continue;
+        LiveInterval interval{v, start[v], end[v]};
+        for (Value member : members[v]) {
+            interval.start = std::min(interval.start, start[member]);
+            interval.end = std::max(interval.end, end[member]);
+        }
+        interval.hasHome = stackParam(v);
+        m_intervals.push_back(interval);
     }
 }
 
-// Statement visitors
-void Generator::visit(const NodeVarDecl& node) {
-    node.rpn->accept(*this);
-    
-    m_output << "ST R1, [SP]\n";
-    m_output << "ADD SP, SP, #1\n";
-    m_stackOffset++;
+/* Linear scan over one interval per web, its members all get the same home */
+void Generator::allocate(std::vector<uint8_t> registers) {
+    m_alloc = LinearScan(std::move(registers)).allocate(m_intervals, m_function->code.size());
+    for (Value v = 0; v < m_web.size(); v++) {
+        if (m_web[v] == v) continue;
+        m_alloc.reg[v] = m_alloc.reg[m_web[v]];
+        m_alloc.slot[v] = m_alloc.slot[m_web[v]];
+    }
 }
 
-void Generator::visit(const NodeArithmetic& node) {
-    for (const auto& expr : node.reversepolish) {
-        expr->accept(*this);
+/* Block labels: every branch target, and a jump's target unless the jump just falls into it */
+void Generator::labelBlocks(const IrFunction& func) {
+    m_blockLabel.assign(func.blocks.size(), NO_LABEL);
+    for (uint32_t b = 0; b < func.blocks.size(); b++) {
+        const IrInst& last = func.code[func.blocks[b].end - 1];
+        auto need = [&](uint32_t target) {
+            if (m_blockLabel[target] == NO_LABEL) m_blockLabel[target] = local("L");
+        };
+        if (last.op == IrOp::JMP && last.target != b + 1) need(last.target);
+        if (last.op == IrOp::BR) {
+            need(last.target);
+            need(last.b);
+        }
     }
 }
 
-void Generator::visit(const NodeAssignment& node) {
-    // TODO: Implement assignment generation
+/* Multiply and divide that don't reduce to shifts and adds, see arithmetic() */
+bool Generator::callsRuntime(const IrInst& inst) const {
+    const std::vector<IrInst>& code = m_function->code;
+    if (inst.op == IrOp::MUL) {
+        return code[inst.a].op != IrOp::CONST && code[inst.b].op != IrOp::CONST;
+    }
+    if (inst.op == IrOp::DIV) {
+        return code[inst.b].op != IrOp::CONST || !isPowerOfTwo(code[inst.b].imm);
+    }
+    return false;
 }
 
-void Generator::visit(const NodeReturn& node) {
-    // TODO: Implement return generation
+/* Globals past #15 can't be addressed as [R0, #name] */
+bool Generator::isFarGlobal(Symbol name) const {
+    return m_globalBase + m_globalIndex[name] > 15;
 }
 
-// Expression visitors
-void Generator::visit(const NodeInteger& node) {
-    m_output << "LD R1, [PC, #1]\n";
-    m_output << "ADD PC, PC, #1\n";
-    m_output << "DEFW " << node.value.value.value() << "\n";
+// ================================== Value Placement ==================================
+
+Generator::Operand Generator::operand(Value v) const {
+    const IrInst& inst = m_function->code[v];
+    if (inst.op == IrOp::CONST) return {true, inst.imm, 0};
+    return {false, 0, v};
+}
+
+/* Register holding operand, loading spilled values and literals into scratch (0 is just R0) */
+uint8_t Generator::use(const Operand& operand, uint8_t scratch) {
+    if (operand.isLiteral) {
+        if (operand.literal == 0) return 0;
+        loadConstant(scratch, operand.literal);
+        return scratch;
+    }
+    if (m_alloc.reg[operand.value] != Allocation::SPILLED) {
+        return static_cast<uint8_t>(m_alloc.reg[operand.value]);
+    }
+    loadStack(scratch, frameOffset(operand.value));
+    return scratch;
 }
 
-void Generator::visit(const NodeBoolean& node) {
-    m_output << "LD R1, [PC, #1]\n";
-    m_output << "ADD PC, PC, #1\n";
-    if (node.value.type == TokenType::TRUE) {
-        m_output << "DEFW 1\n";
+/* Register to compute value into, commit() then writes spilled values back */
+uint8_t Generator::target(uint32_t value, uint8_t scratch) {
+    if (m_alloc.reg[value] != Allocation::SPILLED) {
+        return static_cast<uint8_t>(m_alloc.reg[value]);
+    }
+    return scratch;
+}
+
+void Generator::commit(uint32_t value, uint8_t reg) {
+    if (m_alloc.reg[value] == Allocation::SPILLED) {
+        storeStack(reg, frameOffset(value));
+    }
+}
+
+/* SP-relative offset of a value's memory home
+ *  stack: [stack args...][return address][frame slots...][pushed...] SP ->
+ * The return address slot is where SP pointed on entry, the frame is m_frameWords from there */
+int Generator::frameOffset(uint32_t value) const {
+    if (m_paramIndex[value] >= static_cast<int>(ARG_REGISTERS)) {
+        int params = static_cast<int>(m_function->parameters.size());
+        return -(params - m_paramIndex[value]) - m_frameWords - m_pushDepth;
+    }
+    return 1 + m_alloc.slot[value] - m_frameWords - m_pushDepth;
+}
+
+/* Parameters to their allocated homes: spilled register arguments are stored before the
+ * moves can overwrite them, stack arguments given a register are loaded last */
+void Generator::receiveParameters() {
+    std::vector<std::pair<uint8_t, uint8_t>> moves;
+    std::vector<Value> fromStack;
+    for (Value v = 0; v < m_function->code.size() && m_function->code[v].op == IrOp::PARAM; v++) {
+        uint32_t index = static_cast<uint32_t>(m_function->code[v].imm);
+        bool spilled = m_alloc.reg[v] == Allocation::SPILLED;
+        if (index >= ARG_REGISTERS) {
+            if (!spilled) fromStack.push_back(v);
+        } else if (spilled) {
+            storeStack(static_cast<uint8_t>(R2 + index), frameOffset(v));
+        } else {
+            moves.push_back({static_cast<uint8_t>(m_alloc.reg[v]), static_cast<uint8_t>(R2 + index)});
+        }
+    }
+    parallelMove(moves);
+    for (Value v : fromStack) {
+        loadStack(static_cast<uint8_t>(m_alloc.reg[v]), frameOffset(v));
+    }
+}
+
+/* Register moves (dst, src) as if all at once: a move goes once nothing else still reads its
+ * destination, a cycle is broken by parking one destination in R1 */
+void Generator::parallelMove(std::vector<std::pair<uint8_t, uint8_t>> moves) {
+    moves.erase(std::remove_if(moves.begin(), moves.end(),
+                               [](const std::pair<uint8_t, uint8_t>& m) { return m.first == m.second; }),
+                moves.end());
+    while (!moves.empty()) {
+        auto ready = std::find_if(moves.begin(), moves.end(), [&](const std::pair<uint8_t, uint8_t>& m) {
+            return std::none_of(moves.begin(), moves.end(),
+                                [&](const std::pair<uint8_t, uint8_t>& other) { return other.second == m.first; });
+        });
+        if (ready == moves.end()) {
+            uint8_t parked = moves.front().first;
+            emit(Instruction::move(R1, parked));
+            for (auto& m : moves) {
+                if (m.second == parked) m.second = R1;
+            }
+            continue;
+        }
+        emit(Instruction::move(ready->first, ready->second));
+        moves.erase(ready);
+    }
+}
+
+// ==================================== Literal Pool ====================================
+
+/* Every instruction goes through here so the pool knows where it is
+ * Branches count at their relaxed size, so Listing::relax() never pushes a literal out of reach */
+void Generator::emit(const Instruction& instruction) {
+    uint32_t words = instruction.maxWords();
+    if (!m_poolLocked) reservePool(words);
+    m_listing.code.push_back(instruction);
+    m_words += words;
+}
+
+/* Source identifiers are re-interned as label names in the listing, `_` in front */
+Symbol Generator::symbol(Symbol name) {
+    return m_listing.label(mangle(m_interner.name(name)));
+}
+
+/* Fresh label inside the current function: <fn>_<kind><n> */
+Symbol Generator::local(const char* kind) {
+    return m_listing.label(std::string(m_interner.name(m_function->name)) + "_" + kind + std::to_string(m_localLabels++));
+}
+
+/* Dropping an island here if emitting `words` more would push a pending entry out of reach */
+void Generator::reservePool(uint32_t words) {
+    for (uint32_t i = 0; i < m_pool.size(); i++) {
+        if (m_words + words + 1 + i > m_pool[i].deadline) {
+            flushPool(true);
+            return;
+        }
+    }
+}
+
+void Generator::flushPool(bool branchOver) {
+    if (m_pool.empty()) return;
+    Symbol end = local("pool");
+    if (branchOver) {
+        m_listing.code.push_back(Instruction::branch(Cond::AL, end));
+        m_words++;
+    }
+    for (const PoolEntry& entry : m_pool) {
+        m_listing.code.push_back(Instruction::define(entry.label));
+        m_listing.code.push_back(entry.word);
+        m_placed[entry.key] = {entry.label, m_words};
+        m_words++;
+    }
+    m_pool.clear();
+    if (branchOver) m_listing.code.push_back(Instruction::define(end));
+}
+
+/* LD Rd, label: shares an entry already placed behind us or still pending, else queues one */
+void Generator::loadLiteral(uint8_t r, const std::string& key, const Instruction& word) {
+    reservePool(1);
+    auto placed = m_placed.find(key);
+    if (placed != m_placed.end() && m_words - placed->second.second <= LITERAL_REACH_BACK) {
+        emit(Instruction::memoryLabel(Opcode::LD, r, placed->second.first));
+        return;
+    }
+    auto pending = std::find_if(m_pool.begin(), m_pool.end(),
+                                [&](const PoolEntry& entry) { return entry.key == key; });
+    if (pending == m_pool.end()) {
+        Symbol name = local("lit");
+        m_pool.push_back({key, name, m_words + LITERAL_REACH_FORWARD, word});
+        pending = m_pool.end() - 1;
+    }
+    emit(Instruction::memoryLabel(Opcode::LD, r, pending->label));
+}
+
+// ================================== Emitting Helpers ==================================
+
+/* MOV #imm when it fits in 5 bits, otherwise a pool load */
+void Generator::loadConstant(uint8_t r, int32_t value) {
+    if (fitsImmediate(value)) {
+        emit(Instruction::moveImm(r, value));
     } else {
-        m_output << "DEFW 0\n";
+        loadLiteral(r, std::to_string(value), Instruction::word(Opcode::DEFW, value));
     }
 }
 
-void Generator::visit(const NodeIdentifier& node) {
-    // TODO: Implement identifier generation
+void Generator::loadStack(uint8_t r, int offset) {
+    if (fitsImmediate(offset)) {
+        emit(Instruction::memory(Opcode::LD, r, SP, offset));
+    } else {
+        loadConstant(r, offset);
+        emit(Instruction::memoryReg(Opcode::LD, r, SP, r));
+    }
 }
 
-void Generator::visit(const NodeOperator& node) {
-    // TODO: Implement operator generation
+void Generator::storeStack(uint8_t r, int offset) {
+    if (fitsImmediate(offset)) {
+        emit(Instruction::memory(Opcode::ST, r, SP, offset));
+    } else {
+        uint8_t scratch = r == R1 ? m_scratchB : R1;
+        loadConstant(scratch, offset);
+        emit(Instruction::memoryReg(Opcode::ST, r, SP, scratch));
+    }
 }
 
-void Generator::visit(const NodeFunctionCall& node) {
-    // TODO: Implement function call generation
-}
\ No newline at end of file
+void Generator::loadGlobal(uint8_t r, Symbol name) {
+    if (!isFarGlobal(name)) {
+        emit(Instruction::memory(Opcode::LD, r, 0, 0, symbol(name)));
+    } else {
+        loadLiteral(r, std::string(m_interner.name(name)), Instruction::word(Opcode::DEFW, 0, symbol(name)));
+        emit(Instruction::memory(Opcode::LD, r, r, 0));
+    }
+}
+
+void Generator::storeGlobal(uint8_t r, Symbol name) {
+    if (!isFarGlobal(name)) {
+        emit(Instruction::memory(Opcode::ST, r, 0, 0, symbol(name)));
+    } else {
+        uint8_t scratch = r == R1 ? m_scratchB : R1;
+        loadLiteral(scratch, std::string(m_interner.name(name)), Instruction::word(Opcode::DEFW, 0, symbol(name)));
+        emit(Instruction::memory(Opcode::ST, r, scratch, 0));
+    }
+}
+
+void Generator::push(uint8_t r) {
+    emit(Instruction::memory(Opcode::ST, r, SP, 0));
+    emit(Instruction::aluImm(Opcode::ADD, SP, SP, 1));
+    m_pushDepth++;
+    StackFrame& frame = m_frames.back();
+    frame.words = std::max(frame.words, static_cast<uint32_t>(m_frameWords + m_pushDepth));
+}
+
+/* Immediates are -16..15, so SUB takes at most #15 */
+void Generator::adjustSP(int delta) {
+    while (delta != 0) {
+        int step = delta > 15 ? 15 : (delta < -15 ? -15 : delta);
+        if (step > 0) {
+            emit(Instruction::aluImm(Opcode::ADD, SP, SP, step));
+        } else {
+            emit(Instruction::aluImm(Opcode::SUB, SP, SP, -step));
+        }
+        delta -= step;
+    }
+}
+
+/* Result is already in R1: main halts, other functions drop their frame and pop the return address
+ * Control never falls through, so pending literals can go straight after */
+void Generator::epilogue() {
+    if (m_interner.name(m_function->name) == "main") {
+        emit(Instruction::branch(Cond::AL, m_listing.label("halt")));
+    } else {
+        adjustSP(-m_frameWords - m_pushDepth);
+        emit(Instruction::memory(Opcode::LD, PC, SP, 0));
+    }
+    flushPool(false);
+}
+
+// ================================ Instruction Selection ================================
+
+void Generator::generateInstruction(Value v) {
+    const IrInst& inst = m_function->code[v];
+    switch (inst.op) {
+    case IrOp::CONST:
+        /* Materialised by whatever consumes it */
+        break;
+    case IrOp::PARAM:
+        /* Placed by receiveParameters() on entry */
+        break;
+    case IrOp::LOAD: {
+        uint8_t d = target(v, R1);
+        loadGlobal(d, inst.sym);
+        commit(v, d);
+        break;
+    }
+    case IrOp::STORE:
+        storeGlobal(use(operand(inst.a), R1), inst.sym);
+        break;
+    case IrOp::ADD:
+    case IrOp::SUB:
+    case IrOp::MUL:
+    case IrOp::DIV:
+        arithmetic(v);
+        break;
+    case IrOp::EQ: case IrOp::NE: case IrOp::LT: case IrOp::LE: case IrOp::GT: case IrOp::GE:
+        if (!m_fused[v]) materialise(v);
+        break;
+    case IrOp::PHI:
+        /* Placed by edgeMoves() on the way in, or already there when coalesced */
+        break;
+    case IrOp::CALL: {
+        std::vector<Operand> args;
+        for (uint32_t i = 0; i < inst.b; i++) args.push_back(operand(m_function->args[inst.a + i]));
+        call(symbol(inst.sym), inst.sym, args, v);
+        break;
+    }
+    case IrOp::RET:
+        if (inst.a != NO_VALUE) {
+            Operand result = operand(inst.a);
+            if (result.isLiteral) {
+                loadConstant(R1, result.literal);
+            } else if (uint8_t from = use(result, R1); from != R1) {
+                emit(Instruction::move(R1, from));
+            }
+        }
+        epilogue();
+        break;
+    case IrOp::JMP:
+        edgeMoves(m_block, inst.target);
+        jump(inst.target, true);
+        break;
+    case IrOp::BR:
+        branch(v);
+        break;
+    }
+}
+
+/* Immediate forms when a literal operand fits, otherwise the literal is materialised in R1
+ * (or the destination / scratchB when R1 already holds the other operand)
+ * STUMP has no multiply or divide: constants are strength reduced, the rest calls the runtime */
+void Generator::arithmetic(Value v) {
+    const IrInst& inst = m_function->code[v];
+    Operand lhs = operand(inst.a);
+    Operand rhs = operand(inst.b);
+    bool commutes = inst.op == IrOp::ADD || inst.op == IrOp::MUL;
+    if (commutes && lhs.isLiteral && !rhs.isLiteral &&
+        (inst.op == IrOp::MUL || fitsImmediate(lhs.literal))) {
+        std::swap(lhs, rhs);
+    }
+
+    if (inst.op == IrOp::MUL && !rhs.isLiteral) {
+        m_usesMultiply = true;
+        call(m_listing.label(RUNTIME_MULTIPLY), std::nullopt, {lhs, rhs}, v);
+        return;
+    }
+    if (inst.op == IrOp::DIV && !(rhs.isLiteral && isPowerOfTwo(rhs.literal))) {
+        m_usesDivide = true;
+        call(m_listing.label(RUNTIME_DIVIDE), std::nullopt, {lhs, rhs}, v);
+        return;
+    }
+
+    uint8_t d = target(v, R1);
+    uint8_t a = use(lhs, R1);
+    bool immediate = rhs.isLiteral && fitsImmediate(rhs.literal) &&
+                     (inst.op == IrOp::ADD || inst.op == IrOp::SUB);
+
+    switch (inst.op) {
+    case IrOp::ADD:
+    case IrOp::SUB: {
+        Opcode opcode = inst.op == IrOp::ADD ? Opcode::ADD : Opcode::SUB;
+        if (immediate && rhs.literal == 0) {
+            if (d != a) emit(Instruction::move(d, a));
+        } else if (immediate) {
+            emit(Instruction::aluImm(opcode, d, a, rhs.literal));
+        } else {
+            uint8_t scratch = rhs.isLiteral ? (a != R1 ? R1 : (d != R1 ? d : m_scratchB)) : m_scratchB;
+            uint8_t b = use(rhs, scratch);
+            emit(Instruction::alu(opcode, d, a, b));
+        }
+        break;
+    }
+    case IrOp::MUL:
+        multiplyConstant(d, a, rhs.literal);
+        break;
+    case IrOp::DIV:
+        dividePowerOfTwo(d, a, rhs.literal);
+        break;
+    default:
+        break;
+    }
+    commit(v, d);
+}
+
+// ==================================== Control Flow ====================================
+
+/* Condition codes for each comparison, and with its operands swapped */
+static Cond condition(IrOp op) {
+    switch (op) {
+    case IrOp::EQ: return Cond::EQ;
+    case IrOp::NE: return Cond::NE;
+    case IrOp::LT: return Cond::LT;
+    case IrOp::LE: return Cond::LE;
+    case IrOp::GT: return Cond::GT;
+    default:       return Cond::GE;
+    }
+}
+
+static bool holds(IrOp op, int32_t lhs, int32_t rhs) {
+    switch (op) {
+    case IrOp::EQ: return lhs == rhs;
+    case IrOp::NE: return lhs != rhs;
+    case IrOp::LT: return lhs < rhs;
+    case IrOp::LE: return lhs <= rhs;
+    case IrOp::GT: return lhs > rhs;
+    default:       return lhs >= rhs;
+    }
+}
+
+static Cond swapped(Cond cond) {
+    switch (cond) {
+    case Cond::LT: return Cond::GT;
+    case Cond::LE: return Cond::GE;
+    case Cond::GT: return Cond::LT;
+    case Cond::GE: return Cond::LE;
+    default:       return cond;
+    }
+}
+
+/* Conditions come in encoding pairs, flipping the low bit negates one */
+static Cond inverted(Cond cond) {
+    return static_cast<Cond>(static_cast<uint8_t>(cond) ^ 1);
+}
+
+/* CMP for a comparison, returning the condition that holds when it is true
+ * A literal goes on the right as an immediate when it fits, two literals are decided here */
+Cond Generator::compare(IrOp op, Operand lhs, Operand rhs) {
+    Cond cond = condition(op);
+    if (lhs.isLiteral && rhs.isLiteral) {
+        emit(Instruction::compare(0, 0));
+        return holds(op, lhs.literal, rhs.literal) ? Cond::EQ : Cond::NE;
+    }
+    if (lhs.isLiteral) {
+        std::swap(lhs, rhs);
+        cond = swapped(cond);
+    }
+    uint8_t a = use(lhs, R1);
+    if (rhs.isLiteral && fitsImmediate(rhs.literal)) {
+        emit(Instruction::aluImm(Opcode::CMP, 0, a, rhs.literal));
+    } else {
+        emit(Instruction::compare(a, use(rhs, a != R1 ? R1 : m_scratchB)));
+    }
+    return cond;
+}
+
+/* A comparison whose value is needed as such: 1 or 0 without disturbing the flags */
+void Generator::materialise(Value v) {
+    const IrInst& inst = m_function->code[v];
+    Cond cond = compare(inst.op, operand(inst.a), operand(inst.b));
+    uint8_t d = target(v, R1);
+    Symbol done = local("cmp");
+    emit(Instruction::moveImm(d, 1));
+    emit(Instruction::branch(cond, done));
+    emit(Instruction::moveImm(d, 0));
+    m_listing.code.push_back(Instruction::define(done));
+    commit(v, d);
+}
+
+/* Conditional branch at the end of the current block
+ *  - a fused comparison is a CMP right here, anything else is tested against zero
+ *  - the edge that doesn't branch falls into the next block where it can, so a rotated loop's
+ *    latch is a single Bcc back to its header
+ *  - an edge needing phi moves can't be taken by Bcc directly: its moves follow the branch,
+ *    or go in a stub after the function when both edges have some */
+void Generator::branch(Value v) {
+    const IrInst& inst = m_function->code[v];
+    uint32_t taken = inst.target, other = inst.b;
+    if (taken == other) {
+        edgeMoves(m_block, taken);
+        jump(taken, true);
+        return;
+    }
+
+    Cond cond;
+    if (m_fused[inst.a]) {
+        const IrInst& comparison = m_function->code[inst.a];
+        cond = compare(comparison.op, operand(comparison.a), operand(comparison.b));
+    } else {
+        emit(Instruction::aluImm(Opcode::CMP, 0, use(operand(inst.a), R1), 0));
+        cond = Cond::NE;
+    }
+
+    uint32_t next = m_block + 1;
+    bool takenMoves = needsMoves(m_block, taken);
+    bool otherMoves = needsMoves(m_block, other);
+    /* `other` is the edge handled in line after the Bcc */
+    if ((takenMoves && !otherMoves) || (takenMoves == otherMoves && taken == next)) {
+        std::swap(taken, other);
+        std::swap(takenMoves, otherMoves);
+        cond = inverted(cond);
+    }
+
+    if (!takenMoves) {
+        emit(Instruction::branch(cond, m_blockLabel[taken]));
+        edgeMoves(m_block, other);
+        jump(other, true);
+        return;
+    }
+    Symbol stub = local("edge");
+    emit(Instruction::branch(cond, stub));
+    m_stubs.push_back({stub, m_block, taken});
+    edgeMoves(m_block, other);
+    jump(other, true);
+}
+
+/* Edges both of whose sides needed moves, out of line after the function's last block */
+void Generator::emitStubs() {
+    for (const Stub& stub : m_stubs) {
+        m_listing.code.push_back(Instruction::define(stub.label));
+        edgeMoves(stub.from, stub.to);
+        emit(Instruction::branch(Cond::AL, m_blockLabel[stub.to]));
+        flushPool(false);
+    }
+    m_stubs.clear();
+}
+
+/* Unconditional transfer to a block, nothing at all when it is the next one */
+void Generator::jump(uint32_t block, bool fallThrough) {
+    if (fallThrough && block == m_block + 1) return;
+    emit(Instruction::branch(Cond::AL, m_blockLabel[block]));
+    /* Control never falls past here, pending literals can go straight after */
+    flushPool(false);
+}
+
+/* Value a phi receives along the edge from block */
+Value Generator::incoming(const IrInst& phi, uint32_t block) const {
+    for (uint32_t i = 0; i < phi.b; i++) {
+        const IrIncoming& in = m_function->incoming[phi.a + i];
+        if (in.block == block) return in.value;
+    }
+    return NO_VALUE;
+}
+
+bool Generator::sameHome(Value a, Value b) const {
+    if (m_alloc.reg[a] != m_alloc.reg[b]) return false;
+    return m_alloc.reg[a] != Allocation::SPILLED || frameOffset(a) == frameOffset(b);
+}
+
+bool Generator::needsMoves(uint32_t from, uint32_t to) const {
+    const IrBlock& block = m_function->blocks[to];
+    for (Value v = block.begin; v < block.end && m_function->code[v].op == IrOp::PHI; v++) {
+        Value input = incoming(m_function->code[v], from);
+        if (input != NO_VALUE && (m_function->code[input].op == IrOp::CONST || !sameHome(v, input))) return true;
+    }
+    return false;
+}
+
+/* The target block's phis take their inputs from this edge all at once
+ *  - between registers it is a parallel move
+ *  - when memory is involved every input is pushed first and popped into place
+ *  - constants are written last, nothing reads a phi's home on the way */
+void Generator::edgeMoves(uint32_t from, uint32_t to) {
+    const IrBlock& block = m_function->blocks[to];
+    std::vector<std::pair<Value, Operand>> moves;
+    bool memory = false;
+    for (Value v = block.begin; v < block.end && m_function->code[v].op == IrOp::PHI; v++) {
+        Value input = incoming(m_function->code[v], from);
+        if (input == NO_VALUE) continue;
+        Operand source = operand(input);
+        if (!source.isLiteral && sameHome(v, input)) continue;
+        moves.push_back({v, source});
+        memory |= m_alloc.reg[v] == Allocation::SPILLED ||
+                  (!source.isLiteral && m_alloc.reg[source.value] == Allocation::SPILLED);
+    }
+    if (moves.empty()) return;
+
+    if (!memory) {
+        std::vector<std::pair<uint8_t, uint8_t>> registers;
+        for (const auto& move : moves) {
+            if (!move.second.isLiteral) {
+                registers.push_back({static_cast<uint8_t>(m_alloc.reg[move.first]),
+                                     static_cast<uint8_t>(m_alloc.reg[move.second.value])});
+            }
+        }
+        parallelMove(registers);
+    } else {
+        for (const auto& move : moves) {
+            if (!move.second.isLiteral) push(use(move.second, R1));
+        }
+        for (auto move = moves.rbegin(); move != moves.rend(); ++move) {
+            if (move->second.isLiteral) continue;
+            uint8_t d = target(move->first, R1);
+            emit(Instruction::aluImm(Opcode::SUB, SP, SP, 1));
+            emit(Instruction::memory(Opcode::LD, d, SP, 0));
+            m_pushDepth--;
+            commit(move->first, d);
+        }
+    }
+    for (const auto& move : moves) {
+        if (!move.second.isLiteral) continue;
+        uint8_t d = target(move.first, R1);
+        loadConstant(d, move.second.literal);
+        commit(move.first, d);
+    }
+}
+
+// ===================================== Calls =====================================
+
+/* Register calling convention
+ *  - the caller saves the registers live across the call, the callee may use any of them
+ *  - arguments 0-3 go in R2-R5, any more are pushed before the return address
+ *  - the return address is stored at [SP] without moving SP, so a leaf returns with just
+ *    `LD PC, [SP]` and anything else claims the slot in its frame
+ *  - the result comes back in R1
+ * The runtime routines are leaves that only use their return slot, so they count towards the
+ * caller's own words rather than as calls */
+void Generator::call(Symbol label, std::optional<Symbol> callee, const std::vector<Operand>& args, Value result) {
+    std::vector<uint8_t> saved;
+    for (const LiveInterval& interval : m_intervals) {
+        if (interval.start < m_point && interval.end > m_point &&
+            m_alloc.reg[interval.value] != Allocation::SPILLED) {
+            saved.push_back(static_cast<uint8_t>(m_alloc.reg[interval.value]));
+        }
+    }
+    for (uint8_t r : saved) push(r);
+    int stackArgs = 0;
+    for (size_t i = ARG_REGISTERS; i < args.size(); i++) {
+        push(use(args[i], R1));
+        stackArgs++;
+    }
+
+    /* Register sources move as a whole first, literals and spilled values can't be clobbered */
+    std::vector<std::pair<uint8_t, uint8_t>> moves;
+    for (size_t i = 0; i < args.size() && i < ARG_REGISTERS; i++) {
+        if (!args[i].isLiteral && m_alloc.reg[args[i].value] != Allocation::SPILLED) {
+            moves.push_back({static_cast<uint8_t>(R2 + i), static_cast<uint8_t>(m_alloc.reg[args[i].value])});
+        }
+    }
+    parallelMove(moves);
+    for (size_t i = 0; i < args.size() && i < ARG_REGISTERS; i++) {
+        uint8_t r = static_cast<uint8_t>(R2 + i);
+        if (args[i].isLiteral) {
+            loadConstant(r, args[i].literal);
+        } else if (m_alloc.reg[args[i].value] == Allocation::SPILLED) {
+            loadStack(r, frameOffset(args[i].value));
+        }
+    }
+
+    /* The return address is computed PC-relative, no island may land inside
+     * (relaxing a far call to `LD PC, [PC]; DEFW` bumps the #2) */
+    reservePool(4);
+    m_poolLocked = true;
+    emit(Instruction::aluImm(Opcode::ADD, R1, PC, 2));
+    emit(Instruction::memory(Opcode::ST, R1, SP, 0));
+    emit(Instruction::branch(Cond::AL, label, true));
+    m_poolLocked = false;
+    StackFrame& frame = m_frames.back();
+    uint32_t slot = static_cast<uint32_t>(m_frameWords + m_pushDepth);
+    if (callee) frame.calls.push_back({*callee, slot});
+    else frame.words = std::max(frame.words, slot + 1);
+
+    adjustSP(-stackArgs);
+    m_pushDepth -= stackArgs;
+    for (auto r = saved.rbegin(); r != saved.rend(); ++r) {
+        emit(Instruction::aluImm(Opcode::SUB, SP, SP, 1));
+        emit(Instruction::memory(Opcode::LD, *r, SP, 0));
+        m_pushDepth--;
+    }
+
+    uint8_t d = target(result, R1);
+    if (d != R1) {
+        emit(Instruction::move(d, R1));
+    }
+    commit(result, d);
+}
+
+// ================================ Multiply and Divide ================================
+
+/* x * c by shift-and-add over the non-adjacent form of |c|: doubling is ADD r, r, r and
+ * runs of ones become one subtract, so e.g. x * 15 is ((x + x)*2*2*2) - x */
+void Generator::multiplyConstant(uint8_t d, uint8_t a, int32_t c) {
+    uint32_t magnitude = static_cast<uint32_t>(c < 0 ? -c : c) & 0xFFFF;
+    if (magnitude == 0) {
+        emit(Instruction::moveImm(d, 0));
+        return;
+    }
+
+    /* Digits in {-1, 0, 1}, least significant first */
+    std::vector<int8_t> digits;
+    for (uint32_t n = magnitude; n != 0; n >>= 1) {
+        int8_t digit = 0;
+        if (n & 1) {
+            digit = (n & 3) == 3 ? -1 : 1;
+            n -= static_cast<uint32_t>(static_cast<int32_t>(digit));
+        }
+        digits.push_back(digit);
+    }
+
+    /* d is written before the last use of x when they share a register */
+    bool laterUse = std::any_of(digits.begin(), digits.end() - 1, [](int8_t digit) { return digit != 0; });
+    uint8_t x = a;
+    if (d == a && laterUse) {
+        x = a != R1 ? R1 : m_scratchB;
+        emit(Instruction::move(x, a));
+    }
+
+    bool first = true;
+    for (size_t i = digits.size() - 1; i-- > 0;) {
+        emit(Instruction::alu(Opcode::ADD, d, first ? x : d, first ? x : d));
+        first = false;
+        if (digits[i] != 0) {
+            emit(Instruction::alu(digits[i] > 0 ? Opcode::ADD : Opcode::SUB, d, d, x));
+        }
+    }
+    if (first && d != x) emit(Instruction::move(d, x));
+    if (c < 0) emit(Instruction::alu(Opcode::SUB, d, 0, d));
+}
+
+/* x / 2^k truncating towards zero: ASR rounds down, so negative x is biased by 2^k - 1 first */
+void Generator::dividePowerOfTwo(uint8_t d, uint8_t a, int32_t c) {
+    uint32_t magnitude = static_cast<uint32_t>(c < 0 ? -c : c);
+    int shifts = 0;
+    while ((1u << shifts) < magnitude) shifts++;
+
+    if (d != a) emit(Instruction::move(d, a));
+    if (shifts > 0) {
+        int32_t bias = static_cast<int32_t>(magnitude) - 1;
+        Symbol positive = local("div");
+        emit(Instruction::compare(a, 0));
+        emit(Instruction::branch(Cond::PL, positive));
+        if (fitsImmediate(bias)) {
+            emit(Instruction::aluImm(Opcode::ADD, d, a, bias));
+        } else if (a != R1 && d != R1) {
+            loadConstant(R1, bias);
+            emit(Instruction::alu(Opcode::ADD, d, a, R1));
+        } else if (d != a) {
+            loadConstant(d, bias);
+            emit(Instruction::alu(Opcode::ADD, d, d, a));
+        } else {
+            loadConstant(m_scratchB, bias);
+            emit(Instruction::alu(Opcode::ADD, d, a, m_scratchB));
+        }
+        m_listing.code.push_back(Instruction::define(positive));
+        for (int i = 0; i < shifts; i++) {
+            emit(Instruction::shifted(Opcode::ADD, d, d, 0, Shift::ASR));
+        }
+    }
+    if (c < 0) emit(Instruction::alu(Opcode::SUB, d, 0, d));
+}
+
+// ================================== Runtime Routines ==================================
+
+/* Shared multiply/divide, emitted once after the program's functions and only if called
+ * Leaf functions under the usual convention: a in R2, b in R3, result in R1 */
+void Generator::emitRuntime() {
+    std::vector<Instruction>& code = m_listing.code;
+    auto label = [&](const char* name) { return m_listing.label(name); };
+    auto entry = [&](const char* name) {
+        Symbol symbol = label(name);
+        if (m_listing.functions.size() <= symbol) m_listing.functions.resize(symbol + 1, false);
+        m_listing.functions[symbol] = true;
+        code.push_back(Instruction::define(symbol));
+    };
+    auto place = [&](const char* name) { code.push_back(Instruction::define(label(name))); };
+    auto ret = [&]() {
+        code.push_back(Instruction::memory(Opcode::LD, PC, SP, 0));
+    };
+    /* Operands to magnitudes, R5 ends up 1 when exactly one of them was negative */
+    auto magnitudes = [&](const char* prefix) {
+        std::string p = prefix;
+        code.push_back(Instruction::moveImm(5, 0));
+        code.push_back(Instruction::compare(2, 0));
+        code.push_back(Instruction::branch(Cond::PL, label((p + "_a").c_str())));
+        code.push_back(Instruction::alu(Opcode::SUB, 2, 0, 2));
+        code.push_back(Instruction::moveImm(5, 1));
+        place((p + "_a").c_str());
+        code.push_back(Instruction::compare(3, 0));
+        code.push_back(Instruction::branch(Cond::PL, label((p + "_b").c_str())));
+        code.push_back(Instruction::alu(Opcode::SUB, 3, 0, 3));
+        code.push_back(Instruction::alu(Opcode::SUB, 5, 0, 5));
+        code.push_back(Instruction::aluImm(Opcode::ADD, 5, 5, 1));
+        place((p + "_b").c_str());
+    };
+    auto applySign = [&](const char* prefix) {
+        std::string done = std::string(prefix) + "_done";
+        code.push_back(Instruction::compare(5, 0));
+        code.push_back(Instruction::branch(Cond::EQ, label(done.c_str())));
+        code.push_back(Instruction::alu(Opcode::SUB, R1, 0, R1));
+        place(done.c_str());
+        ret();
+    };
+
+    if (m_usesMultiply) {
+        /* Shift-and-add looping over the bits of the smaller magnitude (R3), the larger (R2) doubles */
+        entry(RUNTIME_MULTIPLY);
+        magnitudes(RUNTIME_MULTIPLY);
+        code.push_back(Instruction::moveImm(R1, 0));
+        code.push_back(Instruction::compare(2, 3));
+        code.push_back(Instruction::branch(Cond::HI, label("__mul_loop")));
+        code.push_back(Instruction::move(4, 2));
+        code.push_back(Instruction::move(2, 3));
+        code.push_back(Instruction::move(3, 4));
+        place("__mul_loop");
+        /* Zero ends it, 0x8000 (both operands -32768) multiplies to 0 */
+        code.push_back(Instruction::compare(3, 0));
+        code.push_back(Instruction::branch(Cond::LE, label("__mul_sign")));
+        code.push_back(Instruction::aluImm(Opcode::AND, 4, 3, 1));
+        code.push_back(Instruction::compare(4, 0));
+        code.push_back(Instruction::branch(Cond::EQ, label("__mul_skip")));
+        code.push_back(Instruction::alu(Opcode::ADD, R1, R1, 2));
+        place("__mul_skip");
+        code.push_back(Instruction::alu(Opcode::ADD, 2, 2, 2));
+        code.push_back(Instruction::shifted(Opcode::ADD, 3, 3, 0, Shift::ASR));
+        code.push_back(Instruction::branch(Cond::AL, label("__mul_loop")));
+        place("__mul_sign");
+        applySign(RUNTIME_MULTIPLY);
+    }
+
+    if (m_usesDivide) {
+        /* Restoring shift-subtract, one quotient bit per iteration. R1 starts as a sentinel 1
+         * which carries out of bit 15 after exactly 16 shifts, so no counter register is needed */
+        entry(RUNTIME_DIVIDE);
+        magnitudes(RUNTIME_DIVIDE);
+        code.push_back(Instruction::moveImm(R1, 1));
+        code.push_back(Instruction::moveImm(4, 0));
+        place("__div_loop");
+        code.push_back(Instruction::alu(Opcode::ADD, 2, 2, 2).flags());
+        code.push_back(Instruction::alu(Opcode::ADC, 4, 4, 4));
+        code.push_back(Instruction::compare(4, 3));
+        code.push_back(Instruction::branch(Cond::CC, label("__div_bit")));
+        code.push_back(Instruction::alu(Opcode::SUB, 4, 4, 3));
+        place("__div_bit");
+        code.push_back(Instruction::alu(Opcode::ADC, R1, R1, R1).flags());
+        code.push_back(Instruction::branch(Cond::CC, label("__div_loop")));
+        applySign(RUNTIME_DIVIDE);
+    }
+}
@@ -0,0 +1,159 @@
+#include "inliner.h"
+
+/* Instructions that cost words once generated */
+static uint32_t cost(const IrFunction& func) {
+    uint32_t total = 0;
+    for (const IrInst& inst : func.code) {
+        if (inst.op != IrOp::CONST && inst.op != IrOp::PARAM) total++;
+    }
+    return total;
+}
+
+Inliner::Inliner(const Interner& interner, uint32_t budget)
+    : m_interner(interner), m_budget(budget) {}
+
+void Inliner::run(IrModule& module) {
+    m_module = &module;
+    m_inlined = 0;
+    size_t count = module.functions.size();
+    m_index.assign(m_interner.size(), -1);
+    for (size_t i = 0; i < count; i++) {
+        m_index[module.functions[i].name] = static_cast<int32_t>(i);
+    }
+
+    m_sites.assign(count, 0);
+    for (const IrFunction& func : module.functions) {
+        for (const IrInst& inst : func.code) {
+            if (inst.op == IrOp::CALL && m_index[inst.sym] >= 0) m_sites[static_cast<size_t>(m_index[inst.sym])]++;
+        }
+    }
+    m_recursive.assign(count, false);
+    for (size_t i = 0; i < count; i++) {
+        m_visited.assign(count, false);
+        m_recursive[i] = reaches(i, i);
+    }
+
+    m_visited.assign(count, false);
+    m_order.clear();
+    for (size_t i = 0; i < count; i++) order(i);
+    for (size_t i : m_order) inlineCalls(module.functions[i]);
+    m_module = nullptr;
+}
+
+/* Post-order over the call graph */
+void Inliner::order(size_t function) {
+    if (m_visited[function]) return;
+    m_visited[function] = true;
+    for (const IrInst& inst : m_module->functions[function].code) {
+        if (inst.op == IrOp::CALL && m_index[inst.sym] >= 0) order(static_cast<size_t>(m_index[inst.sym]));
+    }
+    m_order.push_back(function);
+}
+
+bool Inliner::reaches(size_t from, size_t target) {
+    for (const IrInst& inst : m_module->functions[from].code) {
+        if (inst.op != IrOp::CALL || m_index[inst.sym] < 0) continue;
+        size_t callee = static_cast<size_t>(m_index[inst.sym]);
+        if (callee == target) return true;
+        if (m_visited[callee]) continue;
+        m_visited[callee] = true;
+        if (reaches(callee, target)) return true;
+    }
+    return false;
+}
+
+bool Inliner::qualifies(const IrInst& call) const {
+    if (call.op != IrOp::CALL || m_index[call.sym] < 0) return false;
+    size_t callee = static_cast<size_t>(m_index[call.sym]);
+    const IrFunction& func = m_module->functions[callee];
+    if (call.b != func.parameters.size() || m_recursive[callee] || func.blocks.size() != 1 || m_interner.name(func.name) == "main") return false;
+    uint32_t size = cost(func);
+    return size <= m_budget || (m_sites[callee] == 1 && size <= SINGLE_SITE_BUDGET);
+}
+
+/* Rebuilding the caller with each qualifying call replaced by a copy of the callee's body
+ * Caller operands are renumbered in a second sweep (phi inputs can refer forward), the
+ * callee's are mapped as they are copied */
+void Inliner::inlineCalls(IrFunction& caller) {
+    bool any = false;
+    for (const IrInst& inst : caller.code) {
+        if (qualifies(inst)) {
+            any = true;
+            break;
+        }
+    }
+    if (!any) return;
+
+    std::vector<Value> renumber(caller.code.size(), NO_VALUE);
+    std::vector<IrInst> code;
+    std::vector<bool> fromCaller;
+    std::vector<IrBlock> blocks;
+    std::vector<Value> args;
+    std::vector<Value> map;
+
+    for (const IrBlock& block : caller.blocks) {
+        uint32_t begin = static_cast<uint32_t>(code.size());
+        for (Value v = block.begin; v < block.end; v++) {
+            IrInst inst = caller.code[v];
+            if (!qualifies(inst)) {
+                if (inst.op == IrOp::CALL) {
+                    uint32_t first = static_cast<uint32_t>(args.size());
+                    args.insert(args.end(), caller.args.begin() + inst.a, caller.args.begin() + inst.a + inst.b);
+                    inst.a = first;
+                }
+                renumber[v] = static_cast<Value>(code.size());
+                code.push_back(inst);
+                fromCaller.push_back(true);
+                continue;
+            }
+
+            const IrFunction& callee = m_module->functions[static_cast<size_t>(m_index[inst.sym])];
+            map.assign(callee.code.size(), NO_VALUE);
+            Value result = NO_VALUE;
+            for (Value c = 0; c < callee.code.size(); c++) {
+                IrInst copy = callee.code[c];
+                switch (copy.op) {
+                case IrOp::PARAM:
+                    /* Arguments are defined before the call, so already have their new numbers */
+                    map[c] = renumber[caller.args[inst.a + static_cast<uint32_t>(copy.imm)]];
+                    continue;
+                case IrOp::RET:
+                    result = copy.a != NO_VALUE ? map[copy.a] : NO_VALUE;
+                    continue;
+                case IrOp::CALL: {
+                    uint32_t first = static_cast<uint32_t>(args.size());
+                    for (uint32_t i = 0; i < copy.b; i++) args.push_back(map[callee.args[copy.a + i]]);
+                    copy.a = first;
+                    break;
+                }
+                default:
+                    if (copy.a != NO_VALUE) copy.a = map[copy.a];
+                    if (copy.b != NO_VALUE) copy.b = map[copy.b];
+                    break;
+                }
+                map[c] = static_cast<Value>(code.size());
+                code.push_back(copy);
+                fromCaller.push_back(false);
+            }
+            if (result == NO_VALUE) {
+                /* `ret` without a value leaves R1 undefined, zero is as good as anything */
+                IrInst zero(IrOp::CONST);
+                result = static_cast<Value>(code.size());
+                code.push_back(zero);
+                fromCaller.push_back(false);
+            }
+            renumber[v] = result;
+            m_inlined++;
+        }
+        blocks.push_back({begin, static_cast<uint32_t>(code.size())});
+    }
+
+    caller.code = std::move(code);
+    caller.blocks = std::move(blocks);
+    caller.args = std::move(args);
+
+    /* Operands copied from the caller still carry its old numbers, blocks keep theirs */
+    for (size_t i = 0; i < caller.code.size(); i++) {
+        if (fromCaller[i]) caller.mapOperands(caller.code[i], [&](Value v) { return renumber[v]; });
+    }
+}
@@ -0,0 +1,469 @@
+#include "instruction.h"
+#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+#include "assembler.h"
+
+const char* registerName(uint8_t r) {
+    static const char* names[] = {"R0", "R1", "R2", "R3", "R4", "R5", "SP", "PC"};
+    return names[r];
+}
+
+static const char* mnemonic(Opcode op) {
+    switch (op) {
+    case Opcode::ADD:   return "ADD";
+    case Opcode::ADC:   return "ADC";
+    case Opcode::SUB:   return "SUB";
+    case Opcode::SBC:   return "SBC";
+    case Opcode::AND:   return "AND";
+    case Opcode::OR:    return "OR";
+    case Opcode::MOV:   return "MOV";
+    case Opcode::CMP:   return "CMP";
+    case Opcode::LD:    return "LD";
+    case Opcode::ST:    return "ST";
+    case Opcode::B:     return "B";
+    case Opcode::ORG:   return "ORG";
+    case Opcode::EQU:   return "EQU";
+    case Opcode::DATA:  return "DATA";
+    case Opcode::DEFW:  return "DEFW";
+    default:            return "";
+    }
+}
+
+static const char* shiftName(Shift shift) {
+    static const char* names[] = {"", "ASR", "ROR", "RRC"};
+    return names[static_cast<uint8_t>(shift)];
+}
+
+static const char* condition(Cond cond) {
+    static const char* names[] = {"", "NV", "HI", "LS", "CC", "CS", "NE", "EQ",
+                                  "VC", "VS", "PL", "MI", "GE", "LT", "GT", "LE"};
+    return names[static_cast<uint8_t>(cond)];
+}
+
+// =================================== Construction ===================================
+
+Instruction Instruction::alu(Opcode op, uint8_t rd, uint8_t ra, uint8_t rb) {
+    Instruction i;
+    i.op = op; i.mode = Mode::REG; i.rd = rd; i.ra = ra; i.rb = rb;
+    return i;
+}
+
+Instruction Instruction::aluImm(Opcode op, uint8_t rd, uint8_t ra, int32_t imm) {
+    Instruction i;
+    i.op = op; i.mode = Mode::IMM; i.rd = rd; i.ra = ra; i.imm = imm;
+    return i;
+}
+
+Instruction Instruction::shifted(Opcode op, uint8_t rd, uint8_t ra, uint8_t rb, Shift shift) {
+    Instruction i = alu(op, rd, ra, rb);
+    i.shift = shift;
+    return i;
+}
+
+Instruction Instruction::compare(uint8_t ra, uint8_t rb) {
+    return alu(Opcode::CMP, 0, ra, rb);
+}
+
+Instruction Instruction::move(uint8_t rd, uint8_t ra) {
+    return alu(Opcode::MOV, rd, ra, 0);
+}
+
+Instruction Instruction::moveImm(uint8_t rd, int32_t imm) {
+    return aluImm(Opcode::MOV, rd, 0, imm);
+}
+
+Instruction Instruction::memory(Opcode op, uint8_t rd, uint8_t ra, int32_t imm, Symbol symbol) {
+    Instruction i = aluImm(op, rd, ra, imm);
+    i.label = symbol;
+    return i;
+}
+
+Instruction Instruction::memoryReg(Opcode op, uint8_t rd, uint8_t ra, uint8_t rb) {
+    return alu(op, rd, ra, rb);
+}
+
+Instruction Instruction::memoryLabel(Opcode op, uint8_t rd, Symbol label) {
+    Instruction i;
+    i.op = op; i.mode = Mode::LABEL; i.rd = rd; i.label = label;
+    return i;
+}
+
+Instruction Instruction::branch(Cond cond, Symbol label, bool call) {
+    Instruction i;
+    i.op = Opcode::B; i.mode = Mode::LABEL; i.cond = cond; i.label = label; i.call = call;
+    return i;
+}
+
+Instruction Instruction::define(Symbol label) {
+    Instruction i;
+    i.op = Opcode::LABEL; i.label = label;
+    return i;
+}
+
+Instruction Instruction::word(Opcode op, int32_t value, Symbol label) {
+    Instruction i;
+    i.op = op; i.mode = label == NO_LABEL ? Mode::IMM : Mode::LABEL; i.imm = value; i.label = label;
+    return i;
+}
+
+// ===================================== Dataflow =====================================
+
+bool Instruction::reads(uint8_t r) const {
+    if (r == 0) return false;
+    switch (op) {
+    case Opcode::ADD: case Opcode::ADC: case Opcode::SUB: case Opcode::SBC:
+    case Opcode::AND: case Opcode::OR: case Opcode::MOV:
+        return ra == r || (mode == Mode::REG && op != Opcode::MOV && rb == r);
+    case Opcode::CMP:
+        return ra == r || (mode == Mode::REG && rb == r);
+    case Opcode::LD:
+        return mode != Mode::LABEL ? (ra == r || (mode == Mode::REG && rb == r)) : r == 7;
+    case Opcode::ST:
+        return rd == r || (mode != Mode::LABEL ? (ra == r || (mode == Mode::REG && rb == r)) : r == 7);
+    case Opcode::B:
+        return r == 7;
+    default:
+        return false;
+    }
+}
+
+bool Instruction::writes(uint8_t r) const {
+    if (r == 0) return false;
+    switch (op) {
+    case Opcode::ADD: case Opcode::ADC: case Opcode::SUB: case Opcode::SBC:
+    case Opcode::AND: case Opcode::OR: case Opcode::MOV: case Opcode::LD:
+        return rd == r;
+    case Opcode::B:
+        return r == 7;
+    default:
+        return false;
+    }
+}
+
+uint32_t Instruction::maxWords() const {
+    if (op == Opcode::B) return cond == Cond::AL ? 2 : 3;
+    return emitsWord() ? 1 : 0;
+}
+
+// ===================================== Linking ======================================
+
+void Listing::append(const Listing& other) {
+    std::vector<Symbol> to(other.names.size());
+    for (Symbol s = 0; s < other.names.size(); s++) {
+        to[s] = label(other.names.name(s));
+        if (other.isFunction(s)) {
+            if (functions.size() <= to[s]) functions.resize(to[s] + 1, false);
+            functions[to[s]] = true;
+        }
+    }
+    if (other.stack != NO_LABEL) stack = to[other.stack];
+    /* No exact reserve: appending many small listings would reallocate every time */
+    for (Instruction i : other.code) {
+        i.label = to[i.label];
+        code.push_back(i);
+    }
+}
+
+// ================================= Branch Relaxation =================================
+
+/* Every label defined once, by a LABEL or an EQU, and every one referred to defined somewhere */
+void Listing::checkLabels() const {
+    std::vector<bool> defined(names.size(), false);
+    for (const Instruction& i : code) {
+        if (i.op != Opcode::LABEL && i.op != Opcode::EQU) continue;
+        if (defined[i.label]) throw std::runtime_error("duplicate label " + std::string(names.name(i.label)));
+        defined[i.label] = true;
+    }
+    for (const Instruction& i : code) {
+        if (i.op == Opcode::LABEL || i.op == Opcode::EQU || i.op == Opcode::NOP || i.label == NO_LABEL) continue;
+        if (!defined[i.label]) throw std::runtime_error("undefined symbol " + std::string(names.name(i.label)));
+    }
+}
+
+/* Bcc's offset is 8 bits from PC + 1, a branch further than that becomes
+ *     LD PC, [PC]      PC reads as the address of the DEFW
+ *     DEFW target
+ * behind the inverted condition if it had one. A call's `ADD R1, PC, #k` return address
+ * grows by the extra word. Relaxing only pushes code apart, so it repeats until nothing
+ * else falls out of reach; returns how many branches were rewritten */
+uint32_t Listing::relax() {
+    checkLabels();
+    std::vector<bool> far(code.size(), false);
+    std::vector<int64_t> at(code.size(), 0);
+    std::vector<int64_t> address(names.size(), 0);
+    for (bool changed = true; changed;) {
+        changed = false;
+        int64_t pc = 0;
+        for (size_t n = 0; n < code.size(); n++) {
+            const Instruction& i = code[n];
+            if (i.op == Opcode::ORG) pc = i.imm;
+            if (i.op == Opcode::LABEL) address[i.label] = pc;
+            at[n] = pc;
+            pc += far[n] ? i.maxWords() : (i.emitsWord() ? 1 : 0);
+        }
+        for (size_t n = 0; n < code.size(); n++) {
+            if (code[n].op != Opcode::B || far[n]) continue;
+            int64_t offset = address[code[n].label] - (at[n] + 1);
+            if (offset < -128 || offset > 127) {
+                far[n] = true;
+                changed = true;
+            }
+        }
+    }
+
+    uint32_t relaxed = 0;
+    std::vector<Instruction> out;
+    out.reserve(code.size());
+    for (size_t n = 0; n < code.size(); n++) {
+        const Instruction& i = code[n];
+        if (!far[n]) {
+            out.push_back(i);
+            continue;
+        }
+        Symbol skip = NO_LABEL;
+        if (i.cond != Cond::AL) {
+            skip = label("__far" + std::to_string(relaxed));
+            out.push_back(Instruction::branch(static_cast<Cond>(static_cast<uint8_t>(i.cond) ^ 1), skip));
+        }
+        if (i.call) {
+            for (auto prev = out.rbegin(); prev != out.rend() && prev - out.rbegin() < 4; ++prev) {
+                if (prev->mode == Mode::IMM && prev->ra == 7 && prev->op == Opcode::ADD) {
+                    prev->imm++;
+                    break;
+                }
+            }
+        }
+        out.push_back(Instruction::memory(Opcode::LD, 7, 7, 0));
+        out.push_back(Instruction::word(Opcode::DEFW, 0, i.label));
+        if (skip != NO_LABEL) out.push_back(Instruction::define(skip));
+        relaxed++;
+    }
+    code = std::move(out);
+    return relaxed;
+}
+
+// ===================================== Printing =====================================
+
+void Listing::compact() {
+    code.erase(std::remove_if(code.begin(), code.end(),
+                              [](const Instruction& i) { return i.op == Opcode::NOP; }),
+               code.end());
+}
+
+/* Straight into one string reserved up front, numbers through to_chars, no stream state
+ * A line is rarely longer than PRINT_LINE bytes, the odd long label only costs a regrow */
+static constexpr size_t PRINT_LINE = 24;
+
+std::string Listing::print() const {
+    std::string out;
+    out.reserve(code.size() * PRINT_LINE);
+    auto put = [&](std::string_view text) { out.append(text); };
+    auto number = [&](int32_t value, int base = 10) {
+        char digits[16];
+        /* DATA shows the word's bits, hex of a negative value is its 32-bit two's complement */
+        std::to_chars_result end = base == 16 ? std::to_chars(digits, digits + sizeof(digits), static_cast<uint32_t>(value), 16)
+                                              : std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, static_cast<size_t>(end.ptr - digits));
+    };
+    auto operand = [&](const Instruction& i) {
+        if (i.mode == Mode::REG) {
+            put(registerName(i.rb));
+            if (i.shift != Shift::NONE) {
+                put(", ");
+                put(shiftName(i.shift));
+            }
+        } else if (i.label != NO_LABEL) {
+            out.push_back('#');
+            put(names.name(i.label));
+        } else {
+            out.push_back('#');
+            number(i.imm);
+        }
+    };
+
+    for (size_t n = 0; n < code.size(); n++) {
+        const Instruction& i = code[n];
+        switch (i.op) {
+        case Opcode::NOP:
+            continue;
+        case Opcode::LABEL:
+            /* Data gets its label on the same line, code labels stand alone */
+            if (n + 1 < code.size() && (code[n + 1].op == Opcode::DATA || code[n + 1].op == Opcode::DEFW)) {
+                put(names.name(i.label));
+                put("    ");
+                continue;
+            }
+            if (isFunction(i.label)) out.push_back('\n');
+            put(names.name(i.label));
+            put(":\n");
+            continue;
+        case Opcode::ORG:
+            put("ORG ");
+            number(i.imm);
+            out.push_back('\n');
+            continue;
+        case Opcode::EQU:
+            put(names.name(i.label));
+            put("    EQU    R");
+            number(i.rd);
+            out.push_back('\n');
+            continue;
+        case Opcode::DATA:
+            put("DATA    0x");
+            number(i.imm, 16);
+            out.push_back('\n');
+            continue;
+        case Opcode::DEFW:
+            put("DEFW    ");
+            if (i.mode == Mode::LABEL) put(names.name(i.label));
+            else number(i.imm);
+            out.push_back('\n');
+            continue;
+        case Opcode::B:
+            out.push_back('B');
+            put(condition(i.cond));
+            out.push_back(' ');
+            put(names.name(i.label));
+            out.push_back('\n');
+            continue;
+        case Opcode::LD:
+        case Opcode::ST:
+            put(mnemonic(i.op));
+            out.push_back(' ');
+            put(registerName(i.rd));
+            put(", ");
+            if (i.mode == Mode::LABEL) {
+                put(names.name(i.label));
+            } else if (i.mode == Mode::IMM && i.imm == 0 && i.label == NO_LABEL) {
+                out.push_back('[');
+                put(registerName(i.ra));
+                out.push_back(']');
+            } else {
+                out.push_back('[');
+                put(registerName(i.ra));
+                put(", ");
+                operand(i);
+                out.push_back(']');
+            }
+            out.push_back('\n');
+            continue;
+        case Opcode::MOV:
+            put("MOV ");
+            put(registerName(i.rd));
+            put(", ");
+            if (i.mode == Mode::REG) put(registerName(i.ra));
+            else operand(i);
+            out.push_back('\n');
+            continue;
+        case Opcode::CMP:
+            put("CMP ");
+            put(registerName(i.ra));
+            put(", ");
+            operand(i);
+            out.push_back('\n');
+            continue;
+        default:
+            put(mnemonic(i.op));
+            if (i.setFlags) out.push_back('S');
+            out.push_back(' ');
+            put(registerName(i.rd));
+            put(", ");
+            put(registerName(i.ra));
+            put(", ");
+            operand(i);
+            out.push_back('\n');
+            continue;
+        }
+    }
+    return out;
+}
+
+// ===================================== Encoding =====================================
+
+/* Two passes like the text assembler: label addresses first, since branches and literal
+ * loads refer forward, then every word. Register EQUs only name registers already resolved */
+Image Listing::assemble() const {
+    checkLabels();
+    std::vector<int64_t> address(names.size(), 0);
+    int64_t pc = 0;
+    for (const Instruction& i : code) {
+        if (i.op == Opcode::ORG) pc = i.imm;
+        if (i.op == Opcode::LABEL) address[i.label] = pc;
+        if (i.emitsWord()) pc++;
+    }
+
+    Image image;
+    auto fail = [&](const Instruction& i, const std::string& message) {
+        throw std::runtime_error(std::string(mnemonic(i.op)) + " " + message);
+    };
+    auto imm5 = [&](const Instruction& i, int64_t value) {
+        if (value < -16 || value > 15) fail(i, "immediate " + std::to_string(value) + " doesn't fit in 5 bits");
+        return static_cast<int32_t>(value);
+    };
+    auto value = [&](const Instruction& i) { return i.label != NO_LABEL ? address[i.label] : i.imm; };
+    auto put = [&](int64_t at, uint16_t word, bool instruction) {
+        if (at < 0 || at >= Image::WORDS) throw std::runtime_error("program runs past the end of memory");
+        image.memory[at] = word;
+        image.used[at] = true;
+        image.code[at] = instruction;
+        image.words++;
+    };
+
+    pc = 0;
+    for (const Instruction& i : code) {
+        uint8_t shift = static_cast<uint8_t>(i.shift);
+        switch (i.op) {
+        case Opcode::NOP:
+        case Opcode::EQU:
+            continue;
+        case Opcode::ORG:
+            pc = i.imm;
+            continue;
+        case Opcode::LABEL:
+            image.labels.push_back({static_cast<uint16_t>(pc), std::string(names.name(i.label))});
+            continue;
+        case Opcode::DATA:
+        case Opcode::DEFW:
+            put(pc, static_cast<uint16_t>(value(i)), false);
+            break;
+        case Opcode::MOV:
+            if (i.mode == Mode::REG) put(pc, stump::aluReg(stump::ADD, i.setFlags, i.rd, i.ra, 0, shift), true);
+            else put(pc, stump::aluImm(stump::ADD, i.setFlags, i.rd, 0, imm5(i, value(i))), true);
+            break;
+        case Opcode::CMP:
+            if (i.mode == Mode::REG) put(pc, stump::aluReg(stump::SUB, true, 0, i.ra, i.rb, stump::NO_SHIFT), true);
+            else put(pc, stump::aluImm(stump::SUB, true, 0, i.ra, imm5(i, value(i))), true);
+            break;
+        case Opcode::LD:
+        case Opcode::ST: {
+            bool store = i.op == Opcode::ST;
+            if (i.mode == Mode::REG) {
+                put(pc, stump::memReg(store, i.rd, i.ra, i.rb), true);
+            } else if (i.mode == Mode::LABEL) {
+                /* PC-relative, PC reads as the next address */
+                put(pc, stump::memImm(store, i.rd, 7, imm5(i, address[i.label] - (pc + 1))), true);
+            } else {
+                put(pc, stump::memImm(store, i.rd, i.ra, imm5(i, value(i))), true);
+            }
+            break;
+        }
+        case Opcode::B: {
+            int64_t offset = address[i.label] - (pc + 1);
+            if (offset < -128 || offset > 127) fail(i, "to " + std::string(names.name(i.label)) + " is out of range");
+            put(pc, stump::branch(static_cast<uint8_t>(i.cond), static_cast<int32_t>(offset)), true);
+            break;
+        }
+        default: {
+            /* ADD..OR share their opcode numbering with the encoding */
+            uint8_t op = static_cast<uint8_t>(i.op);
+            if (i.mode == Mode::REG) put(pc, stump::aluReg(op, i.setFlags, i.rd, i.ra, i.rb, shift), true);
+            else put(pc, stump::aluImm(op, i.setFlags, i.rd, i.ra, imm5(i, value(i))), true);
+            break;
+        }
+        }
+        pc++;
+    }
+    std::sort(image.labels.begin(), image.labels.end());
+    return image;
+}
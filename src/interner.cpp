@@ -0,0 +1,49 @@
+#include "interner.h"
+
+Interner::Interner()
+    : m_offsets{0}, m_table(256, EMPTY) {}
+
+Symbol Interner::intern(std::string_view text) {
+    uint32_t h = hash(text);
+    size_t mask = m_table.size() - 1;
+
+    /* Linear probing until the spelling or an empty slot turns up */
+    for (size_t slot = h & mask;; slot = (slot + 1) & mask) {
+        Symbol candidate = m_table[slot];
+        if (candidate == EMPTY) {
+            Symbol symbol = static_cast<Symbol>(size());
+            m_pool.append(text);
+            m_offsets.push_back(static_cast<uint32_t>(m_pool.size()));
+            m_hashes.push_back(h);
+            m_table[slot] = symbol;
+
+            /* Keeping load under 1/2 */
+            if (size() * 2 > m_table.size()) rehash();
+            return symbol;
+        }
+        if (m_hashes[candidate] == h && name(candidate) == text) {
+            return candidate;
+        }
+    }
+}
+
+uint32_t Interner::hash(std::string_view text) {
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    for (char c : text) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void Interner::rehash() {
+    std::vector<Symbol> table(m_table.size() * 2, EMPTY);
+    size_t mask = table.size() - 1;
+    for (Symbol symbol = 0; symbol < size(); symbol++) {
+        size_t slot = m_hashes[symbol] & mask;
+        while (table[slot] != EMPTY) slot = (slot + 1) & mask;
+        table[slot] = symbol;
+    }
+    m_table.swap(table);
+}
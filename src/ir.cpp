@@ -0,0 +1,177 @@
+#include "ir.h"
+#include <algorithm>
+#include <sstream>
+
+void IrFunction::compact(const std::vector<bool>& keep) {
+    std::vector<Value> renumber(code.size(), NO_VALUE);
+    std::vector<uint32_t> renumberBlock(blocks.size(), UINT32_MAX);
+    std::vector<IrInst> kept;
+    std::vector<IrBlock> keptBlocks;
+    std::vector<Value> keptArgs;
+    std::vector<IrIncoming> keptIncoming;
+    kept.reserve(code.size());
+
+    for (uint32_t b = 0; b < blocks.size(); b++) {
+        uint32_t begin = static_cast<uint32_t>(kept.size());
+        for (Value v = blocks[b].begin; v < blocks[b].end; v++) {
+            if (!keep[v]) continue;
+            IrInst inst = code[v];
+            if (inst.op == IrOp::CALL) {
+                uint32_t first = static_cast<uint32_t>(keptArgs.size());
+                keptArgs.insert(keptArgs.end(), args.begin() + inst.a, args.begin() + inst.a + inst.b);
+                inst.a = first;
+            } else if (inst.op == IrOp::PHI) {
+                uint32_t first = static_cast<uint32_t>(keptIncoming.size());
+                keptIncoming.insert(keptIncoming.end(), incoming.begin() + inst.a, incoming.begin() + inst.a + inst.b);
+                inst.a = first;
+            }
+            renumber[v] = static_cast<Value>(kept.size());
+            kept.push_back(inst);
+        }
+        uint32_t end = static_cast<uint32_t>(kept.size());
+        if (end > begin) {
+            renumberBlock[b] = static_cast<uint32_t>(keptBlocks.size());
+            keptBlocks.push_back({begin, end});
+        }
+    }
+
+    code = std::move(kept);
+    blocks = std::move(keptBlocks);
+    args = std::move(keptArgs);
+    incoming = std::move(keptIncoming);
+
+    /* Operands can refer forward through phis, so they are renumbered once everything has its place */
+    for (IrInst& inst : code) {
+        mapOperands(inst, [&](Value v) { return renumber[v]; });
+        if (inst.op == IrOp::JMP || inst.op == IrOp::BR) inst.target = renumberBlock[inst.target];
+        if (inst.op == IrOp::BR) inst.b = renumberBlock[inst.b];
+        if (inst.op == IrOp::PHI) {
+            auto first = incoming.begin() + inst.a;
+            auto last = std::remove_if(first, first + inst.b, [&](const IrIncoming& in) {
+                return renumberBlock[in.block] == UINT32_MAX;
+            });
+            for (auto in = first; in != last; ++in) in->block = renumberBlock[in->block];
+            inst.b = static_cast<uint32_t>(last - first);
+        }
+    }
+}
+
+void IrModule::rename(const std::vector<Symbol>& to) {
+    for (IrGlobal& global : globals) global.name = to[global.name];
+    for (IrFunction& func : functions) {
+        func.name = to[func.name];
+        for (Symbol& parameter : func.parameters) parameter = to[parameter];
+        for (IrInst& inst : func.code) {
+            if (inst.op == IrOp::LOAD || inst.op == IrOp::STORE || inst.op == IrOp::CALL) inst.sym = to[inst.sym];
+        }
+    }
+}
+
+static const char* opName(IrOp op) {
+    switch (op) {
+    case IrOp::CONST: return "const";
+    case IrOp::PARAM: return "param";
+    case IrOp::LOAD:  return "load";
+    case IrOp::STORE: return "store";
+    case IrOp::ADD:   return "add";
+    case IrOp::SUB:   return "sub";
+    case IrOp::MUL:   return "mul";
+    case IrOp::DIV:   return "div";
+    case IrOp::EQ:    return "eq";
+    case IrOp::NE:    return "ne";
+    case IrOp::LT:    return "lt";
+    case IrOp::LE:    return "le";
+    case IrOp::GT:    return "gt";
+    case IrOp::GE:    return "ge";
+    case IrOp::CALL:  return "call";
+    case IrOp::PHI:   return "phi";
+    case IrOp::RET:   return "ret";
+    case IrOp::JMP:   return "jmp";
+    case IrOp::BR:    return "br";
+    }
+    return "";
+}
+
+/*  global g = 3
+ *
+ *  fn f(a) {
+ *  b0:
+ *      %0 = param a
+ *      %1 = const 2
+ *      %2 = mul %0, %1
+ *      %3 = call g(%2, %0)
+ *      store g, %3
+ *      %4 = lt %3, %1
+ *      br %4, b1, b2
+ *  b1:
+ *      ...
+ *  b2:
+ *      %9 = phi [b0: %3], [b1: %7]
+ *      ret %9
+ *  } */
+std::string IrModule::print(const Interner& interner) const {
+    std::ostringstream out;
+    for (const IrGlobal& global : globals) {
+        out << "global " << interner.name(global.name) << " = " << global.initial << "\n";
+    }
+
+    for (const IrFunction& func : functions) {
+        out << "\nfn " << interner.name(func.name) << "(";
+        for (size_t i = 0; i < func.parameters.size(); i++) {
+            out << (i > 0 ? ", " : "") << interner.name(func.parameters[i]);
+        }
+        out << (func.pure ? ") effects [] {\n" : ") {\n");
+
+        for (size_t b = 0; b < func.blocks.size(); b++) {
+            out << "b" << b << ":\n";
+            for (uint32_t v = func.blocks[b].begin; v < func.blocks[b].end; v++) {
+                const IrInst& inst = func.code[v];
+                out << "    ";
+                if (inst.definesValue()) out << "%" << v << " = ";
+                out << opName(inst.op);
+                switch (inst.op) {
+                case IrOp::CONST:
+                    out << " " << inst.imm;
+                    break;
+                case IrOp::PARAM:
+                    out << " " << interner.name(func.parameters[static_cast<size_t>(inst.imm)]);
+                    break;
+                case IrOp::LOAD:
+                    out << " " << interner.name(inst.sym);
+                    break;
+                case IrOp::STORE:
+                    out << " " << interner.name(inst.sym) << ", %" << inst.a;
+                    break;
+                case IrOp::CALL:
+                    out << " " << interner.name(inst.sym) << "(";
+                    for (uint32_t i = 0; i < inst.b; i++) {
+                        out << (i > 0 ? ", %" : "%") << func.args[inst.a + i];
+                    }
+                    out << ")";
+                    break;
+                case IrOp::PHI:
+                    for (uint32_t i = 0; i < inst.b; i++) {
+                        const IrIncoming& in = func.incoming[inst.a + i];
+                        out << (i > 0 ? ", [b" : " [b") << in.block << ": %" << in.value << "]";
+                    }
+                    break;
+                case IrOp::RET:
+                    if (inst.a != NO_VALUE) out << " %" << inst.a;
+                    break;
+                case IrOp::JMP:
+                    out << " b" << inst.target;
+                    break;
+                case IrOp::BR:
+                    out << " %" << inst.a << ", b" << inst.target << ", b" << inst.b;
+                    break;
+                default:
+                    out << " %" << inst.a << ", %" << inst.b;
+                    break;
+                }
+                out << "\n";
+            }
+        }
+        out << "}\n";
+    }
+    return out.str();
+}
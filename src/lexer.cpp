@@ -1,146 +1,319 @@
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <iostream>
-#include <fstream>
-#include <unordered_map>
 
 #include "lexer.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-Lexer::Lexer(std::string& src) 
-    : m_src(std::move(src)), m_idx(0) {}
+// ================================ Character Classes ================================
+
+/* One table lookup per character instead of the locale-aware <cctype> calls,
+ * SPACE is what std::isspace accepts in the C locale */
+enum CharClass : uint8_t {
+    SPACE = 1,
+    DIGIT = 2,
+    ALPHA = 4,
+    WORD = DIGIT | ALPHA,
+};
+
+struct ClassTable {
+    uint8_t of[256] = {};
+
+    constexpr ClassTable() {
+        for (int c = '\t'; c <= '\r'; c++) of[c] = SPACE;
+        of[static_cast<unsigned char>(' ')] = SPACE;
+        for (int c = '0'; c <= '9'; c++) of[c] = DIGIT;
+        for (int c = 'a'; c <= 'z'; c++) of[c] = ALPHA;
+        for (int c = 'A'; c <= 'Z'; c++) of[c] = ALPHA;
+    }
+};
+
+static constexpr ClassTable CLASSES;
+
+static inline bool is(char c, uint8_t classes) {
+    return (CLASSES.of[static_cast<unsigned char>(c)] & classes) != 0;
+}
+
+/* Keywords by length then first character, so most identifiers are turned away after
+ * one or two compares and none go through a hash */
+static bool keyword(std::string_view text, TokenType& type) {
+    auto match = [&](const char* word, TokenType t) {
+        if (std::memcmp(text.data(), word, text.size()) != 0) return false;
+        type = t;
+        return true;
+    };
+    switch (text.size()) {
+    case 2:
+        if (text[0] == 'f') return match("fn", TokenType::FUNCTION);
+        if (text[0] == 'i') return match("if", TokenType::IF);
+        return false;
+    case 3:
+        return text[0] == 'i' && match("int", TokenType::INT);
+    case 4:
+        if (text[0] == 'e') return match("else", TokenType::ELSE);
+        if (text[0] == 'b') return match("bool", TokenType::BOOL);
+        if (text[0] == 't') return match("true", TokenType::TRUE);
+        return false;
+    case 5:
+        if (text[0] == 'w') return match("while", TokenType::WHILE);
+        if (text[0] == 'f') return match("false", TokenType::FALSE);
+        if (text[0] == 'b') return match("break", TokenType::BREAK);
+        return false;
+    case 6:
+        return text[0] == 'r' && match("return", TokenType::RETURN);
+    case 7:
+        return text[0] == 'e' && match("effects", TokenType::EFFECTS);
+    case 8:
+        return text[0] == 'c' && match("continue", TokenType::CONTINUE);
+    default:
+        return false;
+    }
+}
+
+// ====================================== Lexer ======================================
+
+Lexer::Lexer(std::string_view src, Interner& interner)
+    : m_src(src), m_interner(interner), m_idx(0) {}
 
 std::vector<Token> Lexer::tokenise() {
     std::vector<Token> tokens;
-    std::string buffer;
+    do {
+        tokens.push_back(next());
+    } while (tokens.back().type != TokenType::END_OF_FILE);
+
+    m_idx = 0;
+    m_line = 1;
+    m_lineStart = 0;
+    return tokens;
+}
+
+/* 16 bytes at a time while a whole block is left, the mapped source may end at a page
+ * boundary so the tail goes one byte at a time */
+void Lexer::skipSpace() {
+    const char* src = m_src.data();
+    size_t size = m_src.size();
+#ifdef __SSE2__
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i controls = _mm_set1_epi8('\r' - '\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (m_idx + 16 <= size) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + m_idx));
+        /* \t..\r as one unsigned range: c - '\t' <= '\r' - '\t' */
+        __m128i offset = _mm_sub_epi8(block, tab);
+        __m128i inRange = _mm_cmpeq_epi8(_mm_min_epu8(offset, controls), offset);
+        __m128i blank = _mm_or_si128(inRange, _mm_cmpeq_epi8(block, space));
+        uint32_t blanks = static_cast<uint32_t>(_mm_movemask_epi8(blank));
+        uint32_t newlines = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        /* Length of the whitespace run from the start of the block */
+        uint32_t run = blanks == 0xFFFF ? 16 : static_cast<uint32_t>(__builtin_ctz(~blanks));
+        newlines &= (1u << run) - 1;
+        if (newlines) {
+            m_line += static_cast<uint32_t>(__builtin_popcount(newlines));
+            m_lineStart = m_idx + static_cast<size_t>(31 - __builtin_clz(newlines)) + 1;
+        }
+        m_idx += run;
+        if (run < 16) return;
+    }
+#endif
+    while (m_idx < size && is(src[m_idx], SPACE)) {
+        if (src[m_idx] == '\n') {
+            m_line++;
+            m_lineStart = m_idx + 1;
+        }
+        m_idx++;
+    }
+}
+
+void Lexer::skipComment() {
+    const char* src = m_src.data();
+    size_t size = m_src.size();
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (m_idx + 16 <= size) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + m_idx));
+        uint32_t newlines = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        if (newlines) {
+            m_idx += static_cast<size_t>(__builtin_ctz(newlines));
+            return;
+        }
+        m_idx += 16;
+    }
+#endif
+    while (m_idx < size && src[m_idx] != '\n') m_idx++;
+}
 
-    while (peek().has_value()) {
+Token Lexer::next() {
+    const char* src = m_src.data();
+    size_t size = m_src.size();
+    while (m_idx < size) {
+        char c = src[m_idx];
 
-        /* SKIP WHITESPACE */
-        if (std::isspace(peek().value())) consume();
+        /* SKIP WHITESPACE, the lone space between tokens without the vector scan */
+        if (is(c, SPACE)) {
+            if (c == ' ' && m_idx + 1 < size && !is(src[m_idx + 1], SPACE)) m_idx++;
+            else skipSpace();
+            continue;
+        }
 
         /* SKIP COMMENTS */
-        else if (peek().value() == '/' && peek(1).has_value() && peek(1).value() == '/') {
-            while (peek().has_value() && peek().value() != '\n') {
-                consume();
-            }
+        if (c == '/' && m_idx + 1 < size && src[m_idx + 1] == '/') {
+            skipComment();
+            continue;
         }
-            
-        /* INT_LIT */
-        else if (std::isdigit(peek().value())) {
-            buffer.push_back(consume());
-            while (peek().has_value() && std::isdigit(peek().value())) {
-                buffer.push_back(consume());
-            }
-            if (std::isspace(peek().value()) || peek().value() == ';') {
-                tokens.push_back({.type = TokenType::INT_LIT, .value = buffer});
-                buffer.clear();
-            } else {
-                std::cerr << "invalid integer" << std::endl;
-                exit(EXIT_FAILURE);
+
+        size_t start = m_idx;
+        uint32_t line = m_line;
+        uint32_t column = static_cast<uint32_t>(m_idx - m_lineStart) + 1;
+
+        /* INT_LIT, one running straight into letters is a single INVALID token */
+        if (is(c, DIGIT)) {
+            do m_idx++; while (m_idx < size && is(src[m_idx], DIGIT));
+            if (m_idx == size || !is(src[m_idx], ALPHA)) {
+                return make(TokenType::INT_LIT, start, line, column);
             }
+            do m_idx++; while (m_idx < size && is(src[m_idx], WORD));
+            return make(TokenType::INVALID, start, line, column);
         }
 
         /* TEXT-BASED TOKENS */
-        else if (std::isalpha(peek().value())) {
-            buffer.push_back(consume());
-            while (peek().has_value() && std::isalnum(peek().value())) {
-                buffer.push_back(consume());
-            }
+        if (is(c, ALPHA)) {
+            do m_idx++; while (m_idx < size && is(src[m_idx], WORD));
 
-            static const std::unordered_map<std::string, TokenType> text_tokens = {
-                {"return", TokenType::RETURN},
-                {"if", TokenType::IF},
-                {"while", TokenType::WHILE},
-                {"else", TokenType::ELSE},
-                {"fn", TokenType::FUNCTION},
-                {"int", TokenType::INT},
-                {"bool", TokenType::BOOL},
-                {"true", TokenType::TRUE},
-                {"false", TokenType::FALSE},
-                {"effects", TokenType::EFFECTS}
-            };
-
-            auto text_token = text_tokens.find(buffer);
-            if (text_token != text_tokens.end()) {
-                tokens.push_back({.type = text_token->second});
+            std::string_view text = m_src.substr(start, m_idx - start);
+            TokenType type;
+            if (keyword(text, type)) {
+                return make(type, start, line, column);
             } else {
-                tokens.push_back({.type = TokenType::IDENTIFIER, .value = buffer});
+                Token identifier = make(TokenType::IDENTIFIER, start, line, column);
+                identifier.symbol = m_interner.intern(text);
+                return identifier;
             }
-            buffer.clear();
         }
 
-        /* SINGLE CHARACTER TOKENS */
-        else {
-            char c = peek().value();
-            switch(c) {
-                case ';': tokens.push_back({.type = TokenType::SEMI}); break;
-                case '(': tokens.push_back({.type = TokenType::LBRACKET}); break;
-                case ')': tokens.push_back({.type = TokenType::RBRACKET}); break;
-                case '{': tokens.push_back({.type = TokenType::LBRACE}); break;
-                case '}': tokens.push_back({.type = TokenType::RBRACE}); break;
-                case ',': tokens.push_back({.type = TokenType::COMMA}); break;
-                case '[': tokens.push_back({.type = TokenType::LSQUARE}); break;
-                case ']': tokens.push_back({.type = TokenType::RSQUARE}); break;
-                case '.': tokens.push_back({.type = TokenType::DOT}); break;
-                case '+': tokens.push_back({.type = TokenType::PLUS}); break;
-                case '-':
-                    if (peek(1).has_value() && peek(1).value() == '>') {
-                        consume();
-                        tokens.push_back({.type = TokenType::ARROW});
-                    } else {
-                        tokens.push_back({.type = TokenType::MINUS});
-                    }
-                    break;
-                case '*': tokens.push_back({.type = TokenType::MULTIPLY}); break;
-                case '/': tokens.push_back({.type = TokenType::DIVIDE}); break;
-                case '&': tokens.push_back({.type = TokenType::BIT_AND}); break;
-                case '|': tokens.push_back({.type = TokenType::BIT_OR}); break;
-                case '=':
-                    if (peek(1).has_value() && peek(1).value() == '=') {
-                        consume();
-                        tokens.push_back({.type = TokenType::EQUALS});
-                    } else {
-                        tokens.push_back({.type = TokenType::ASSIGN});
-                    }
-                    break;
-                case '<':
-                    if (peek(1).has_value() && peek(1).value() == '=') {
-                        consume();
-                        tokens.push_back({.type = TokenType::LESS_EQUAL});
-                    } else {
-                        tokens.push_back({.type = TokenType::LESS});
-                    }
-                    break;
-                case '>':
-                    if (peek(1).has_value() && peek(1).value() == '=') {
-                        consume();
-                        tokens.push_back({.type = TokenType::GREATER_EQUAL});
-                    } else {
-                        tokens.push_back({.type = TokenType::GREATER});
-                    }
-                    break;
-                default:
-                    std::cerr << "invalid character" << std::endl;
-                    tokens.push_back({.type = TokenType::INVALID}); 
-                    break;
-            }
-            consume();
+        /* SINGLE CHARACTER TOKENS, and the two character ones they start */
+        char following = m_idx + 1 < size ? src[m_idx + 1] : '\0';
+        TokenType type;
+        switch(c) {
+            case ';': type = TokenType::SEMI; break;
+            case '(': type = TokenType::LBRACKET; break;
+            case ')': type = TokenType::RBRACKET; break;
+            case '{': type = TokenType::LBRACE; break;
+            case '}': type = TokenType::RBRACE; break;
+            case ',': type = TokenType::COMMA; break;
+            case '[': type = TokenType::LSQUARE; break;
+            case ']': type = TokenType::RSQUARE; break;
+            case '.': type = TokenType::DOT; break;
+            case '+': type = TokenType::PLUS; break;
+            case '-':
+                if (following == '>') {
+                    m_idx++;
+                    type = TokenType::ARROW;
+                } else {
+                    type = TokenType::MINUS;
+                }
+                break;
+            case '*': type = TokenType::MULTIPLY; break;
+            case '/': type = TokenType::DIVIDE; break;
+            case '&': type = TokenType::BIT_AND; break;
+            case '|': type = TokenType::BIT_OR; break;
+            case '=':
+                if (following == '=') {
+                    m_idx++;
+                    type = TokenType::EQUALS;
+                } else {
+                    type = TokenType::ASSIGN;
+                }
+                break;
+            case '!':
+                if (following == '=') {
+                    m_idx++;
+                    type = TokenType::NOT_EQUALS;
+                } else {
+                    type = TokenType::NOT;
+                }
+                break;
+            case '<':
+                if (following == '=') {
+                    m_idx++;
+                    type = TokenType::LESS_EQUAL;
+                } else {
+                    type = TokenType::LESS;
+                }
+                break;
+            case '>':
+                if (following == '=') {
+                    m_idx++;
+                    type = TokenType::GREATER_EQUAL;
+                } else {
+                    type = TokenType::GREATER;
+                }
+                break;
+            default:
+                type = TokenType::INVALID;
+                break;
         }
+        m_idx++;
+        return make(type, start, line, column);
     }
-    m_idx = 0;
-    buffer.clear();
-    tokens.push_back({.type = TokenType::END_OF_FILE});
-    return tokens;
+    return make(TokenType::END_OF_FILE, m_idx, m_line, static_cast<uint32_t>(m_idx - m_lineStart) + 1);
 }
 
-std::optional<char> Lexer::peek(int ahead) const {
-    if (m_idx + ahead >= m_src.length()) {
-        return {};
-    } 
-    return m_src.at(m_idx + ahead);    
+const char* spelling(TokenType type) {
+    switch (type) {
+    case TokenType::FUNCTION:       return "fn";
+    case TokenType::WHILE:          return "while";
+    case TokenType::IF:             return "if";
+    case TokenType::ELSE:           return "else";
+    case TokenType::RETURN:         return "return";
+    case TokenType::BREAK:          return "break";
+    case TokenType::CONTINUE:       return "continue";
+    case TokenType::INT:            return "int";
+    case TokenType::BOOL:           return "bool";
+    case TokenType::INT_LIT:        return "an integer";
+    case TokenType::TRUE:           return "true";
+    case TokenType::FALSE:          return "false";
+    case TokenType::IDENTIFIER:     return "a name";
+    case TokenType::PLUS:           return "+";
+    case TokenType::MINUS:          return "-";
+    case TokenType::MULTIPLY:       return "*";
+    case TokenType::DIVIDE:         return "/";
+    case TokenType::ASSIGN:         return "=";
+    case TokenType::EQUALS:         return "==";
+    case TokenType::NOT_EQUALS:     return "!=";
+    case TokenType::LESS:           return "<";
+    case TokenType::GREATER:        return ">";
+    case TokenType::LESS_EQUAL:     return "<=";
+    case TokenType::GREATER_EQUAL:  return ">=";
+    case TokenType::AND:            return "&&";
+    case TokenType::OR:             return "||";
+    case TokenType::NOT:            return "!";
+    case TokenType::BIT_AND:        return "&";
+    case TokenType::BIT_OR:         return "|";
+    case TokenType::BIT_XOR:        return "^";
+    case TokenType::BIT_NOT:        return "~";
+    case TokenType::LBRACKET:       return "(";
+    case TokenType::RBRACKET:       return ")";
+    case TokenType::LBRACE:         return "{";
+    case TokenType::RBRACE:         return "}";
+    case TokenType::LSQUARE:        return "[";
+    case TokenType::RSQUARE:        return "]";
+    case TokenType::SEMI:           return ";";
+    case TokenType::COMMA:          return ",";
+    case TokenType::DOT:            return ".";
+    case TokenType::ARROW:          return "->";
+    case TokenType::EFFECTS:        return "effects";
+    case TokenType::END_OF_FILE:    return "the end of the file";
+    case TokenType::INVALID:        return "an invalid token";
+    case TokenType::NEGATE:         return "-";
+    }
+    return "";
 }
 
-char Lexer::consume() {
-    return m_src.at(m_idx++);
-}
\ No newline at end of file
+Token Lexer::make(TokenType type, size_t start, uint32_t line, uint32_t column) const {
+    return {type, 0, static_cast<uint32_t>(start), static_cast<uint32_t>(m_idx - start), line, column};
+}
@@ -0,0 +1,27 @@
+#include "linker.h"
+#include <algorithm>
+#include <stdexcept>
+
+Linker::Linker(const Interner& interner)
+    : m_interner(interner) {}
+
+IrModule Linker::merge(std::vector<IrModule>& modules) {
+    IrModule program;
+    for (IrModule& module : modules) {
+        for (IrGlobal& global : module.globals) program.globals.push_back(global);
+        for (IrFunction& func : module.functions) program.functions.push_back(std::move(func));
+    }
+    modules.clear();
+
+    auto main = std::find_if(program.functions.begin(), program.functions.end(),
+                             [&](const IrFunction& func) { return m_interner.name(func.name) == "main"; });
+    if (main == program.functions.end()) throw std::runtime_error("no main function, the program has nowhere to start");
+    std::rotate(program.functions.begin(), main, main + 1);
+    return program;
+}
+
+Listing Linker::link(Listing header, const std::vector<Listing>& pieces, const Listing& runtime) {
+    for (const Listing& piece : pieces) header.append(piece);
+    header.append(runtime);
+    return header;
+}
@@ -0,0 +1,434 @@
+#include "lower.h"
+#include <algorithm>
+#include <stdexcept>
+
+/* Initialisers that are already a single literal become the global's initial value */
+static bool isLiteral(const NodeArithmetic& rpn) {
+    return rpn.reversepolish.size == 1 &&
+           (rpn.reversepolish[0].kind == ExprKind::INTEGER || rpn.reversepolish[0].kind == ExprKind::BOOLEAN);
+}
+
+static std::string arguments(int32_t count) {
+    return std::to_string(count) + (count == 1 ? " argument" : " arguments");
+}
+
+Lowering::Lowering(const Interner& interner, Diagnostics* diagnostics, uint32_t file)
+    : m_interner(interner), m_diagnostics(diagnostics), m_file(file) {}
+
+IrModule Lowering::lower(const NodeProgram& program, const std::vector<Symbol>& externals,
+                         const std::vector<std::pair<Symbol, uint32_t>>& functions) {
+    m_program = &program;
+    m_errors = 0;
+    m_global.assign(m_interner.size(), false);
+    m_binding.assign(m_interner.size(), NO_VALUE);
+    m_parameters.assign(m_interner.size(), -1);
+    for (Symbol name : externals) m_global[name] = true;
+    for (const auto& function : functions) m_parameters[function.first] = static_cast<int32_t>(function.second);
+    for (const NodeFunction& func : program.functions) m_parameters[func.name] = static_cast<int32_t>(func.parameters.size);
+
+    IrModule module;
+    bool hasMain = std::any_of(program.functions.begin(), program.functions.end(),
+                               [&](const NodeFunction& func) { return m_interner.name(func.name) == "main"; });
+    for (const NodeStatement& global : program.globals) {
+        m_global[global.name] = true;
+        if (!isLiteral(global.rpn) && !hasMain) {
+            error(global.line, global.column, "global " + std::string(m_interner.name(global.name)) +
+                                              " needs a constant initialiser, only main's module runs the others");
+        }
+        module.globals.push_back({global.name, isLiteral(global.rpn) ? global.rpn.reversepolish[0].value : 0});
+    }
+    module.functions.reserve(program.functions.size);
+    for (const NodeFunction& func : program.functions) {
+        module.functions.push_back({func.name, {}, {}, {}, {}, {}, func.pure});
+        m_function = &module.functions.back();
+        lowerFunction(func);
+    }
+    return module;
+}
+
+void Lowering::lowerFunction(const NodeFunction& func) {
+    m_function->blocks.push_back({0, 0});
+    m_live = true;
+    for (uint32_t i = 0; i < func.parameters.size; i++) {
+        IrInst param(IrOp::PARAM);
+        param.imm = static_cast<int32_t>(i);
+        m_function->parameters.push_back(func.parameters[i]);
+        bind(func.parameters[i], append(param));
+    }
+
+    if (m_interner.name(func.name) == "main") {
+        for (const NodeStatement& global : m_program->globals) {
+            if (!isLiteral(global.rpn)) global.accept(*this);
+        }
+    }
+    lowerBody(func.body);
+
+    /* Falling off the end returns, an empty trailing block nothing branches to (after a return) is dropped */
+    uint32_t lastBlock = currentBlock();
+    IrBlock& last = m_function->blocks.back();
+    last.end = static_cast<uint32_t>(m_function->code.size());
+    bool targeted = std::any_of(m_function->code.begin(), m_function->code.end(), [&](const IrInst& inst) {
+        return (inst.op == IrOp::JMP || inst.op == IrOp::BR) && (inst.target == lastBlock || (inst.op == IrOp::BR && inst.b == lastBlock));
+    });
+    if (last.begin == last.end && lastBlock > 0 && !targeted) {
+        m_function->blocks.pop_back();
+    } else if (last.begin == last.end || !m_function->code.back().isTerminator()) {
+        append(IrInst(IrOp::RET));
+        m_function->blocks.back().end++;
+    }
+
+    for (Symbol symbol : m_touched) m_binding[symbol] = NO_VALUE;
+    m_touched.clear();
+}
+
+/* Declarations last until the end of the body, shadowed names get their old binding back */
+void Lowering::lowerBody(const NodeBody& body) {
+    size_t scope = m_scope.size();
+    for (const NodeStatement& stmt : body.statements) {
+        stmt.accept(*this);
+    }
+    while (m_scope.size() > scope) {
+        m_binding[m_scope.back().first] = m_scope.back().second;
+        m_scope.pop_back();
+    }
+}
+
+Value Lowering::lowerCondition(const NodeArithmetic& condition) {
+    condition.accept(*this);
+    Value value = m_stack.back();
+    m_stack.pop_back();
+    return value;
+}
+
+Value Lowering::append(const IrInst& inst) {
+    m_function->code.push_back(inst);
+    return static_cast<Value>(m_function->code.size() - 1);
+}
+
+uint32_t Lowering::currentBlock() const {
+    return static_cast<uint32_t>(m_function->blocks.size() - 1);
+}
+
+/* Closes the current block at a terminator, whatever follows starts the next */
+void Lowering::endBlock() {
+    uint32_t end = static_cast<uint32_t>(m_function->code.size());
+    m_function->blocks.back().end = end;
+    m_function->blocks.push_back({end, end});
+}
+
+Value Lowering::phi(const std::vector<IrIncoming>& incoming) {
+    IrInst inst(IrOp::PHI);
+    inst.a = static_cast<uint32_t>(m_function->incoming.size());
+    inst.b = static_cast<uint32_t>(incoming.size());
+    m_function->incoming.insert(m_function->incoming.end(), incoming.begin(), incoming.end());
+    return append(inst);
+}
+
+/* A name where edges join: what they all carry, or a phi when they differ. With no edge
+ * arriving the join is unreachable and the name is left as it is */
+void Lowering::merge(Symbol name, const std::vector<IrIncoming>& incoming) {
+    if (incoming.empty()) return;
+    bool same = std::all_of(incoming.begin(), incoming.end(), [&](const IrIncoming& in) { return in.value == incoming[0].value; });
+    bind(name, same ? incoming[0].value : phi(incoming));
+}
+
+/* break/continue: the block jumps out of the loop's body, carrying each name the loop assigns
+ * as bound outside the body's own declarations. Targets are filled in by visitWhile */
+void Lowering::leave(std::vector<Value>& jumps, std::vector<IrIncoming>& sites) {
+    const Loop& loop = m_loops.back();
+    jumps.push_back(append(IrInst(IrOp::JMP)));
+    if (m_live) {
+        for (Symbol name : loop.names) {
+            Value value = m_binding[name];
+            for (size_t s = m_scope.size(); s > loop.scope; s--) {
+                if (m_scope[s - 1].first == name) value = m_scope[s - 1].second;
+            }
+            sites.push_back({currentBlock(), value});
+        }
+    }
+    endBlock();
+    m_live = false;
+}
+
+/* Locals and parameters a body assigns, the ones that need a phi where its paths join */
+void Lowering::tracked(std::vector<Symbol>& names) const {
+    names.erase(std::remove_if(names.begin(), names.end(), [&](Symbol name) { return m_binding[name] == NO_VALUE; }),
+                names.end());
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+}
+
+void Lowering::bind(Symbol name, Value value) {
+    if (m_binding[name] == NO_VALUE) m_touched.push_back(name);
+    m_binding[name] = value;
+}
+
+void Lowering::declare(Symbol name, Value value) {
+    m_scope.push_back({name, m_binding[name]});
+    bind(name, value);
+}
+
+void Lowering::error(uint32_t line, uint32_t column, const std::string& message) {
+    m_errors++;
+    if (!m_diagnostics) throw std::runtime_error(std::to_string(line) + ":" + std::to_string(column) + ": " + message);
+    m_diagnostics->error(m_file, line, column, message);
+}
+
+// ================================= Statement Visitors =================================
+
+void Lowering::visitVarDecl(const NodeStatement& node) {
+    node.rpn.accept(*this);
+    Value value = m_stack.back();
+    m_stack.pop_back();
+
+    if (node.global) {
+        IrInst store(IrOp::STORE);
+        store.a = value;
+        store.sym = node.name;
+        append(store);
+        return;
+    }
+    declare(node.name, value);
+}
+
+void Lowering::visitArithmetic(const NodeArithmetic& node) {
+    for (const NodeExpression& expr : node.reversepolish) {
+        expr.accept(*this);
+    }
+}
+
+void Lowering::visitAssignment(const NodeStatement& node) {
+    node.rpn.accept(*this);
+    Value value = m_stack.back();
+    m_stack.pop_back();
+
+    if (m_binding[node.name] != NO_VALUE) {
+        bind(node.name, value);
+    } else if (m_global[node.name]) {
+        IrInst store(IrOp::STORE);
+        store.a = value;
+        store.sym = node.name;
+        append(store);
+    } else {
+        error(node.line, node.column, "undeclared identifier " + std::string(m_interner.name(node.name)));
+    }
+}
+
+void Lowering::visitReturn(const NodeStatement& node) {
+    node.rpn.accept(*this);
+    IrInst ret(IrOp::RET);
+    ret.a = m_stack.back();
+    m_stack.pop_back();
+    append(ret);
+    endBlock();
+    m_live = false;
+}
+
+/*  cond; br then, else       (else is the join without an else branch)
+ *  then: ...; jmp join
+ *  else: ...; jmp join
+ *  join: phis for whatever the two paths left bound differently */
+void Lowering::visitIf(const NodeStatement& node) {
+    Value condition = lowerCondition(node.rpn);
+    uint32_t from = currentBlock();
+    bool live = m_live;
+    Value branch = append(IrInst(IrOp::BR));
+    m_function->code[branch].a = condition;
+
+    std::vector<Symbol> names;
+    node.body.assigned(names);
+    node.otherwise.assigned(names);
+    tracked(names);
+    std::vector<Value> before, thenValues;
+    for (Symbol name : names) before.push_back(m_binding[name]);
+
+    endBlock();
+    m_function->code[branch].target = currentBlock();
+    lowerBody(node.body);
+    uint32_t thenFrom = currentBlock();
+    bool thenLive = m_live;
+    for (Symbol name : names) thenValues.push_back(m_binding[name]);
+    Value thenJump = append(IrInst(IrOp::JMP));
+    endBlock();
+
+    uint32_t elseFrom = from;
+    bool elseLive = live;
+    Value elseJump = NO_VALUE;
+    for (size_t i = 0; i < names.size(); i++) m_binding[names[i]] = before[i];
+    m_live = live;
+    if (!node.otherwise.statements.empty()) {
+        m_function->code[branch].b = currentBlock();
+        lowerBody(node.otherwise);
+        elseFrom = currentBlock();
+        elseLive = m_live;
+        elseJump = append(IrInst(IrOp::JMP));
+        endBlock();
+    }
+
+    uint32_t join = currentBlock();
+    m_function->code[thenJump].target = join;
+    if (elseJump != NO_VALUE) {
+        m_function->code[elseJump].target = join;
+    } else {
+        m_function->code[branch].b = join;
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        Value elseValue = m_binding[names[i]];
+        if (thenLive && elseLive && thenValues[i] != elseValue) {
+            bind(names[i], phi({{thenFrom, thenValues[i]}, {elseFrom, elseValue}}));
+        } else {
+            bind(names[i], thenLive ? thenValues[i] : elseValue);
+        }
+    }
+    m_live = thenLive || elseLive;
+}
+
+/* Rotated so the back edge is the only branch taken per iteration, the condition is lowered twice
+ *  pre:  cond; br body, exit
+ *  body: phis for what the body assigns; ...; jmp latch      (continue: jmp latch)
+ *  latch: phis for the same, only when something continues; cond; br body, exit
+ *  exit: phis for the same, arriving from pre, the latch and every break */
+void Lowering::visitWhile(const NodeStatement& node) {
+    std::vector<Symbol> names;
+    node.body.assigned(names);
+    tracked(names);
+
+    Value condition = lowerCondition(node.rpn);
+    uint32_t pre = currentBlock();
+    bool live = m_live;
+    std::vector<Value> before, phis;
+    for (Symbol name : names) before.push_back(m_binding[name]);
+    Value guard = append(IrInst(IrOp::BR));
+    m_function->code[guard].a = condition;
+    endBlock();
+
+    uint32_t body = currentBlock();
+    m_function->code[guard].target = body;
+    for (size_t i = 0; i < names.size(); i++) {
+        /* The back edge's input is filled in once the body has been lowered */
+        phis.push_back(phi({{pre, before[i]}, {pre, before[i]}}));
+        bind(names[i], phis.back());
+    }
+    m_loops.push_back({names, m_scope.size(), {}, {}, {}, {}});
+    lowerBody(node.body);
+
+    /* Arrivals of name i at a join, from jumps that each recorded every name */
+    auto arrivals = [&](const std::vector<IrIncoming>& sites, size_t i, std::vector<IrIncoming>& incoming) {
+        for (size_t at = i; at < sites.size(); at += names.size()) incoming.push_back(sites[at]);
+    };
+    std::vector<IrIncoming> incoming;
+    if (!m_loops.back().continueJumps.empty()) {
+        /* The end of the body is one more jump to the latch, which starts a block of its own */
+        Loop& loop = m_loops.back();
+        leave(loop.continueJumps, loop.continues);
+        for (Value jump : loop.continueJumps) m_function->code[jump].target = currentBlock();
+        for (size_t i = 0; i < names.size(); i++) {
+            incoming.clear();
+            arrivals(loop.continues, i, incoming);
+            merge(names[i], incoming);
+        }
+        m_live = !loop.continues.empty();
+    }
+    Loop loop = std::move(m_loops.back());
+    m_loops.pop_back();
+
+    condition = lowerCondition(node.rpn);
+    uint32_t latch = currentBlock();
+    bool latchLive = m_live;
+    Value back = append(IrInst(IrOp::BR));
+    m_function->code[back].a = condition;
+    m_function->code[back].target = body;
+    endBlock();
+
+    uint32_t exit = currentBlock();
+    m_function->code[guard].b = exit;
+    m_function->code[back].b = exit;
+    for (Value jump : loop.breakJumps) m_function->code[jump].target = exit;
+    for (size_t i = 0; i < names.size(); i++) {
+        Value latchValue = m_binding[names[i]];
+        m_function->incoming[m_function->code[phis[i]].a + 1] = {latch, latchValue};
+        incoming.assign(1, {pre, before[i]});
+        if (latchLive) incoming.push_back({latch, latchValue});
+        arrivals(loop.breaks, i, incoming);
+        merge(names[i], incoming);
+    }
+    m_live = live;
+}
+
+void Lowering::visitBreak(const NodeStatement&) {
+    leave(m_loops.back().breakJumps, m_loops.back().breaks);
+}
+
+void Lowering::visitContinue(const NodeStatement&) {
+    leave(m_loops.back().continueJumps, m_loops.back().continues);
+}
+
+// ================================= Expression Visitors =================================
+
+void Lowering::visitInteger(const NodeExpression& node) {
+    IrInst constant(IrOp::CONST);
+    constant.imm = node.value;
+    m_stack.push_back(append(constant));
+}
+
+void Lowering::visitBoolean(const NodeExpression& node) {
+    IrInst constant(IrOp::CONST);
+    constant.imm = node.value ? 1 : 0;
+    m_stack.push_back(append(constant));
+}
+
+void Lowering::visitIdentifier(const NodeExpression& node) {
+    if (m_binding[node.name] != NO_VALUE) {
+        m_stack.push_back(m_binding[node.name]);
+    } else if (m_global[node.name]) {
+        IrInst load(IrOp::LOAD);
+        load.sym = node.name;
+        m_stack.push_back(append(load));
+    } else {
+        /* A stand-in keeps the RPN stack whole for the rest of the expression */
+        error(node.line, node.column, "undeclared identifier " + std::string(m_interner.name(node.name)));
+        m_stack.push_back(append(IrInst(IrOp::CONST)));
+    }
+}
+
+void Lowering::visitOperator(const NodeExpression& node) {
+    IrOp op;
+    switch (node.op) {
+    case TokenType::PLUS:     op = IrOp::ADD; break;
+    case TokenType::MINUS:    op = IrOp::SUB; break;
+    case TokenType::MULTIPLY: op = IrOp::MUL; break;
+    case TokenType::DIVIDE:   op = IrOp::DIV; break;
+    case TokenType::EQUALS:        op = IrOp::EQ; break;
+    case TokenType::NOT_EQUALS:    op = IrOp::NE; break;
+    case TokenType::LESS:          op = IrOp::LT; break;
+    case TokenType::LESS_EQUAL:    op = IrOp::LE; break;
+    case TokenType::GREATER:       op = IrOp::GT; break;
+    case TokenType::GREATER_EQUAL: op = IrOp::GE; break;
+    default:
+        throw std::runtime_error("unsupported operator");
+    }
+    IrInst inst(op);
+    inst.b = m_stack.back();
+    m_stack.pop_back();
+    inst.a = m_stack.back();
+    m_stack.pop_back();
+    m_stack.push_back(append(inst));
+}
+
+void Lowering::visitFunctionCall(const NodeExpression& node) {
+    int32_t parameters = m_parameters[node.name];
+    if (parameters < 0) {
+        error(node.line, node.column, "undefined function " + std::string(m_interner.name(node.name)));
+    } else if (node.argc != parameters) {
+        error(node.line, node.column, std::string(m_interner.name(node.name)) + " takes " + arguments(parameters) +
+                                      " but " + std::string(m_interner.name(m_function->name)) + " passes " +
+                                      std::to_string(node.argc));
+    }
+    IrInst call(IrOp::CALL);
+    call.sym = node.name;
+    call.a = static_cast<uint32_t>(m_function->args.size());
+    call.b = node.argc;
+    m_function->args.insert(m_function->args.end(), m_stack.end() - node.argc, m_stack.end());
+    m_stack.resize(m_stack.size() - node.argc);
+    m_stack.push_back(append(call));
+}
@@ -1,48 +1,706 @@
 #include <iostream>
-#include <fstream>
+#include <shared_mutex>
+#include <sstream>
+#include <unordered_map>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "source.h"
 #include "lexer.h"
 #include "parser.h"
+#include "constfold.h"
+#include "lower.h"
+#include "tailcall.h"
+#include "evaluator.h"
+#include "inliner.h"
+#include "dce.h"
 #include "generator.h"
+#include "peephole.h"
+#include "assembler.h"
+#include "symtab.h"
+#include "linker.h"
+#include "threadpool.h"
+#include "cache.h"
+#include "profiler.h"
+#include "diagnostics.h"
+#include "server.h"
+#include "footprint.h"
 
-int main(int argc, char** argv) {
-    if (argc != 2) {
-        std::cerr << "Usage should be..." << std::endl;
-        std::cerr << "./src/main <input.stump>" << std::endl;
-        exit(EXIT_FAILURE);
+/* What the compiler writes: assembly text, a flat memory image or Intel HEX */
+enum class Format { ASM, BIN, HEX };
+
+static std::optional<Format> format(std::string_view name) {
+    if (name == "asm") return Format::ASM;
+    if (name == "bin") return Format::BIN;
+    if (name == "hex") return Format::HEX;
+    return std::nullopt;
+}
+
+/* Format from the output's extension when --format isn't given */
+static Format formatFor(std::string_view path) {
+    size_t dot = path.rfind('.');
+    std::optional<Format> byExtension = dot == std::string_view::npos ? std::nullopt : format(path.substr(dot + 1));
+    return byExtension ? *byExtension : Format::ASM;
+}
+
+/* The whole output in as few write() calls as the kernel allows, "-" is stdout */
+static bool writeOutput(const std::string& path, std::string_view data) {
+    int fd = path == "-" ? STDOUT_FILENO : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    while (!data.empty()) {
+        ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) break;
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+    bool ok = data.empty();
+    if (fd != STDOUT_FILENO) ok = close(fd) == 0 && ok;
+    return ok;
+}
+
+/* A file's front end results: its source, its names and its folded AST
+ *  - built on one thread, then only read, so the compile server can hand the same one to
+ *    every request that sends the same source */
+struct Unit {
+    std::unique_ptr<SourceBuffer> source;   // a file read from disk
+    std::string text;                       // or source sent with a server request
+    Interner interner;                      // the file's own names, until imported
+    std::unique_ptr<NodeProgram> program;   // tokens and the AST point into the source
+    uint32_t folded = 0, propagated = 0;
+
+    std::string_view view() const { return source ? source->view() : std::string_view(text); }
+};
+
+/* One input file on its way through the compiler, owned by whichever thread has it */
+struct Module {
+    std::string path;
+    const std::string* text = nullptr;      // source sent with a request, otherwise read from path
+    std::shared_ptr<const Unit> unit;
+    std::vector<Symbol> global;             // per local symbol: the program-wide one
+    IrModule ir;
+    std::string lowered, tailCalled;        // --emit-ir dumps, printed in input order
+    uint32_t tailCalls = 0;
+};
+
+/* What the compile server keeps between requests, shared by all of them
+ *  - front ends by source text, a file sent again is neither lexed, parsed nor folded
+ *  - the runtime routines for each mix of multiply and divide, generated up front
+ * Once the kept sources pass MAX_BYTES the units start over, a build rarely comes back to
+ * a file after that many others */
+class Warm {
+public:
+    Warm() {
+        Interner none;
+        Generator generator(none);
+        for (size_t i = 0; i < m_runtimes.size(); i++) m_runtimes[i] = generator.generateRuntime(i & 2, i & 1);
+    }
+
+    std::shared_ptr<const Unit> find(const std::string& text) const {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto found = m_units.find(text);
+        return found == m_units.end() ? nullptr : found->second;
+    }
+
+    void keep(std::shared_ptr<const Unit> unit) {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (m_bytes + unit->text.size() > MAX_BYTES) {
+            m_units.clear();
+            m_bytes = 0;
+        }
+        if (m_units.emplace(unit->text, unit).second) m_bytes += unit->text.size();
+    }
+
+    const Listing& runtime(bool multiply, bool divide) const { return m_runtimes[(multiply ? 2 : 0) | (divide ? 1 : 0)]; }
+
+private:
+    static constexpr size_t MAX_BYTES = 64u << 20;
+
+    mutable std::shared_mutex m_mutex;
+    std::unordered_map<std::string_view, std::shared_ptr<const Unit>> m_units;     // keys point into the units
+    size_t m_bytes = 0;
+    std::array<Listing, 4> m_runtimes;
+};
+
+/* A run of functions generated on one thread */
+struct Piece {
+    size_t begin = 0, end = 0;
+    Listing listing;
+    std::vector<Generator::SpillReport> spills;
+    std::vector<Generator::StackFrame> frames;
+    bool multiply = false, divide = false;
+    std::array<uint32_t, static_cast<size_t>(PeepholeRule::COUNT)> hits{};     // peephole, summed over runs
+};
+
+/* Everything a command line, or a request to the compile server, can ask for */
+struct Options {
+    bool reportSpills = false;
+    bool reportStats = false;
+    bool emitIR = false;
+    Peephole peephole;
+    std::vector<std::string> inputs;
+    std::string outputPath = "output/output.s";
+    std::optional<Format> outputFormat;
+    unsigned jobs = 0;
+    std::string cacheDirectory;
+    bool reportCache = false;
+    bool reportMemory = false;
+    uint32_t stackSize = 0;     // words the stack may take, 0 for all the RAM above the program
+    uint32_t evalBudget = CallEvaluator::BUDGET;    // steps a call at compile time may take, 0 for none
+    bool verbose = false;
+    bool timeReport = false;
+    std::string tracePath;
+    uint32_t maxErrors = 20;
+    std::string serverPath;
+};
+
+static const char* USAGE =
+    "./src/main [-v] [--spills] [--stats] [--emit-ir] [--time-report] [--trace=<file.json>]"
+    " [--peephole=<rule,...|none>]"
+    " [-o <file>|-] [--format=asm|bin|hex] [-j <threads>] [--cache=<dir>] [--cache-stats]"
+    " [--memory] [--stack-size=<words>] [--eval-budget=<steps>]"
+    " [--max-errors=<n>]"
+    " <input.stump>...\n"
+    "./src/main --server=<socket>";
+
+/* Flags and input files in any order. A server request names its files separately and
+ * gets its output back, so it can't ask for files, -o, threads, profiling or a server.
+ * Anything not understood leaves a reason in problem, empty for a plain usage error */
+static bool parseOptions(const std::vector<std::string>& args, bool request, Options& options, std::string& problem) {
+    auto local = [&](const std::string& arg) {
+        problem = arg + " is not available in a server request";
+        return false;
+    };
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::string& arg = args[i];
+        if (arg == "--spills") {
+            options.reportSpills = true;
+        } else if (arg == "--stats") {
+            options.reportStats = true;
+        } else if (arg == "--emit-ir") {
+            options.emitIR = true;
+        } else if (arg == "-v") {
+            options.verbose = true;
+        } else if (arg == "--time-report") {
+            if (request) return local(arg);
+            options.timeReport = true;
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            if (request) return local("--trace");
+            options.tracePath = arg.substr(8);
+        } else if (arg == "-o" && i + 1 < args.size()) {
+            if (request) return local(arg);
+            options.outputPath = args[++i];
+        } else if (arg == "-j" && i + 1 < args.size()) {
+            if (request) return local(arg);
+            options.jobs = static_cast<unsigned>(std::strtoul(args[++i].c_str(), nullptr, 10));
+        } else if (arg.rfind("--max-errors=", 0) == 0) {
+            options.maxErrors = static_cast<uint32_t>(std::strtoul(arg.c_str() + 13, nullptr, 10));
+        } else if (arg.rfind("--cache=", 0) == 0) {
+            options.cacheDirectory = arg.substr(8);
+        } else if (arg == "--cache-stats") {
+            options.reportCache = true;
+        } else if (arg == "--memory") {
+            options.reportMemory = true;
+        } else if (arg.rfind("--stack-size=", 0) == 0) {
+            options.stackSize = static_cast<uint32_t>(std::strtoul(arg.c_str() + 13, nullptr, 10));
+        } else if (arg.rfind("--eval-budget=", 0) == 0) {
+            options.evalBudget = static_cast<uint32_t>(std::strtoul(arg.c_str() + 14, nullptr, 10));
+        } else if (arg.rfind("--server=", 0) == 0) {
+            if (request) return local("--server");
+            options.serverPath = arg.substr(9);
+        } else if (arg.rfind("--format=", 0) == 0) {
+            options.outputFormat = format(std::string_view(arg).substr(9));
+            if (!options.outputFormat) {
+                problem = "unknown output format " + arg.substr(9);
+                return false;
+            }
+        } else if (arg.rfind("--peephole=", 0) == 0) {
+            /* Comma separated rule names, or none */
+            std::string rules = arg.substr(11);
+            options.peephole.enableAll(false);
+            for (size_t start = 0; start < rules.size() && rules != "none";) {
+                size_t end = rules.find(',', start);
+                if (end == std::string::npos) end = rules.size();
+                std::optional<PeepholeRule> rule = Peephole::rule(std::string_view(rules).substr(start, end - start));
+                if (!rule) {
+                    problem = "unknown peephole rule " + rules.substr(start, end - start);
+                    return false;
+                }
+                options.peephole.enable(*rule, true);
+                start = end + 1;
+            }
+        } else if (arg.rfind("-", 0) != 0 && !request) {
+            options.inputs.push_back(arg);
+        } else {
+            problem = request ? "unknown option " + arg : "";
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Every option that changes generated code, in a fixed order and spelled from its effect rather
+ * than from the command line: part of every cache key */
+static std::string codeFlags(const Options& options) {
+    std::string flags = "peephole=";
+    for (size_t r = 0; r < static_cast<size_t>(PeepholeRule::COUNT); r++) {
+        PeepholeRule rule = static_cast<PeepholeRule>(r);
+        if (options.peephole.enabled(rule)) flags += std::string(Peephole::name(rule)) + ",";
+    }
+    flags += " eval-budget=" + std::to_string(options.evalBudget);
+    return flags;
+}
+
+/* One compile from source to output, everything it reports to info and errors
+ *  - modules come with their path set, and their text when they weren't read from disk
+ *  - with warm, front ends and runtime routines come from it and new front ends go into it */
+static int compile(const Options& options, std::vector<Module>& modules, ThreadPool& pool, Profiler& profiler,
+                   Warm* warm, std::ostream& info, std::ostream& errors, std::string& output) {
+    bool emitIR = options.emitIR;
+    SymbolTable symbols;
+    std::vector<std::string> paths;
+    for (const Module& module : modules) paths.push_back(module.path);
+    Diagnostics diagnostics(std::move(paths), options.maxErrors);
+
+    if (options.verbose) errors << "starting\n";
+
+    //---> 1. TOKENISE + 2. PARSE + 3. OPTIMISE, every file on its own thread
+    pool.run(modules.size(), [&](size_t m) {
+        Module& module = modules[m];
+        if (warm && module.text) module.unit = warm->find(*module.text);
+        if (!module.unit) {
+            std::shared_ptr<Unit> unit = std::make_shared<Unit>();
+            if (module.text) {
+                unit->text = *module.text;
+            } else {
+                /* Mapping input file, tokens and AST point into it so it must outlive them */
+                Profiler::Scope scope(profiler, "read");
+                unit->source = std::make_unique<SourceBuffer>(module.path);
+            }
+            if (profiler.enabled()) {
+                /* The parser lexes on demand, a separate pass is the only way to see the lexer on
+                 * its own. Interning the same names in the same order leaves the symbols as they were */
+                Profiler::Scope scope(profiler, "lex");
+                Lexer(unit->view(), unit->interner).tokenise();
+            }
+            {
+                Profiler::Scope scope(profiler, "parse");
+                Lexer lexer(unit->view(), unit->interner);
+                Parser parser(lexer, &diagnostics, static_cast<uint32_t>(m));
+                unit->program = parser.parse();
+                if (parser.errors() > 0) return;
+            }
+            {
+                Profiler::Scope scope(profiler, "constfold");
+                ConstantFolder folder(unit->interner);
+                folder.run(*unit->program);
+                unit->folded = folder.folded();
+                unit->propagated = folder.propagated();
+            }
+            if (warm && module.text) warm->keep(unit);
+            module.unit = std::move(unit);
+        }
+        const Unit& unit = *module.unit;
+
+        /* Every definition into the shared table, the same name twice anywhere is an error */
+        module.global = symbols.import(unit.interner);
+        auto define = [&](Symbol name, SymbolTable::Kind kind, uint32_t parameters = 0) {
+            std::optional<SymbolTable::Definition> previous = symbols.define(module.global[name], kind, static_cast<uint32_t>(m), parameters);
+            if (previous) {
+                throw std::runtime_error(std::string(unit.interner.name(name)) + " in " + module.path +
+                                         " is already defined in " + modules[previous->module].path);
+            }
+        };
+        for (const NodeStatement& global : unit.program->globals) define(global.name, SymbolTable::Kind::GLOBAL);
+        for (const NodeFunction& func : unit.program->functions) {
+            define(func.name, SymbolTable::Kind::FUNCTION, static_cast<uint32_t>(func.parameters.size));
+        }
+    });
+
+    if (diagnostics.count() > 0) {
+        diagnostics.print(errors);
+        return EXIT_FAILURE;
+    }
+
+    if (options.verbose) errors << "successful parsing, now optimising\nsuccessful optimising, now generating\n";
+
+    //---> 4. LOWER to SSA + 5. TAIL CALLS, once every file's definitions are known
+    pool.run(modules.size(), [&](size_t m) {
+        Module& module = modules[m];
+        {
+            Profiler::Scope scope(profiler, "lower");
+            std::vector<Symbol> externals;
+            std::vector<std::pair<Symbol, uint32_t>> functions;
+            for (Symbol s = 0; s < module.unit->interner.size(); s++) {
+                std::optional<SymbolTable::Definition> definition = symbols.find(module.global[s]);
+                if (!definition || definition->module == m) continue;
+                if (definition->kind == SymbolTable::Kind::GLOBAL) externals.push_back(s);
+                else functions.push_back({s, definition->parameters});
+            }
+            Lowering lowering(module.unit->interner, &diagnostics, static_cast<uint32_t>(m));
+            module.ir = lowering.lower(*module.unit->program, externals, functions);
+            if (lowering.errors() > 0) return;
+        }
+        if (emitIR) module.lowered = module.ir.print(module.unit->interner);
+
+        Profiler::Scope scope(profiler, "tailcall");
+        TailCallEliminator tailCalls;
+        tailCalls.run(module.ir);
+        module.tailCalls = tailCalls.eliminated();
+        if (emitIR) module.tailCalled = module.ir.print(module.unit->interner);
+
+        module.ir.rename(module.global);
+    });
+
+    if (diagnostics.count() > 0) {
+        diagnostics.print(errors);
+        return EXIT_FAILURE;
+    }
+
+    const Interner& interner = symbols.interner();
+    uint32_t folded = 0, propagated = 0, tailCalls = 0;
+    for (const Module& module : modules) {
+        folded += module.unit->folded;
+        propagated += module.unit->propagated;
+        tailCalls += module.tailCalls;
+    }
+    if (emitIR) {
+        auto dump = [&](const char* title, std::string Module::*text) {
+            for (const Module& module : modules) {
+                info << title << (modules.size() > 1 ? std::string(" ") + module.path : "") << "\n" << module.*text;
+            }
+        };
+        dump("; lowered", &Module::lowered);
+        dump("\n; after tail calls", &Module::tailCalled);
+    }
+
+    //---> 6. LINK the IR
+    std::vector<IrModule> irs;
+    for (Module& module : modules) irs.push_back(std::move(module.ir));
+    Linker linker(interner);
+    IrModule program;
+    {
+        Profiler::Scope scope(profiler, "link ir");
+        program = linker.merge(irs);
     }
 
-    /* Reading input file into string */
-    std::string contents;
+    //---> 7. EVALUATE calls to pure functions with constant arguments
+    CallEvaluator evaluator(interner, options.evalBudget);
+    uint32_t evaluated = 0;
     {
-        std::stringstream contents_stream;
-        std::fstream input(argv[1], std::ios::in);
-        contents_stream << input.rdbuf();
-        contents = contents_stream.str();
+        Profiler::Scope scope(profiler, "evaluate");
+        evaluator.run(program);
+        evaluated += evaluator.evaluated();
+    }
+    if (emitIR) {
+        info << "\n; after compile-time calls\n" << program.print(interner);
     }
 
-    std::cout << "starting" << std::endl;
+    //---> 8. INLINE, then evaluate again where inlining left constant arguments
+    Inliner inliner(interner);
+    {
+        Profiler::Scope scope(profiler, "inline");
+        inliner.run(program);
+    }
+    {
+        Profiler::Scope scope(profiler, "evaluate");
+        evaluator.run(program);
+        evaluated += evaluator.evaluated();
+    }
+    if (emitIR) {
+        info << "\n; after inlining\n" << program.print(interner);
+    }
 
-    //---> 1. TOKENISE
-    Lexer lexer(contents);
-    std::vector<Token> tokens = lexer.tokenise();
+    //---> 9. DEAD CODE
+    DeadCodeEliminator dce(interner);
+    {
+        Profiler::Scope scope(profiler, "dce");
+        dce.run(program);
+    }
+    if (emitIR) {
+        info << "\n; after dead code elimination\n" << program.print(interner);
+    }
 
-    std::cout << "successful lexing, now parsing" << std::endl;
+    //---> 10. GENERATE + 11. PEEPHOLE, runs of functions of about equal size on each thread
+    size_t count = std::min<size_t>(program.functions.size(), pool.threads() == 1 ? 1 : pool.threads() * 4);
+    std::vector<Piece> pieces(count);
+    size_t total = 0;
+    for (const IrFunction& func : program.functions) total += func.code.size();
+    for (size_t f = 0, piece = 0, size = 0; f < program.functions.size(); f++) {
+        size += program.functions[f].code.size();
+        pieces[piece].end = f + 1;
+        if (size * count >= total * (piece + 1) && piece + 1 < count) {
+            pieces[++piece].begin = f + 1;
+        }
+    }
+    std::unique_ptr<FunctionCache> cache;
+    if (!options.cacheDirectory.empty()) {
+        cache = std::make_unique<FunctionCache>(options.cacheDirectory, codeFlags(options));
+        cache->layout(program, interner, Generator::globalBase(program));
+    }
+    /* Cached frames name their callees, the symbols are only this run's */
+    std::unordered_map<std::string_view, Symbol> functionNamed;
+    if (cache) {
+        for (const IrFunction& func : program.functions) functionNamed[interner.name(func.name)] = func.name;
+    }
+    pool.run(pieces.size(), [&](size_t p) {
+        Piece& piece = pieces[p];
+        Peephole optimiser = options.peephole;
+        auto optimise = [&](Listing& listing) {
+            Profiler::Scope scope(profiler, "peephole");
+            optimiser.run(listing);
+            for (size_t i = 0; i < piece.hits.size(); i++) piece.hits[i] += optimiser.hits(static_cast<PeepholeRule>(i));
+        };
+        if (!cache) {
+            {
+                Profiler::Scope scope(profiler, "generate");
+                Generator generator(interner);
+                piece.listing = generator.generateFunctions(program, piece.begin, piece.end);
+                piece.spills = generator.spills();
+                piece.frames = generator.frames();
+                piece.multiply = generator.usesMultiply();
+                piece.divide = generator.usesDivide();
+            }
+            optimise(piece.listing);
+            return;
+        }
+        /* Cached one function at a time, only misses are generated */
+        for (size_t f = piece.begin; f < piece.end; f++) {
+            const IrFunction& func = program.functions[f];
+            FunctionCache::Entry entry;
+            uint64_t key = 0;
+            bool hit = false;
+            {
+                Profiler::Scope scope(profiler, "cache");
+                key = cache->key(func, interner);
+                hit = cache->load(key, entry);
+            }
+            if (!hit) {
+                {
+                    Profiler::Scope scope(profiler, "generate");
+                    Generator generator(interner);
+                    entry.listing = generator.generateFunctions(program, f, f + 1);
+                    entry.spills = generator.spills()[0].spills;
+                    entry.frameSlots = generator.spills()[0].frameSlots;
+                    entry.stackWords = generator.frames()[0].words;
+                    for (const auto& call : generator.frames()[0].calls) {
+                        entry.calls.push_back({std::string(interner.name(call.first)), call.second});
+                    }
+                    entry.multiply = generator.usesMultiply();
+                    entry.divide = generator.usesDivide();
+                }
+                optimise(entry.listing);
+                Profiler::Scope scope(profiler, "cache");
+                cache->store(key, entry);
+            }
+            piece.listing.append(entry.listing);
+            piece.spills.push_back({func.name, entry.spills, entry.frameSlots});
+            Generator::StackFrame frame{func.name, entry.stackWords, {}};
+            for (const auto& call : entry.calls) {
+                auto callee = functionNamed.find(call.first);
+                if (callee != functionNamed.end()) frame.calls.push_back({callee->second, call.second});
+            }
+            piece.frames.push_back(std::move(frame));
+            piece.multiply |= entry.multiply;
+            piece.divide |= entry.divide;
+        }
+    });
 
-    //---> 2. PARSE
-    Parser parser(tokens);
-    std::unique_ptr<NodeProgram> program = parser.parse();
+    //---> 12. LINK the code
+    Generator generator(interner);
+    bool multiply = false, divide = false;
+    std::vector<Listing> listings;
+    for (Piece& piece : pieces) {
+        multiply |= piece.multiply;
+        divide |= piece.divide;
+        listings.push_back(std::move(piece.listing));
+    }
+    Listing listing;
+    uint32_t relaxed = 0;
+    {
+        Profiler::Scope scope(profiler, "link");
+        Listing header = generator.generateHeader(program);
+        listing = warm ? linker.link(std::move(header), listings, warm->runtime(multiply, divide))
+                       : linker.link(std::move(header), listings, generator.generateRuntime(multiply, divide));
+        relaxed = listing.relax();
+    }
 
-    std::cout << "successful parsing, now generating" << std::endl;
+    //---> 13. MEMORY: code, data and the deepest the stack can go, against the memory map
+    std::vector<Generator::StackFrame> frames;
+    for (Piece& piece : pieces) {
+        for (Generator::StackFrame& frame : piece.frames) frames.push_back(std::move(frame));
+    }
+    Footprint footprint(interner, options.stackSize);
+    {
+        Profiler::Scope scope(profiler, "footprint");
+        footprint.run(listing, frames);
+    }
+    if (!footprint.recursion().empty()) {
+        errors << "warning: the stack has no bound, " << footprint.recursion() << " is recursive\n";
+    }
+    Format outputFormat = options.outputFormat ? *options.outputFormat : formatFor(options.outputPath);
+    if (outputFormat == Format::ASM) {
+        Profiler::Scope scope(profiler, "print");
+        output = listing.print();
+    } else {
+        //---> 14. ASSEMBLE
+        Profiler::Scope scope(profiler, "assemble");
+        Image image = listing.assemble();
+        output = outputFormat == Format::BIN ? flatImage(image) : intelHex(image);
+    }
 
-    //---> 3. GENERATE
-    Generator generator;
-    std::string output = generator.generate(*program);
+    if (options.verbose) errors << "code generated\n";
 
-    std::cout << "code generated" << std::endl;
+    if (options.reportSpills) {
+        for (const Piece& piece : pieces) {
+            for (const Generator::SpillReport& report : piece.spills) {
+                info << interner.name(report.function) << ": "
+                          << report.spills << " spills, "
+                          << report.frameSlots << " stack slots" << std::endl;
+            }
+        }
+    }
+
+    if (options.reportStats) {
+        info << "constant folding: " << folded << " folded, "
+                  << propagated << " propagated" << std::endl;
+        info << "tail calls: " << tailCalls << " turned into jumps" << std::endl;
+        info << "compile-time calls: " << evaluated << " evaluated" << std::endl;
+        info << "inlining: " << inliner.inlined() << " calls inlined" << std::endl;
+        info << "dead code: " << dce.functions() << " functions, " << dce.blocks() << " blocks, "
+                  << dce.values() << " values, " << dce.globals() << " globals removed" << std::endl;
+        for (size_t i = 0; i < static_cast<size_t>(PeepholeRule::COUNT); i++) {
+            PeepholeRule rule = static_cast<PeepholeRule>(i);
+            uint32_t hits = 0;
+            for (const Piece& piece : pieces) hits += piece.hits[i];
+            info << "peephole " << Peephole::name(rule) << ": " << hits << std::endl;
+        }
+        info << "far branches: " << relaxed << std::endl;
+    }
+
+    /*  code: 178 words (356 bytes) from 0x0000
+     *  data: 12 words (24 bytes)
+     *  stack: 9 words (18 bytes) from 0x1200, 60663 words spare
+     *  main: 1 words, 9 with its calls
+     * A function's figures start below its return slot, as the stack's do: main's is never written */
+    if (options.reportMemory) {
+        auto hex = [](uint32_t address) {
+            char text[8];
+            std::snprintf(text, sizeof(text), "0x%04X", address);
+            return std::string(text);
+        };
+        info << "code: " << footprint.codeWords() << " words (" << 2 * footprint.codeWords() << " bytes) from 0x0000\n";
+        info << "data: " << footprint.dataWords() << " words (" << 2 * footprint.dataWords() << " bytes)\n";
+        if (std::optional<uint32_t> stack = footprint.stackWords()) {
+            info << "stack: " << *stack << " words (" << 2 * *stack << " bytes) from " << hex(footprint.stackBase())
+                 << ", " << footprint.stackLimit() - *stack << " words spare\n";
+        } else {
+            info << "stack: unbounded, recursion from main, " << footprint.stackLimit() << " words from "
+                 << hex(footprint.stackBase()) << "\n";
+        }
+        for (const Footprint::Function& function : footprint.functions()) {
+            info << interner.name(function.name) << ": " << function.words - 1 << " words, ";
+            if (function.stack) info << *function.stack - 1 << " with its calls\n";
+            else info << (function.recursive ? "recursive\n" : "unbounded, calls a recursive function\n");
+        }
+    }
+
+    if (options.reportCache && cache) {
+        info << "cache: " << cache->hits() << " hits, " << cache->misses() << " misses" << std::endl;
+    }
 
-    /* Writing string into output file */
-    std::ofstream out("output/output.s");
-    out << output;
-    
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+/* A request's files become modules that carry their own text, its output and everything it
+ * printed go back in the response */
+static CompileServer::Response serve(const CompileServer::Request& request, Warm& warm) {
+    CompileServer::Response response;
+    Options options;
+    std::string problem;
+    if (!parseOptions(request.args, true, options, problem)) {
+        response.status = EXIT_FAILURE;
+        response.messages = "error: " + problem + "\n";
+        return response;
+    }
+    if (request.files.empty()) {
+        response.status = EXIT_FAILURE;
+        response.messages = "error: no input files\n";
+        return response;
+    }
+    std::vector<Module> modules(request.files.size());
+    for (size_t m = 0; m < modules.size(); m++) {
+        modules[m].path = request.files[m].name;
+        modules[m].text = &request.files[m].source;
+    }
+    /* Requests run side by side on the server's connection threads, each compiles on its own */
+    ThreadPool pool(1);
+    Profiler profiler(false, false);
+    std::ostringstream messages;
+    try {
+        response.status = static_cast<uint32_t>(compile(options, modules, pool, profiler, &warm, messages, messages, response.output));
+    } catch (const std::exception& e) {
+        response.status = EXIT_FAILURE;
+        response.output.clear();
+        messages << "error: " << e.what() << "\n";
+    }
+    response.messages = messages.str();
+    return response;
+}
+
+/* Syntax errors and unresolved names are collected and reported together, the ones after
+ * (names defined twice, programs that don't fit) are thrown, one per run */
+int main(int argc, char** argv) {
+    Options options;
+    std::string problem;
+    if (!parseOptions(std::vector<std::string>(argv + 1, argv + argc), false, options, problem)) {
+        if (!problem.empty()) {
+            std::cerr << problem << std::endl;
+        } else {
+            std::cerr << "Usage should be...\n" << USAGE << std::endl;
+        }
+        return EXIT_FAILURE;
+    }
+    if (options.serverPath.empty() == options.inputs.empty()) {
+        std::cerr << "Usage should be...\n" << USAGE << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (!options.serverPath.empty()) {
+            Warm warm;
+            CompileServer server(options.serverPath, [&](const CompileServer::Request& request) { return serve(request, warm); });
+            if (options.verbose) std::cerr << "listening on " << options.serverPath << "\n";
+            server.serve();
+            return EXIT_SUCCESS;
+        }
+
+        /* With -o - stdout carries the program, everything else the compiler says goes to stderr */
+        std::ostream& info = options.outputPath == "-" ? std::cerr : std::cout;
+        Profiler profiler(options.timeReport, !options.tracePath.empty());
+        ThreadPool pool(options.jobs);
+        std::vector<Module> modules(options.inputs.size());
+        for (size_t m = 0; m < modules.size(); m++) modules[m].path = options.inputs[m];
+        std::string output;
+        int status = compile(options, modules, pool, profiler, nullptr, info, std::cerr, output);
+        if (status != EXIT_SUCCESS) return status;
+
+        /* Writing string into output file */
+        {
+            Profiler::Scope scope(profiler, "write");
+            if (!writeOutput(options.outputPath, output)) {
+                std::cerr << "can't write " << options.outputPath << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (options.timeReport) info << profiler.report();
+        if (!options.tracePath.empty() && !profiler.writeTrace(options.tracePath)) {
+            std::cerr << "can't write " << options.tracePath << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    } catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
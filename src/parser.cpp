@@ -3,19 +3,37 @@
 // ============================= Constructing & Entering =============================
 
 // Constructor
-Parser::Parser(std::vector<Token>& tokens)
-    : m_tokens(std::move(tokens)) {}
+Parser::Parser(Lexer& lexer, Diagnostics* diagnostics, uint32_t file)
+    : m_lexer(lexer), m_diagnostics(diagnostics), m_file(file) {}
 
 // Entry to parser
 std::unique_ptr<NodeProgram> Parser::parse() {
     auto program = std::make_unique<NodeProgram>();
-
-    while (!atEnd()) {
-        if (check(TokenType::INT)) {
-            program->globals.push_back(parseVarDecl(true));
+    m_program = program.get();
+    m_errors = 0;
+
+    std::vector<NodeFunction> functions;
+    std::vector<NodeStatement> globals;
+    try {
+        while (!atEnd()) {
+            try {
+                if (check(TokenType::INT)) {
+                    globals.push_back(parseVarDecl(true));
+                } else {
+                    functions.push_back(parseFunction());
+                }
+            } catch (const SyntaxError& error) {
+                report(error);
+                skipDeclaration();
+            }
         }
-        program->functions.push_back(parseFunction());
+    } catch (const Abandon&) {
+        /* Enough errors for one run, the rest of the file goes unread */
     }
+
+    program->functions = program->arena.copy(functions.data(), functions.size());
+    program->globals = program->arena.copy(globals.data(), globals.size());
+    m_program = nullptr;
     return program;
 }
 
@@ -23,96 +41,119 @@ std::unique_ptr<NodeProgram> Parser::parse() {
 // ====================================== Parser ======================================
 
 // Function parser
-std::unique_ptr<NodeFunction> Parser::parseFunction() {
+NodeFunction Parser::parseFunction() {
     /* fn name(... */
     consume(TokenType::FUNCTION);
-    auto name = consume(TokenType::IDENTIFIER).value;
-    consume(TokenType::LBRACKET);
-
-    /* param1, param2)...*/
-    std::vector<std::string> parameters = parseParameters();
-    consume(TokenType::RBRACKET);
-
-    /* -> int effects [] */
-    consume(TokenType::ARROW);
-    consume(TokenType::INT);        // expecting only INT return type for now
-    consume(TokenType::EFFECTS);
-    parseEffectList();
+    m_loops = 0;
+    Symbol name = 0;
+    Span<Symbol> parameters;
+    bool pure = false;
+    try {
+        name = consume(TokenType::IDENTIFIER).symbol;
+        consume(TokenType::LBRACKET);
+
+        /* param1, param2)...*/
+        parameters = parseParameters();
+        consume(TokenType::RBRACKET);
+
+        /* -> int effects [] */
+        consume(TokenType::ARROW);
+        consume(TokenType::INT);        // expecting only INT return type for now
+        consume(TokenType::EFFECTS);
+        pure = parseEffectList();
+    } catch (const SyntaxError& error) {
+        /* A broken signature still has a body worth checking */
+        report(error);
+        while (!atEnd() && !check(TokenType::LBRACE) && !check(TokenType::FUNCTION)) advance();
+    }
 
     /* { (body) ... */
     consume(TokenType::LBRACE);
-    auto body = parseBody(); 
+    NodeBody body = parseBody(); 
 
     /* Function: name (parameters) {body} */
-    return std::make_unique<NodeFunction>(name.value(), std::move(parameters), std::move(body));
+    return NodeFunction{name, parameters, body, pure};
 }
 
 // Function parameters parser
-std::vector<std::string> Parser::parseParameters() {
-    std::vector<std::string> parameters;
+Span<Symbol> Parser::parseParameters() {
+    m_parameters.clear();
     if (!check(TokenType::RBRACKET)) {
         do {
-            parameters.push_back(consume(TokenType::IDENTIFIER).value.value());
+            m_parameters.push_back(consume(TokenType::IDENTIFIER).symbol);
         } while (checkAdvance(TokenType::COMMA));
     }
-    return parameters;
+    return m_program->arena.copy(m_parameters.data(), m_parameters.size());
 }
 
-// Function effects parser
-void Parser::parseEffectList() {
+// Function effects parser, true for an empty list
+bool Parser::parseEffectList() {
     consume(TokenType::LSQUARE);
     
-    // for now, just skip any identifiers inside []
-    while (!check(TokenType::RSQUARE)) {
-        if (check(TokenType::IDENTIFIER)) {
-            advance(); // skip effect name
-        }
-        if (check(TokenType::COMMA)) {
-            advance(); // skip comma
-        }
+    // for now, the identifiers inside [] only matter for whether there are any
+    bool empty = check(TokenType::RSQUARE);
+    if (!empty) {
+        do {
+            consume(TokenType::IDENTIFIER);
+        } while (checkAdvance(TokenType::COMMA));
     }
-    
+
     consume(TokenType::RSQUARE);
+    return empty;
 }
 
 // Function Body parser
-std::unique_ptr<NodeBody> Parser::parseBody() {
-    std::vector<std::unique_ptr<NodeStatement>> statements;
+NodeBody Parser::parseBody() {
+    size_t base = m_statements.size();
     /* ... stmt1; stmt2; }*/
     while (!check(TokenType::RBRACE)) {
-        statements.push_back(parseStatement());
+        /* Nothing inside a body resumes past these, the declaration level has to */
+        if (atEnd() || check(TokenType::FUNCTION)) throw error(peek(), "'}'");
+        try {
+            NodeStatement statement = parseStatement();
+            m_statements.push_back(statement);
+        } catch (const SyntaxError& error) {
+            if (atEnd() || check(TokenType::FUNCTION)) throw;
+            report(error);
+            skipStatement();
+        }
     }
 
     consume(TokenType::RBRACE);
-    return std::make_unique<NodeBody>(std::move(statements));
+    NodeBody body{m_program->arena.copy(m_statements.data() + base, m_statements.size() - base)};
+    m_statements.resize(base);
+    return body;
 }
 
 // Statement parser (one line of a body)
-std::unique_ptr<NodeStatement> Parser::parseStatement() {
+NodeStatement Parser::parseStatement() {
     TokenType t = peek().type;
     switch (t) {
     case TokenType::IDENTIFIER: return parseAssignment();
     case TokenType::INT:        return parseVarDecl(false);
     case TokenType::BOOL:       return parseVarDecl(false);
     case TokenType::RETURN:     return parseReturn();
-    // case if/while
+    case TokenType::IF:         return parseIf();
+    case TokenType::WHILE:      return parseWhile();
+    case TokenType::BREAK:      return parseJump();
+    case TokenType::CONTINUE:   return parseJump();
     // case FPGA peripherals (make libraries to include?!)
-    default: 
-        throw std::runtime_error("Invalid statement start");
+    default:
+        throw error(peek(), "a statement");
     }
 }
 
 // Assignment parser 
-std::unique_ptr<NodeAssignment> Parser::parseAssignment() {
-    std::string name = consume(TokenType::IDENTIFIER).value.value();
+NodeStatement Parser::parseAssignment() {
+    Token name = consume(TokenType::IDENTIFIER);
     consume(TokenType::ASSIGN);
-    std::unique_ptr<NodeArithmetic> expr = parseArithmetic();
+    NodeArithmetic expr = parseArithmetic();
 
-    return std::make_unique<NodeAssignment>(name, std::move(expr));
+    return at(NodeStatement{StmtKind::ASSIGNMENT, false, name.symbol, expr}, name);
 }
 
 // Variable declaration parser
-std::unique_ptr<NodeVarDecl> Parser::parseVarDecl(bool global = false) {    
+NodeStatement Parser::parseVarDecl(bool global = false) {    
     TokenType varType = peek().type;
     if (varType == TokenType::INT) {
         consume(TokenType::INT);
@@ -120,95 +161,218 @@ std::unique_ptr<NodeVarDecl> Parser::parseVarDecl(bool global = false) {
         consume(TokenType::BOOL);
     }
     
-    std::string name = consume(TokenType::IDENTIFIER).value.value();
+    Token name = consume(TokenType::IDENTIFIER);
     consume(TokenType::ASSIGN);
-    std::unique_ptr<NodeArithmetic> expr = parseArithmetic();
+    NodeArithmetic expr = parseArithmetic();
+
+    return at(NodeStatement{StmtKind::VAR_DECL, global, name.symbol, expr}, name);
+}
 
-    return std::make_unique<NodeVarDecl>(name, std::move(expr), global);
+// Arithmetic parser: an expression ending in ;
+NodeArithmetic Parser::parseArithmetic() {
+    NodeArithmetic expr = parseExpression();
+    consume(TokenType::SEMI);
+    return expr;
+}
+
+// Condition parser: a parenthesised expression, comparisons are operators like any other
+NodeArithmetic Parser::parseCondition() {
+    consume(TokenType::LBRACKET);
+    NodeArithmetic expr = parseExpression();
+    consume(TokenType::RBRACKET);
+    return expr;
 }
 
-// Arithmetic parser (Shunting-Yard algorithm: Infix -> Reverse Polish)
-std::unique_ptr<NodeArithmetic> Parser::parseArithmetic() {
-    std::vector<std::unique_ptr<NodeExpression>> output;
-    std::stack<TokenType> operators;
+// Expression parser (Shunting-Yard algorithm: Infix -> Reverse Polish)
+//  - function calls push FUNCTION as their '(' marker, arguments are left on the RPN
+//    stack in order and the CALL element records how many to take
+//  - stops at the first token that can't continue it: ; or a ) nothing opened
+//  - `operand` tracks whether an operand or an operator comes next, so anything out of turn
+//    is an error here rather than a malformed RPN for later passes
+//  - a minus where an operand should be is negation, NEGATE binds tighter than any operator
+NodeArithmetic Parser::parseExpression() {
+    m_rpn.clear();
+    m_operators.clear();
+    m_calls.clear();
+    size_t open = 0;
+    bool operand = true;
 
     while (!check(TokenType::SEMI)) {
         TokenType t = peek().type;
-        
-        if (t == TokenType::INT_LIT) {
-            output.push_back(std::make_unique<NodeInteger>(advance()));
+        bool startsOperand = t == TokenType::INT_LIT || t == TokenType::TRUE || t == TokenType::FALSE ||
+                             t == TokenType::IDENTIFIER || t == TokenType::LBRACKET;
+        if (startsOperand && !operand) throw error(peek(), "an operator");
+
+        if (t == TokenType::MINUS && operand) {
+            /* -x is 0 - x, pushed without popping anything: a prefix applies to what follows */
+            NodeExpression zero{ExprKind::INTEGER};
+            m_rpn.push_back(zero);
+            m_operators.push_back(TokenType::NEGATE);
+            advance();
+        }
+        else if (t == TokenType::INT_LIT) {
+            /* Literals are 16-bit words, larger ones wrap */
+            NodeExpression integer{ExprKind::INTEGER};
+            for (char c : text(advance())) {
+                integer.value = static_cast<int16_t>(static_cast<uint16_t>(integer.value * 10 + (c - '0')));
+            }
+            m_rpn.push_back(integer);
+            operand = false;
         }
         else if (t == TokenType::TRUE || t == TokenType::FALSE) {
-            output.push_back(std::make_unique<NodeBoolean>(advance()));
+            advance();
+            NodeExpression boolean{ExprKind::BOOLEAN};
+            boolean.value = t == TokenType::TRUE;
+            m_rpn.push_back(boolean);
+            operand = false;
+        }
+        else if (t == TokenType::IDENTIFIER && peek(1).type == TokenType::LBRACKET) {
+            Token name = advance();
+            advance();
+            m_calls.push_back({name, 0, m_rpn.size()});
+            m_operators.push_back(TokenType::FUNCTION);
+            open++;
         }
         else if (t == TokenType::IDENTIFIER) {
-            output.push_back(std::make_unique<NodeIdentifier>(advance()));
+            Token name = advance();
+            NodeExpression identifier = at(NodeExpression{ExprKind::IDENTIFIER}, name);
+            identifier.name = name.symbol;
+            m_rpn.push_back(identifier);
+            operand = false;
         }
         else if (isOperator(t)) {
-            while (!operators.empty() && isOperator(operators.top()) &&
-                   getPrecedence(getOperator(operators.top())) >= getPrecedence(getOperator(t))) {
-                output.push_back(std::make_unique<NodeOperator>(Token{operators.top(), std::nullopt}));
-                operators.pop();
+            if (operand) throw error(peek(), "an operand");
+            while (!m_operators.empty() && isOperator(m_operators.back()) &&
+                   getPrecedence(m_operators.back()) >= getPrecedence(t)) {
+                popOperator();
             }
-            operators.push(t);
+            m_operators.push_back(t);
+            operand = true;
             advance();
         }
         else if (t == TokenType::LBRACKET) {
-            operators.push(t);
+            m_operators.push_back(t);
+            open++;
             advance();
         }
-        else if (t == TokenType::RBRACKET) {
-            while (!operators.empty() && operators.top() != TokenType::LBRACKET) {
-                output.push_back(std::make_unique<NodeOperator>(Token{operators.top(), std::nullopt}));
-                operators.pop();
+        else if (t == TokenType::COMMA && !m_calls.empty()) {
+            if (operand) throw error(peek(), "an operand");
+            while (!m_operators.empty() && m_operators.back() != TokenType::FUNCTION &&
+                   m_operators.back() != TokenType::LBRACKET) {
+                popOperator();
             }
-            if (!operators.empty()) operators.pop();
+            /* Arguments are separated at the call's own bracket, not inside a grouping one: f((1, 2)) */
+            if (m_operators.back() == TokenType::LBRACKET) throw error(peek(), "')'");
+            m_calls.back().argc++;
+            operand = true;
+            advance();
+        }
+        else if (t == TokenType::RBRACKET && open > 0) {
+            /* Only a call's own bracket may close with nothing in it: f() */
+            bool emptyCall = !m_operators.empty() && m_operators.back() == TokenType::FUNCTION &&
+                             m_rpn.size() == m_calls.back().outputBase && m_calls.back().argc == 0;
+            if (operand && !emptyCall) throw error(peek(), "an operand");
+            while (!m_operators.empty() && m_operators.back() != TokenType::LBRACKET &&
+                   m_operators.back() != TokenType::FUNCTION) {
+                popOperator();
+            }
+            if (!m_operators.empty() && m_operators.back() == TokenType::FUNCTION) {
+                PendingCall call = m_calls.back();
+                m_calls.pop_back();
+                NodeExpression node = at(NodeExpression{ExprKind::CALL}, call.name);
+                node.name = call.name.symbol;
+                node.argc = call.argc + (m_rpn.size() > call.outputBase ? 1 : 0);
+                m_rpn.push_back(node);
+            }
+            if (!m_operators.empty()) m_operators.pop_back();
+            open--;
+            operand = false;
             advance();
         }
         else {
             break;
         }
     }
+    if (operand) throw error(peek(), m_rpn.empty() ? "an expression" : "an operand");
+    if (open > 0) throw error(peek(), "')'");
 
-    while (!operators.empty()) {
-        output.push_back(std::make_unique<NodeOperator>(Token{operators.top(), std::nullopt}));
-        operators.pop();
+    while (!m_operators.empty()) {
+        popOperator();
     }
 
-    consume(TokenType::SEMI);
-    return std::make_unique<NodeArithmetic>(std::move(output));
+    return NodeArithmetic{m_program->arena.copy(m_rpn.data(), m_rpn.size())};
 }
 
-std::unique_ptr<NodeReturn> Parser::parseReturn() {
-    consume(TokenType::RETURN);
-    return std::make_unique<NodeReturn>(parseArithmetic());
+NodeStatement Parser::parseReturn() {
+    Token keyword = consume(TokenType::RETURN);
+    return at(NodeStatement{StmtKind::RETURN, false, 0, parseArithmetic()}, keyword);
+}
+
+// If parser: if (cond) { ... } [else { ... } | else if ...]
+NodeStatement Parser::parseIf() {
+    Token keyword = consume(TokenType::IF);
+    NodeStatement statement = at(NodeStatement{StmtKind::IF, false, 0, parseCondition()}, keyword);
+    consume(TokenType::LBRACE);
+    statement.body = parseBody();
+
+    if (checkAdvance(TokenType::ELSE)) {
+        if (check(TokenType::IF)) {
+            NodeStatement nested = parseIf();
+            statement.otherwise = NodeBody{m_program->arena.copy(&nested, 1)};
+        } else {
+            consume(TokenType::LBRACE);
+            statement.otherwise = parseBody();
+        }
+    }
+    return statement;
+}
+
+// While parser: while (cond) { ... }
+NodeStatement Parser::parseWhile() {
+    Token keyword = consume(TokenType::WHILE);
+    NodeStatement statement = at(NodeStatement{StmtKind::WHILE, false, 0, parseCondition()}, keyword);
+    consume(TokenType::LBRACE);
+    m_loops++;
+    statement.body = parseBody();
+    m_loops--;
+    return statement;
+}
+
+// Break/continue parser: break; or continue; inside a while's body
+NodeStatement Parser::parseJump() {
+    Token keyword = advance();
+    if (m_loops == 0) throw SyntaxError{keyword, "'" + std::string(spelling(keyword.type)) + "' outside a loop"};
+    consume(TokenType::SEMI);
+    return at(NodeStatement{keyword.type == TokenType::BREAK ? StmtKind::BREAK : StmtKind::CONTINUE}, keyword);
 }
 
 // ============================= Arithmetic Helper Methods =============================
 
 bool Parser::isOperator(TokenType type) {
-    return type == TokenType::PLUS ||
-           type == TokenType::MINUS ||
-           type == TokenType::MULTIPLY ||
-           type == TokenType::DIVIDE;
+    return getPrecedence(type) > 0;
 }
 
-char Parser::getOperator(TokenType op) {
-    switch (op) {
-        case TokenType::PLUS: return '+';
-        case TokenType::MINUS: return '-';
-        case TokenType::MULTIPLY: return '*';
-        case TokenType::DIVIDE: return '/';
-        default: return '\0';
-    }
+void Parser::popOperator() {
+    NodeExpression node{ExprKind::OPERATOR};
+    node.op = m_operators.back() == TokenType::NEGATE ? TokenType::MINUS : m_operators.back();
+    m_operators.pop_back();
+    m_rpn.push_back(node);
 }
 
-int Parser::getPrecedence(char op) {
+/* Comparisons bind loosest, so `a + 1 < b * 2` compares the two sums */
+int Parser::getPrecedence(TokenType op) {
     switch (op) {
-        case '+':
-        case '-': return 1;
-        case '*':
-        case '/': return 2;
+        case TokenType::EQUALS:
+        case TokenType::NOT_EQUALS:
+        case TokenType::LESS:
+        case TokenType::GREATER:
+        case TokenType::LESS_EQUAL:
+        case TokenType::GREATER_EQUAL: return 1;
+        case TokenType::PLUS:
+        case TokenType::MINUS: return 2;
+        case TokenType::MULTIPLY:
+        case TokenType::DIVIDE: return 3;
+        case TokenType::NEGATE: return 4;
         default: return 0;
     }
 }
@@ -216,18 +380,28 @@ int Parser::getPrecedence(char op) {
 
 // ================================== Token Management =================================
 
-Token Parser::peek() const {
-    return m_tokens.at(m_idx);
+const Token& Parser::peek(size_t ahead) {
+    static_assert((LOOKAHEAD & (LOOKAHEAD - 1)) == 0, "ring size must be a power of two");
+    while (m_buffered <= ahead) {
+        m_ring[(m_head + m_buffered) & (LOOKAHEAD - 1)] = m_lexer.next();
+        m_buffered++;
+    }
+    return m_ring[(m_head + ahead) & (LOOKAHEAD - 1)];
 }
 
 Token Parser::consume(TokenType type) {
     if (check(type)) return advance();
-    throw error(peek());
+    bool quoted = type != TokenType::IDENTIFIER && type != TokenType::INT_LIT && type != TokenType::END_OF_FILE;
+    throw error(peek(), quoted ? std::string("'") + spelling(type) + "'" : spelling(type));
 }
 
 Token Parser::advance() {
-    if (!atEnd()) return m_tokens.at(m_idx++);
-    return m_tokens.at(m_idx);
+    Token token = peek();
+    if (token.type != TokenType::END_OF_FILE) {
+        m_head = (m_head + 1) & (LOOKAHEAD - 1);
+        m_buffered--;
+    }
+    return token;
 }
 
 bool Parser::check(TokenType type) {
@@ -247,12 +421,74 @@ bool Parser::atEnd() {
     return peek().type == TokenType::END_OF_FILE;
 }
 
+std::string_view Parser::text(const Token& token) const {
+    return m_lexer.text(token);
+}
+
 
 
 // ==================================== Error Handling ====================================
 
-std::runtime_error Parser::error(const Token& token) {
-    // TODO: include token name -> error handling
-    std::string error_message;
-    return std::runtime_error(error_message);
+/* expected: what would have been accepted, already quoted where it is a symbol */
+Parser::SyntaxError Parser::error(const Token& token, const std::string& expected) {
+    if (token.type == TokenType::INVALID) {
+        std::string_view spelt = text(token);
+        bool digits = !spelt.empty() && spelt[0] >= '0' && spelt[0] <= '9';
+        return {token, std::string(digits ? "invalid integer '" : "invalid character '") + std::string(spelt) + "'"};
+    }
+    return {token, "expected " + expected + " but found " + describe(token)};
+}
+
+std::string Parser::describe(const Token& token) const {
+    switch (token.type) {
+    case TokenType::IDENTIFIER:
+    case TokenType::INT_LIT:
+        return "'" + std::string(text(token)) + "'";
+    case TokenType::END_OF_FILE:
+        return spelling(token.type);
+    default:
+        return std::string("'") + spelling(token.type) + "'";
+    }
+}
+
+void Parser::report(const SyntaxError& error) {
+    m_errors++;
+    if (!m_diagnostics) {
+        throw std::runtime_error(std::to_string(error.token.line) + ":" + std::to_string(error.token.column) +
+                                 ": " + error.message);
+    }
+    m_diagnostics->error(m_file, error.token.line, error.token.column, error.message);
+    if (m_diagnostics->full()) throw Abandon{};
+}
+
+/* Panic mode inside a body: past the `;` ending the broken statement, or past the block it
+ * opened (and an `else` block after it), or up to the `}` closing the body it sits in */
+void Parser::skipStatement() {
+    size_t depth = 0;
+    while (!atEnd() && !check(TokenType::FUNCTION)) {
+        TokenType t = peek().type;
+        if (t == TokenType::RBRACE) {
+            if (depth == 0) return;
+            advance();
+            if (--depth == 0 && !check(TokenType::ELSE)) return;
+            continue;
+        }
+        if (t == TokenType::LBRACE) depth++;
+        advance();
+        if (t == TokenType::SEMI && depth == 0) return;
+    }
+}
+
+/* Panic mode between declarations: up to the next `fn`, or `int name` (not a return type),
+ * outside any braces */
+void Parser::skipDeclaration() {
+    size_t depth = 0;
+    while (!atEnd()) {
+        TokenType t = peek().type;
+        bool global = t == TokenType::INT && peek(1).type == TokenType::IDENTIFIER;
+        if (depth == 0 && (t == TokenType::FUNCTION || global)) return;
+        if (t == TokenType::LBRACE) depth++;
+        if (t == TokenType::RBRACE && depth > 0) depth--;
+        advance();
+    }
 }
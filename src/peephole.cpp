@@ -0,0 +1,276 @@
+#include "peephole.h"
+
+static constexpr uint8_t R1 = 1;
+static constexpr uint8_t SP = 6;
+static constexpr uint8_t PC = 7;
+
+static const char* RULE_NAMES[] = {
+    "store-load", "load-load", "load-store", "self-move", "reverse-move", "sp-sink", "sp-merge", "dead-zero",
+};
+
+static bool fitsImmediate(int32_t value) {
+    return value >= -16 && value <= 15;
+}
+
+/* ADD/SUB SP, SP, #k as a signed adjustment, 0 if it isn't one */
+static int32_t spAdjust(const Instruction& i) {
+    if (i.mode != Mode::IMM || i.rd != SP || i.ra != SP || i.label != NO_LABEL) return 0;
+    if (i.op == Opcode::ADD) return i.imm;
+    if (i.op == Opcode::SUB) return -i.imm;
+    return 0;
+}
+
+/* LD/ST with a fixed address: [Ra, #imm] or [R0, #symbol] */
+static bool fixedAddress(const Instruction& i) {
+    return (i.op == Opcode::LD || i.op == Opcode::ST) && i.mode == Mode::IMM &&
+           i.ra != PC && i.rd != SP && i.rd != PC;
+}
+
+Peephole::Peephole(size_t window)
+    : m_window(window) {
+    m_enabled.fill(true);
+    m_hits.fill(0);
+}
+
+const char* Peephole::name(PeepholeRule rule) {
+    return RULE_NAMES[static_cast<size_t>(rule)];
+}
+
+std::optional<PeepholeRule> Peephole::rule(std::string_view name) {
+    for (size_t i = 0; i < RULES; i++) {
+        if (name == RULE_NAMES[i]) return static_cast<PeepholeRule>(i);
+    }
+    return std::nullopt;
+}
+
+void Peephole::run(Listing& listing) {
+    m_hits.fill(0);
+    m_listing = &listing;
+    m_code = &listing.code;
+    std::vector<Instruction>& code = listing.code;
+
+    m_labelAt.assign(listing.names.size(), SIZE_MAX);
+    for (size_t i = 0; i < code.size(); i++) {
+        if (code[i].op == Opcode::LABEL) m_labelAt[code[i].label] = i;
+    }
+    m_visited.assign(code.size(), false);
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        /* `ADD Rd, PC, #k` fixes the distance to its target, the k words after it can't shrink */
+        m_pinned.assign(code.size(), false);
+        for (size_t i = 0; i < code.size(); i++) {
+            const Instruction& in = code[i];
+            if (in.op > Opcode::OR || in.mode != Mode::IMM || in.ra != PC) continue;
+            m_pinned[i] = true;
+            for (size_t j = i + 1, words = 0; j < code.size() && words < static_cast<size_t>(in.imm); j++) {
+                m_pinned[j] = true;
+                if (code[j].emitsWord()) words++;
+            }
+        }
+
+        for (size_t at = 0; at < code.size(); at++) {
+            Instruction& in = code[at];
+            if (in.op == Opcode::NOP) continue;
+            if (in.op == Opcode::MOV && in.mode == Mode::REG && in.rd == in.ra &&
+                enabled(PeepholeRule::SELF_MOVE) && !m_pinned[at]) {
+                in.op = Opcode::NOP;
+                hit(PeepholeRule::SELF_MOVE);
+                changed = true;
+                continue;
+            }
+            if (fixedAddress(in)) changed |= forwardMemory(at);
+            else if (in.op == Opcode::MOV && in.mode == Mode::REG) changed |= reverseMove(at);
+            else if (spAdjust(in) != 0) changed |= stackPointer(at);
+            else if (in.op == Opcode::MOV && in.mode == Mode::IMM && in.imm == 0) changed |= deadZero(at);
+        }
+    }
+
+    listing.compact();
+    m_listing = nullptr;
+    m_code = nullptr;
+}
+
+size_t Peephole::next(size_t at) const {
+    const std::vector<Instruction>& code = *m_code;
+    for (at++; at < code.size() && code[at].op == Opcode::NOP; at++) {}
+    return at;
+}
+
+/* Control can enter or leave here, so nothing is known across it */
+bool Peephole::barrier(const Instruction& i) const {
+    switch (i.op) {
+    case Opcode::LABEL: case Opcode::B: case Opcode::DEFW: case Opcode::DATA:
+    case Opcode::ORG: case Opcode::EQU:
+        return true;
+    default:
+        return i.writes(PC);
+    }
+}
+
+// ================================== Memory Forwarding ==================================
+
+/* After `ST r, [a]` or `LD r, [a]`, r holds mem[a] until r, the base or memory changes */
+bool Peephole::forwardMemory(size_t at) {
+    std::vector<Instruction>& code = *m_code;
+    const Instruction known = code[at];
+    if (known.op == Opcode::LD && (known.rd == known.ra || known.rd == 0)) return false;
+    PeepholeRule forward = known.op == Opcode::ST ? PeepholeRule::STORE_LOAD : PeepholeRule::LOAD_LOAD;
+    int32_t delta = 0;      // SP moved since, when the base is SP
+
+    size_t j = at;
+    for (size_t seen = 0; seen < m_window; seen++) {
+        j = next(j);
+        if (j >= code.size() || barrier(code[j])) return false;
+        Instruction& in = code[j];
+
+        if (known.ra == SP && spAdjust(in) != 0) {
+            delta += spAdjust(in);
+            continue;
+        }
+        bool same = fixedAddress(in) && in.ra == known.ra && in.label == known.label &&
+                    in.imm == known.imm - delta;
+        if (same && in.op == Opcode::LD && enabled(forward)) {
+            if (in.rd == known.rd) {
+                if (m_pinned[j]) return false;
+                in.op = Opcode::NOP;
+            } else {
+                in = Instruction::move(in.rd, known.rd);
+            }
+            hit(forward);
+            return true;
+        }
+        if (same && in.op == Opcode::ST && in.rd == known.rd && enabled(PeepholeRule::LOAD_STORE) && !m_pinned[j]) {
+            in.op = Opcode::NOP;
+            hit(PeepholeRule::LOAD_STORE);
+            return true;
+        }
+        /* Another store only leaves mem[a] alone if it provably hits a different word */
+        if (in.op == Opcode::ST) {
+            bool disjoint = fixedAddress(in) && in.ra == known.ra && in.label == known.label && !same &&
+                            (known.ra == SP || known.ra == 0);
+            if (!disjoint) return false;
+        }
+        if (in.writes(known.rd) || in.writes(known.ra)) return false;
+    }
+    return false;
+}
+
+// ==================================== Register Moves ====================================
+
+/* After `MOV r, s` both registers hold the same value until either is written, so moving it
+ * back is a no-op: a call's result parked in a register and then returned, for one */
+bool Peephole::reverseMove(size_t at) {
+    std::vector<Instruction>& code = *m_code;
+    const Instruction known = code[at];
+    if (!enabled(PeepholeRule::REVERSE_MOVE) || known.rd == known.ra || known.rd == PC || known.ra == PC) return false;
+
+    size_t j = at;
+    for (size_t seen = 0; seen < m_window; seen++) {
+        j = next(j);
+        if (j >= code.size() || barrier(code[j])) return false;
+        Instruction& in = code[j];
+        if (in.op == Opcode::MOV && in.mode == Mode::REG && in.rd == known.ra && in.ra == known.rd &&
+            !in.setFlags && !m_pinned[j]) {
+            in.op = Opcode::NOP;
+            hit(PeepholeRule::REVERSE_MOVE);
+            return true;
+        }
+        if (in.writes(known.rd) || in.writes(known.ra)) return false;
+    }
+    return false;
+}
+
+// ================================ Stack Pointer Arithmetic ================================
+
+/* Pushing SP adjustments down past SP-relative accesses until they meet and merge */
+bool Peephole::stackPointer(size_t at) {
+    std::vector<Instruction>& code = *m_code;
+    size_t j = next(at);
+    if (j >= code.size() || m_pinned[at] || m_pinned[j]) return false;
+    Instruction& adjust = code[at];
+    Instruction& in = code[j];
+    int32_t k = spAdjust(adjust);
+
+    if (spAdjust(in) != 0 && enabled(PeepholeRule::SP_MERGE)) {
+        int32_t total = k + spAdjust(in);
+        if (total < -15 || total > 15) return false;
+        if (total == 0) {
+            adjust.op = Opcode::NOP;
+        } else {
+            adjust = Instruction::aluImm(total > 0 ? Opcode::ADD : Opcode::SUB, SP, SP, total > 0 ? total : -total);
+        }
+        in.op = Opcode::NOP;
+        hit(PeepholeRule::SP_MERGE);
+        return true;
+    }
+    if (fixedAddress(in) && in.ra == SP && in.label == NO_LABEL && fitsImmediate(in.imm + k) &&
+        enabled(PeepholeRule::SP_SINK)) {
+        Instruction moved = in;
+        moved.imm += k;
+        in = adjust;
+        adjust = moved;
+        hit(PeepholeRule::SP_SINK);
+        return true;
+    }
+    return false;
+}
+
+// ===================================== Dead Zeroing =====================================
+
+bool Peephole::deadZero(size_t at) {
+    const Instruction& in = (*m_code)[at];
+    if (!enabled(PeepholeRule::DEAD_ZERO) || m_pinned[at] || in.rd == SP || in.rd == PC) return false;
+    if (isLive(at + 1, in.rd)) return false;
+    (*m_code)[at].op = Opcode::NOP;
+    hit(PeepholeRule::DEAD_ZERO);
+    return true;
+}
+
+/* Whether reg may be read on some path from `from` before being written
+ *  - a call reads the argument registers R2-R5 and kills the rest, the caller reloads what it saved
+ *  - a return only reads R1, and so does main's `halt: B halt`, a branch to itself
+ *  - anything else leaving the listing's known control flow counts as a read, falling into
+ *    the next function's entry too */
+bool Peephole::isLive(size_t from, uint8_t reg) {
+    const std::vector<Instruction>& code = *m_code;
+    std::vector<size_t> touched;
+    bool live = false;
+    m_work.assign(1, from);
+
+    while (!m_work.empty() && !live) {
+        size_t at = m_work.back();
+        m_work.pop_back();
+        for (; at < code.size(); at++) {
+            if (m_visited[at]) break;
+            m_visited[at] = true;
+            touched.push_back(at);
+
+            const Instruction& in = code[at];
+            if (in.op == Opcode::LABEL && m_listing->isFunction(in.label)) { live = true; break; }
+            if (in.op == Opcode::NOP || in.op == Opcode::LABEL) continue;
+            if (in.op == Opcode::B) {
+                if (in.call) { live = reg >= 2 && reg <= 5; break; }
+                size_t target = in.label < m_labelAt.size() ? m_labelAt[in.label] : SIZE_MAX;
+                if (target == SIZE_MAX) { live = true; break; }
+                if (in.cond == Cond::AL && next(target) == at) { live = reg == R1; break; }
+                m_work.push_back(target);
+                if (in.cond == Cond::AL) break;
+                continue;
+            }
+            if (in.reads(reg)) { live = true; break; }
+            if (in.op == Opcode::LD && in.rd == PC && in.ra == SP) { live = reg == R1; break; }
+            if (in.writes(reg)) break;
+            if (in.writes(PC) || !in.emitsWord() || in.op == Opcode::DEFW || in.op == Opcode::DATA) {
+                live = true;
+                break;
+            }
+        }
+        if (at >= code.size()) live = true;
+    }
+
+    for (size_t at : touched) m_visited[at] = false;
+    m_work.clear();
+    return live;
+}
@@ -0,0 +1,171 @@
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <malloc.h>
+
+// ===================================== Heap Counts ====================================
+
+/* Per thread, so counting costs no atomics; frees on another thread than the allocation
+ * only shift which thread's live figure drops */
+struct HeapCounts {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+    int64_t live = 0;
+    int64_t peak = 0;
+};
+
+static std::atomic<bool> g_counting{false};
+static thread_local HeapCounts t_heap;
+
+/* Aligned requests beyond what malloc guarantees go to posix_memalign, whose blocks free()
+ * and malloc_usable_size() take all the same. Null when out of memory */
+static void* allocate(size_t size, size_t alignment = 0) noexcept {
+    if (size == 0) size = 1;
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t)) p = std::malloc(size);
+    else if (posix_memalign(&p, alignment, size) != 0) p = nullptr;
+    if (p && g_counting.load(std::memory_order_relaxed)) {
+        int64_t usable = static_cast<int64_t>(malloc_usable_size(p));
+        t_heap.allocations++;
+        t_heap.bytes += static_cast<uint64_t>(usable);
+        t_heap.live += usable;
+        if (t_heap.live > t_heap.peak) t_heap.peak = t_heap.live;
+    }
+    return p;
+}
+
+static void* allocateOrThrow(size_t size, size_t alignment = 0) {
+    void* p = allocate(size, alignment);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+static void release(void* p) noexcept {
+    if (p && g_counting.load(std::memory_order_relaxed)) t_heap.live -= static_cast<int64_t>(malloc_usable_size(p));
+    std::free(p);
+}
+
+/* Every replaceable form, so nothing the standard library allocates escapes the counts */
+void* operator new(size_t size) { return allocateOrThrow(size); }
+void* operator new[](size_t size) { return allocateOrThrow(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new(size_t size, std::align_val_t align) { return allocateOrThrow(size, static_cast<size_t>(align)); }
+void* operator new[](size_t size, std::align_val_t align) { return allocateOrThrow(size, static_cast<size_t>(align)); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<size_t>(align));
+}
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return allocate(size, static_cast<size_t>(align));
+}
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { release(p); }
+
+// ====================================== Profiler ======================================
+
+static uint32_t threadIndex() {
+    static std::atomic<uint32_t> next{0};
+    static thread_local uint32_t index = next++;
+    return index;
+}
+
+Profiler::Profiler(bool enabled, bool trace)
+    : m_enabled(enabled || trace), m_trace(trace), m_start(std::chrono::steady_clock::now()) {
+    if (m_enabled) g_counting = true;
+}
+
+Profiler::~Profiler() {
+    if (m_enabled) g_counting = false;
+}
+
+Profiler::Scope::Scope(Profiler& profiler, const char* name)
+    : m_profiler(profiler.m_enabled ? &profiler : nullptr), m_name(name) {
+    if (!m_profiler) return;
+    m_allocations = t_heap.allocations;
+    m_bytes = t_heap.bytes;
+    m_live = t_heap.live;
+    m_outerPeak = t_heap.peak;
+    t_heap.peak = t_heap.live;
+    m_start = std::chrono::steady_clock::now();
+}
+
+Profiler::Scope::~Scope() {
+    if (!m_profiler) return;
+    int64_t peak = t_heap.peak - m_live;
+    t_heap.peak = std::max(t_heap.peak, m_outerPeak);
+    m_profiler->record(m_name, m_start, t_heap.allocations - m_allocations, t_heap.bytes - m_bytes, peak);
+}
+
+void Profiler::record(const char* name, std::chrono::steady_clock::time_point start,
+                      uint64_t allocations, uint64_t bytes, int64_t peak) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto phase = std::find_if(m_phases.begin(), m_phases.end(), [&](const Phase& p) { return p.name == name; });
+    if (phase == m_phases.end()) {
+        m_phases.push_back(Phase{name});
+        phase = m_phases.end() - 1;
+    }
+    phase->runs++;
+    phase->ms += std::chrono::duration<double, std::milli>(now - start).count();
+    phase->allocations += allocations;
+    phase->bytes += bytes;
+    phase->peak = std::max(phase->peak, peak);
+    if (m_trace) {
+        m_events.push_back({name, threadIndex(),
+                            std::chrono::duration<double, std::micro>(start - m_start).count(),
+                            std::chrono::duration<double, std::micro>(now - start).count()});
+    }
+}
+
+// ====================================== Reports =======================================
+
+/*  phase        runs        ms    allocs       bytes    peak bytes
+ *  parse           2     0.412       118       53120         26624
+ *  ...
+ *  total                 1.873 */
+std::string Profiler::report() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << std::left << std::setw(12) << "phase" << std::right
+        << std::setw(6) << "runs" << std::setw(10) << "ms" << std::setw(10) << "allocs"
+        << std::setw(12) << "bytes" << std::setw(14) << "peak bytes" << "\n";
+    for (const Phase& phase : m_phases) {
+        out << std::left << std::setw(12) << phase.name << std::right << std::setw(6) << phase.runs
+            << std::setw(10) << phase.ms << std::setw(10) << phase.allocations
+            << std::setw(12) << phase.bytes << std::setw(14) << phase.peak << "\n";
+    }
+    out << std::left << std::setw(18) << "total" << std::right << std::setw(10)
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count() << "\n";
+    return out.str();
+}
+
+/* {"traceEvents": [{"name": "parse", "ph": "X", "pid": 1, "tid": 0, "ts": 12.5, "dur": 401.2}, ...]}
+ * Complete events only, which is all chrome://tracing and Perfetto need for nested spans */
+bool Profiler::writeTrace(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ofstream out(path);
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+    for (size_t i = 0; i < m_events.size(); i++) {
+        const Event& event = m_events[i];
+        out << (i > 0 ? ",\n  " : "\n  ") << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+            << event.thread << ", \"ts\": " << event.start << ", \"dur\": " << event.duration << "}";
+    }
+    out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    return static_cast<bool>(out);
+}
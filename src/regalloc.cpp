@@ -0,0 +1,75 @@
+#include <algorithm>
+
+#include "regalloc.h"
+
+LinearScan::LinearScan(std::vector<uint8_t> registers)
+    : m_registers(std::move(registers)) {}
+
+Allocation LinearScan::allocate(std::vector<LiveInterval> intervals, size_t valueCount) const {
+    Allocation result;
+    result.reg.assign(valueCount, Allocation::SPILLED);
+    result.slot.assign(valueCount, -1);
+
+    std::sort(intervals.begin(), intervals.end(), [](const LiveInterval& a, const LiveInterval& b) {
+        return a.start != b.start ? a.start < b.start : a.value < b.value;
+    });
+
+    std::vector<uint8_t> freeRegs(m_registers.rbegin(), m_registers.rend());
+    std::vector<const LiveInterval*> active;        // holding a register, sorted by end
+    std::vector<const LiveInterval*> spilledActive; // holding a slot
+    std::vector<std::pair<int16_t, uint32_t>> freeSlots;   // slot, point its last occupant died
+
+    auto giveSlot = [&](const LiveInterval* interval) {
+        result.spills++;
+        if (interval->hasHome) return;
+        /* A stolen interval started earlier, only slots free since its start will do */
+        auto reusable = std::find_if(freeSlots.begin(), freeSlots.end(),
+            [&](const std::pair<int16_t, uint32_t>& free) { return free.second <= interval->start; });
+        int16_t slot;
+        if (reusable != freeSlots.end()) {
+            slot = reusable->first;
+            freeSlots.erase(reusable);
+        } else {
+            slot = static_cast<int16_t>(result.slots++);
+        }
+        result.slot[interval->value] = slot;
+        spilledActive.push_back(interval);
+    };
+
+    for (const LiveInterval& current : intervals) {
+        /* Expiring intervals that end at or before this start, their registers/slots are reusable */
+        while (!active.empty() && active.front()->end <= current.start) {
+            freeRegs.push_back(result.reg[active.front()->value]);
+            active.erase(active.begin());
+        }
+        for (size_t i = 0; i < spilledActive.size();) {
+            if (spilledActive[i]->end <= current.start) {
+                freeSlots.push_back({result.slot[spilledActive[i]->value], spilledActive[i]->end});
+                spilledActive[i] = spilledActive.back();
+                spilledActive.pop_back();
+            } else {
+                i++;
+            }
+        }
+
+        if (!freeRegs.empty()) {
+            result.reg[current.value] = static_cast<int8_t>(freeRegs.back());
+            freeRegs.pop_back();
+        } else if (!active.empty() && active.back()->end > current.end) {
+            /* Stealing the register of the interval that lives longest */
+            const LiveInterval* victim = active.back();
+            active.pop_back();
+            result.reg[current.value] = result.reg[victim->value];
+            result.reg[victim->value] = Allocation::SPILLED;
+            giveSlot(victim);
+        } else {
+            giveSlot(&current);
+            continue;
+        }
+
+        auto at = std::upper_bound(active.begin(), active.end(), &current,
+            [](const LiveInterval* a, const LiveInterval* b) { return a->end < b->end; });
+        active.insert(at, &current);
+    }
+    return result;
+}
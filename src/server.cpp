@@ -0,0 +1,222 @@
+#include "server.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Anything longer is a client speaking some other protocol */
+static constexpr uint32_t MAX_MESSAGE = 256u << 20;
+
+// ===================================== Messages =======================================
+
+static void put(std::string& out, uint32_t value) {
+    char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8),
+                     static_cast<char>(value >> 16), static_cast<char>(value >> 24)};
+    out.append(bytes, 4);
+}
+
+static void put(std::string& out, const std::string& text) {
+    put(out, static_cast<uint32_t>(text.size()));
+    out += text;
+}
+
+/* Reads fields off a received message, failing for good once one runs past its end */
+class Fields {
+public:
+    explicit Fields(const std::string& message) : m_message(message) {}
+
+    bool get(uint32_t& value) {
+        if (m_message.size() - m_at < 4) return false;
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(m_message.data() + m_at);
+        value = p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+        m_at += 4;
+        return true;
+    }
+    bool get(std::string& text) {
+        uint32_t size = 0;
+        if (!get(size) || m_message.size() - m_at < size) return false;
+        text.assign(m_message, m_at, size);
+        m_at += size;
+        return true;
+    }
+    bool done() const { return m_at == m_message.size(); }
+
+private:
+    const std::string& m_message;
+    size_t m_at = 0;
+};
+
+static bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t got = ::read(fd, data, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        data += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+/* The length goes in front once the body is built, so a message is one send() */
+static bool sendMessage(int fd, std::string& message) {
+    uint32_t size = static_cast<uint32_t>(message.size() - 4);
+    for (int i = 0; i < 4; i++) message[static_cast<size_t>(i)] = static_cast<char>(size >> (8 * i));
+    return writeAll(fd, message.data(), message.size());
+}
+
+static bool receiveMessage(int fd, std::string& message) {
+    unsigned char length[4];
+    if (!readAll(fd, reinterpret_cast<char*>(length), 4)) return false;
+    uint32_t size = length[0] | length[1] << 8 | length[2] << 16 | static_cast<uint32_t>(length[3]) << 24;
+    if (size > MAX_MESSAGE) return false;
+    message.resize(size);
+    return readAll(fd, message.data(), size);
+}
+
+bool CompileServer::send(int fd, const Request& request) {
+    size_t size = 12;
+    for (const std::string& arg : request.args) size += 4 + arg.size();
+    for (const File& file : request.files) size += 8 + file.name.size() + file.source.size();
+    std::string message(4, '\0');
+    message.reserve(size);
+    put(message, static_cast<uint32_t>(request.args.size()));
+    for (const std::string& arg : request.args) put(message, arg);
+    put(message, static_cast<uint32_t>(request.files.size()));
+    for (const File& file : request.files) {
+        put(message, file.name);
+        put(message, file.source);
+    }
+    return sendMessage(fd, message);
+}
+
+bool CompileServer::send(int fd, const Response& response) {
+    std::string message(4, '\0');
+    message.reserve(16 + response.output.size() + response.messages.size());
+    put(message, response.status);
+    put(message, response.output);
+    put(message, response.messages);
+    return sendMessage(fd, message);
+}
+
+bool CompileServer::receive(int fd, Request& request) {
+    std::string message;
+    if (!receiveMessage(fd, message)) return false;
+    Fields fields(message);
+    uint32_t count = 0;
+    if (!fields.get(count) || count > message.size() / 4) return false;
+    request.args.resize(count);
+    for (std::string& arg : request.args) {
+        if (!fields.get(arg)) return false;
+    }
+    if (!fields.get(count) || count > message.size() / 8) return false;
+    request.files.resize(count);
+    for (File& file : request.files) {
+        if (!fields.get(file.name) || !fields.get(file.source)) return false;
+    }
+    return fields.done();
+}
+
+bool CompileServer::receive(int fd, Response& response) {
+    std::string message;
+    if (!receiveMessage(fd, message)) return false;
+    Fields fields(message);
+    return fields.get(response.status) && fields.get(response.output) && fields.get(response.messages) && fields.done();
+}
+
+// ====================================== Sockets =======================================
+
+static sockaddr_un address(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("socket path too long: " + path);
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+int CompileServer::connect(const std::string& path) {
+    sockaddr_un addr = address(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Only one server runs per process, the signal handler needs the path without locking */
+static char g_socketPath[sizeof(sockaddr_un::sun_path)];
+
+static void stop(int) {
+    unlink(g_socketPath);
+    _exit(EXIT_SUCCESS);
+}
+
+CompileServer::CompileServer(std::string path, Handler handler)
+    : m_path(std::move(path)), m_handler(std::move(handler)) {
+    sockaddr_un addr = address(m_path);
+    int running = connect(m_path);
+    if (running >= 0) {
+        close(running);
+        throw std::runtime_error("a server is already listening on " + m_path);
+    }
+    unlink(m_path.c_str());
+    m_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_listener < 0 || bind(m_listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(m_listener, SOMAXCONN) != 0) {
+        std::string reason = std::strerror(errno);
+        if (m_listener >= 0) close(m_listener);
+        throw std::runtime_error("can't listen on " + m_path + ": " + reason);
+    }
+}
+
+CompileServer::~CompileServer() {
+    close(m_listener);
+    unlink(m_path.c_str());
+}
+
+void CompileServer::serve() {
+    std::memcpy(g_socketPath, m_path.c_str(), m_path.size() + 1);
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+    for (;;) {
+        int fd = accept4(m_listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            throw std::runtime_error(std::string("accept failed: ") + std::strerror(errno));
+        }
+        std::thread(&CompileServer::handle, this, fd).detach();
+    }
+}
+
+/* A request the handler throws on still gets an answer, only a broken connection ends it */
+void CompileServer::handle(int fd) const {
+    Request request;
+    while (receive(fd, request)) {
+        Response response;
+        try {
+            response = m_handler(request);
+        } catch (const std::exception& e) {
+            response.status = EXIT_FAILURE;
+            response.messages += std::string("error: ") + e.what() + "\n";
+        }
+        if (!send(fd, response)) break;
+    }
+    close(fd);
+}
@@ -0,0 +1,164 @@
+#include "simulator.h"
+
+static const char* CLASS_NAMES[] = {"alu", "load", "store", "branch taken", "branch not taken"};
+
+Simulator::Simulator(const Image& image, CycleModel model)
+    : m_image(image), m_model(model), m_memory(image.memory),
+      m_hits(Image::WORDS, 0), m_hitCycles(Image::WORDS, 0) {}
+
+const char* Simulator::className(InstructionClass c) {
+    return CLASS_NAMES[static_cast<size_t>(c)];
+}
+
+bool Simulator::flag(char name) const {
+    switch (name) {
+    case 'N': return m_n;
+    case 'Z': return m_z;
+    case 'V': return m_v;
+    case 'C': return m_c;
+    default:  return false;
+    }
+}
+
+Simulator::Stop Simulator::run(uint64_t stepLimit) {
+    while (m_steps < stepLimit) {
+        if (!m_image.code[pc()]) return Stop::BAD_FETCH;
+        step();
+        if (m_halted) return Stop::HALTED;
+    }
+    return Stop::STEP_LIMIT;
+}
+
+uint16_t Simulator::load(uint16_t address) {
+    m_reads++;
+    if (address >= PERIPHERAL_BASE) m_peripheral++;
+    return m_memory[address];
+}
+
+void Simulator::store(uint16_t address, uint16_t value) {
+    m_writes++;
+    if (address >= PERIPHERAL_BASE) m_peripheral++;
+    m_memory[address] = value;
+}
+
+bool Simulator::condition(uint8_t cond) const {
+    switch (cond) {
+    case 0:  return true;                   // AL
+    case 1:  return false;                  // NV
+    case 2:  return m_c && !m_z;            // HI
+    case 3:  return !m_c || m_z;            // LS
+    case 4:  return !m_c;                   // CC
+    case 5:  return m_c;                    // CS
+    case 6:  return !m_z;                   // NE
+    case 7:  return m_z;                    // EQ
+    case 8:  return !m_v;                   // VC
+    case 9:  return m_v;                    // VS
+    case 10: return !m_n;                   // PL
+    case 11: return m_n;                    // MI
+    case 12: return m_n == m_v;             // GE
+    case 13: return m_n != m_v;             // LT
+    case 14: return !m_z && m_n == m_v;     // GT
+    default: return m_z || m_n != m_v;      // LE
+    }
+}
+
+/* Fetch, then PC already points at the next word, which is what R7 reads as */
+void Simulator::step() {
+    uint16_t address = pc();
+    uint16_t ir = m_memory[address];
+    m_regs[7] = static_cast<uint16_t>(address + 1);
+
+    uint8_t op = ir >> 13;
+    bool immediate = (ir >> 12) & 1;
+    bool bit11 = (ir >> 11) & 1;
+    uint8_t rd = (ir >> 8) & 7, ra = (ir >> 5) & 7, rb = (ir >> 2) & 7;
+    uint16_t imm = static_cast<uint16_t>(static_cast<int16_t>(static_cast<int16_t>(ir << 11) >> 11));
+
+    InstructionClass cls;
+    uint32_t cycles = m_model.fetch + m_model.execute;
+    bool jumped = false;
+
+    auto write = [&](uint8_t r, uint16_t value) {
+        if (r == 0) return;
+        if (r == 7) jumped = true;
+        m_regs[r] = value;
+    };
+
+    if (op == stump::BRANCH) {
+        uint8_t cond = (ir >> 8) & 0xF;
+        int8_t offset = static_cast<int8_t>(ir & 0xFF);
+        if (condition(cond)) {
+            cls = InstructionClass::BRANCH_TAKEN;
+            m_regs[7] = static_cast<uint16_t>(m_regs[7] + offset);
+            jumped = true;
+            if (m_regs[7] == address) m_halted = true;
+        } else {
+            cls = InstructionClass::BRANCH_NOT_TAKEN;
+        }
+    } else if (op == stump::MEM) {
+        uint16_t ea = static_cast<uint16_t>(m_regs[ra] + (immediate ? imm : m_regs[rb]));
+        cycles += m_model.memory;
+        if (bit11) {
+            cls = InstructionClass::STORE;
+            store(ea, m_regs[rd]);
+        } else {
+            cls = InstructionClass::LOAD;
+            write(rd, load(ea));
+        }
+    } else {
+        cls = InstructionClass::ALU;
+        uint16_t a = m_regs[ra];
+        bool shiftCarry = m_c;
+        if (!immediate) {
+            switch (ir & 3) {
+            case stump::ASR:
+                shiftCarry = a & 1;
+                a = static_cast<uint16_t>(static_cast<int16_t>(a) >> 1);
+                break;
+            case stump::ROR:
+                shiftCarry = a & 1;
+                a = static_cast<uint16_t>((a >> 1) | (a << 15));
+                break;
+            case stump::RRC:
+                shiftCarry = a & 1;
+                a = static_cast<uint16_t>((a >> 1) | (m_c << 15));
+                break;
+            default:
+                break;
+            }
+        }
+        uint16_t b = immediate ? imm : m_regs[rb];
+
+        uint32_t wide = 0;
+        bool arithmetic = op <= stump::SBC;
+        switch (op) {
+        case stump::ADD: wide = uint32_t(a) + b; break;
+        case stump::ADC: wide = uint32_t(a) + b + m_c; break;
+        case stump::SUB: b = static_cast<uint16_t>(~b); wide = uint32_t(a) + b + 1; break;
+        case stump::SBC: b = static_cast<uint16_t>(~b); wide = uint32_t(a) + b + m_c; break;
+        case stump::AND: wide = a & b; break;
+        default:         wide = a | b; break;
+        }
+        uint16_t result = static_cast<uint16_t>(wide);
+        if (bit11) {
+            m_n = result >> 15;
+            m_z = result == 0;
+            if (arithmetic) {
+                m_c = wide >> 16;
+                m_v = ((a ^ result) & (b ^ result)) >> 15;
+            } else {
+                m_c = shiftCarry;
+            }
+        }
+        write(rd, result);
+    }
+
+    if (jumped) cycles += m_model.branchTaken;
+    m_steps++;
+    m_cycles += cycles;
+    m_classCount[static_cast<size_t>(cls)]++;
+    m_classCycles[static_cast<size_t>(cls)] += cycles;
+    m_hits[address]++;
+    m_hitCycles[address] += cycles;
+    if (m_regs[6] > m_peakSP) m_peakSP = m_regs[6];
+}
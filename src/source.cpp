@@ -0,0 +1,39 @@
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.h"
+
+SourceBuffer::SourceBuffer(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw std::runtime_error("cannot stat " + path);
+    }
+
+    /* mmap of length 0 fails, empty file is just an empty view */
+    m_size = static_cast<size_t>(st.st_size);
+    if (m_size > 0) {
+        void* mapped = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("cannot map " + path);
+        }
+        madvise(mapped, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const char*>(mapped);
+    }
+    close(fd);
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
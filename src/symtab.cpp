@@ -0,0 +1,24 @@
+#include "symtab.h"
+#include <mutex>
+
+std::vector<Symbol> SymbolTable::import(const Interner& local) {
+    std::vector<Symbol> global(local.size());
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    for (Symbol s = 0; s < local.size(); s++) {
+        global[s] = m_interner.intern(local.name(s));
+    }
+    m_definitions.resize(m_interner.size());
+    return global;
+}
+
+std::optional<SymbolTable::Definition> SymbolTable::define(Symbol name, Kind kind, uint32_t module, uint32_t parameters) {
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    if (m_definitions[name]) return m_definitions[name];
+    m_definitions[name] = Definition{kind, module, parameters};
+    return std::nullopt;
+}
+
+std::optional<SymbolTable::Definition> SymbolTable::find(Symbol name) const {
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return name < m_definitions.size() ? m_definitions[name] : std::nullopt;
+}
@@ -0,0 +1,94 @@
+#include "tailcall.h"
+
+void TailCallEliminator::run(IrModule& module) {
+    m_eliminated = 0;
+    std::vector<Value> sites;
+    for (IrFunction& func : module.functions) {
+        sites.clear();
+        for (Value v = 0; v + 1 < func.code.size(); v++) {
+            const IrInst& call = func.code[v];
+            const IrInst& next = func.code[v + 1];
+            /* A call passing the wrong number of arguments is an error lowering has reported, not a loop */
+            if (call.op == IrOp::CALL && call.sym == func.name && call.b == func.parameters.size() &&
+                next.op == IrOp::RET && next.a == v) {
+                sites.push_back(v);
+            }
+        }
+        if (!sites.empty()) eliminate(func, sites);
+    }
+}
+
+/* Rebuilding the function behind a new entry block
+ *  b0:  parameters; jmp b1
+ *  b1:  a phi per parameter, then the old entry block
+ * every old block moves up one and each tail call's `call; ret` pair becomes `jmp b1` */
+void TailCallEliminator::eliminate(IrFunction& func, const std::vector<Value>& sites) {
+    uint32_t params = static_cast<uint32_t>(func.parameters.size());
+    uint32_t inputs = 1 + static_cast<uint32_t>(sites.size());
+    std::vector<Value> renumber(func.code.size(), NO_VALUE);
+    std::vector<IrInst> code;
+    std::vector<IrBlock> blocks;
+    std::vector<bool> tail(func.code.size(), false);
+    for (Value site : sites) tail[site] = true;
+
+    for (uint32_t i = 0; i < params; i++) {
+        IrInst param(IrOp::PARAM);
+        param.imm = static_cast<int32_t>(i);
+        code.push_back(param);
+    }
+    IrInst enter(IrOp::JMP);
+    enter.target = 1;
+    code.push_back(enter);
+    blocks.push_back({0, static_cast<uint32_t>(code.size())});
+
+    uint32_t firstInput = static_cast<uint32_t>(func.incoming.size());
+    for (uint32_t i = 0; i < params; i++) {
+        IrInst phi(IrOp::PHI);
+        phi.a = firstInput + i * inputs;
+        phi.b = inputs;
+        func.incoming.push_back({0, i});
+        func.incoming.resize(func.incoming.size() + sites.size());
+        code.push_back(phi);
+    }
+
+    uint32_t site = 0;
+    for (uint32_t b = 0; b < func.blocks.size(); b++) {
+        uint32_t begin = b == 0 ? params + 1 : static_cast<uint32_t>(code.size());
+        for (Value v = func.blocks[b].begin; v < func.blocks[b].end; v++) {
+            IrInst inst = func.code[v];
+            if (inst.op == IrOp::PARAM) {
+                renumber[v] = params + 1 + static_cast<uint32_t>(inst.imm);
+                continue;
+            }
+            if (v > 0 && tail[v - 1]) continue;     // the tail call's ret
+            if (tail[v]) {
+                for (uint32_t i = 0; i < params; i++) {
+                    /* Arguments come before the call, so already have their new numbers */
+                    func.incoming[firstInput + i * inputs + 1 + site] = {b + 1, renumber[func.args[inst.a + i]]};
+                }
+                site++;
+                inst = IrInst(IrOp::JMP);
+                inst.target = 1;
+            } else if (inst.op == IrOp::JMP || inst.op == IrOp::BR) {
+                inst.target++;
+                if (inst.op == IrOp::BR) inst.b++;
+            }
+            renumber[v] = static_cast<Value>(code.size());
+            code.push_back(inst);
+        }
+        blocks.push_back({begin, static_cast<uint32_t>(code.size())});
+    }
+
+    /* The header's phis are complete, the old instructions still carry old blocks and numbers */
+    uint32_t old = 2 * params + 1;
+    for (size_t i = old; i < code.size(); i++) {
+        if (code[i].op != IrOp::PHI) continue;
+        for (uint32_t k = 0; k < code[i].b; k++) func.incoming[code[i].a + k].block++;
+    }
+    func.code = std::move(code);
+    func.blocks = std::move(blocks);
+    for (size_t i = old; i < func.code.size(); i++) {
+        func.mapOperands(func.code[i], [&](Value v) { return renumber[v]; });
+    }
+    m_eliminated += static_cast<uint32_t>(sites.size());
+}
@@ -0,0 +1,76 @@
+#include "threadpool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    m_workers.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; i++) {
+        m_workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers) worker.join();
+}
+
+/* A worker that wakes late for a batch finds nothing left and goes back to sleep. run() won't
+ * post the next batch while any worker is still inside drain(), so a late one can't pick up
+ * new indices with the old task */
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) return;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&] { return m_active == 0; });
+        m_task = &task;
+        m_count = count;
+        m_finished = 0;
+        m_error = nullptr;
+        m_next.store(0);
+        m_batch++;
+    }
+    m_wake.notify_all();
+    drain(task, count);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&] { return m_finished == m_count && m_active == 0; });
+    m_task = nullptr;
+    if (m_error) std::rethrow_exception(m_error);
+}
+
+void ThreadPool::work() {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [&] { return m_stopping || m_batch != seen; });
+        if (m_stopping) return;
+        seen = m_batch;
+        if (m_task == nullptr) continue;
+        const std::function<void(size_t)>& task = *m_task;
+        size_t count = m_count;
+        m_active++;
+        lock.unlock();
+        drain(task, count);
+        lock.lock();
+        m_active--;
+        m_done.notify_all();
+    }
+}
+
+void ThreadPool::drain(const std::function<void(size_t)>& task, size_t count) {
+    for (size_t i = m_next.fetch_add(1); i < count; i = m_next.fetch_add(1)) {
+        std::exception_ptr error;
+        try {
+            task(i);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (error && !m_error) m_error = error;
+        if (++m_finished == m_count) m_done.notify_all();
+    }
+}
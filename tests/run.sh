@@ -0,0 +1,56 @@
+#!/bin/sh
+# Regression programs, each saying on its first line what should become of it
+#   // result: N       compiles, halts in the simulator, and R1 holds N then
+#   // error: TEXT     doesn't compile, and says TEXT; more // error: lines straight after
+#                      each add a message the same run has to print too
+#
+#   run.sh <compiler> <simulator> <program.stump>...
+compiler=$1
+simulator=$2
+shift 2
+failed=0
+for program in "$@"; do
+    expect=$(head -n 1 "$program")
+    output=output/tests.s
+    case $expect in
+    "// result: "*)
+        want=${expect#// result: }
+        if ! messages=$("$compiler" -o "$output" "$program" 2>&1); then
+            echo "$program: doesn't compile: $messages"
+            failed=1
+            continue
+        fi
+        # The simulator still prints a result when it gives up on the step limit or a bad fetch
+        if ! "$simulator" "$output" > output/tests.sim 2>&1; then
+            echo "$program: didn't halt: $(tail -n 1 output/tests.sim)"
+            failed=1
+            continue
+        fi
+        got=$(sed -n 's/^result: *//p' output/tests.sim)
+        if [ "$got" != "$want" ]; then
+            echo "$program: result $got, expected $want"
+            failed=1
+        fi
+        ;;
+    "// error: "*)
+        want=${expect#// error: }
+        if messages=$("$compiler" -o "$output" "$program" 2>&1); then
+            echo "$program: compiles, expected an error saying $want"
+            failed=1
+            continue
+        fi
+        sed -n '/^\/\/ error: /!q; s/^\/\/ error: //p' "$program" > output/tests.want
+        while IFS= read -r want; do
+            if ! printf '%s\n' "$messages" | grep -qF -- "$want"; then
+                echo "$program: expected an error saying $want, got: $messages"
+                failed=1
+            fi
+        done < output/tests.want
+        ;;
+    *)
+        echo "$program: first line says neither // result: nor // error:"
+        failed=1
+        ;;
+    esac
+done
+exit $failed